@@ -0,0 +1,55 @@
+#include "fixtures.h"
+#include "column_batch.h"
+#include <benchmark/benchmark.h>
+
+using namespace ingester;
+using namespace ingester::bench;
+
+namespace {
+
+// Filling the wire-format column buffers, as the writer loop does per row
+void BM_ColumnarBatchAppend(benchmark::State& state) {
+    const auto payload = static_cast<Payload>(state.range(0));
+    const size_t rows = static_cast<size_t>(state.range(1));
+    std::vector<LogEntry> entries = sample_entries(rows, payload);
+    ColumnarBatch batch;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        batch.clear();
+        for (const LogEntry& entry : entries) batch.append(entry);
+        bytes = batch.bytes();
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetLabel(payload_name(payload));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * rows));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+BENCHMARK(BM_ColumnarBatchAppend)->ArgsProduct({{0, 2}, {1000, 10000}});
+
+// Streaming a full batch out, as write_batch does through SavePrefix/SaveBody
+// (the sink only sums lengths; compression and the socket are not included)
+void BM_ColumnarBatchSerialize(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    std::vector<LogEntry> entries = sample_entries(rows, Payload::kPlain);
+    ColumnarBatch batch;
+    for (const LogEntry& entry : entries) batch.append(entry);
+
+    size_t total = 0;
+    for (auto _ : state) {
+        total = 0;
+        batch.for_each_column([&](const ColumnSpec&, const auto& column) {
+            auto sink = [&](const void* data, size_t len) {
+                benchmark::DoNotOptimize(data);
+                total += len;
+            };
+            column.write_prefix(sink);
+            column.write_body(sink);
+        });
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * rows));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * total));
+}
+BENCHMARK(BM_ColumnarBatchSerialize)->Arg(10000);
+
+} // namespace
@@ -0,0 +1,76 @@
+#include "fixtures.h"
+#include "json_scanner.h"
+#include "proto_scanner.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+using namespace ingester;
+using namespace ingester::bench;
+
+namespace {
+
+// Field scan alone: one pass, slices only
+void BM_ScanLogFields(benchmark::State& state) {
+    const auto payload = static_cast<Payload>(state.range(0));
+    const std::string json = json_payload(payload, 12345);
+    LogFieldSlices fields;
+    for (auto _ : state) {
+        bool ok = scan_log_fields(json.data(), json.size(), fields);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(fields);
+    }
+    state.SetLabel(payload_name(payload));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json.size()));
+}
+BENCHMARK(BM_ScanLogFields)->DenseRange(0, 2);
+
+// Scan plus decoding of every escaped field, as parse_message does
+void BM_ScanAndUnescape(benchmark::State& state) {
+    const auto payload = static_cast<Payload>(state.range(0));
+    const std::string json = json_payload(payload, 12345);
+    std::vector<char> out(json.size());
+    LogFieldSlices fields;
+    for (auto _ : state) {
+        scan_log_fields(json.data(), json.size(), fields);
+        size_t len = 0;
+        for (const JsonSlice* slice : {&fields.app_id, &fields.message, &fields.source, &fields.environment,
+                                       &fields.metadata, &fields.trace_id, &fields.user_id}) {
+            if (slice->escaped) unescape_json(*slice, out.data(), len);
+        }
+        benchmark::DoNotOptimize(len);
+    }
+    state.SetLabel(payload_name(payload));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * json.size()));
+}
+BENCHMARK(BM_ScanAndUnescape)->DenseRange(0, 2);
+
+// Escaping for the metadata column of pb entries
+void BM_EscapeJson(benchmark::State& state) {
+    const std::string text = json_payload(Payload::kEscaped, 7);
+    std::vector<char> out(escaped_json_length(text.data(), text.size()));
+    for (auto _ : state) {
+        char* end = escape_json(text.data(), text.size(), out.data());
+        benchmark::DoNotOptimize(end);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+BENCHMARK(BM_EscapeJson);
+
+void BM_ScanProtoBatch(benchmark::State& state) {
+    const std::string batch = proto_batch(static_cast<size_t>(state.range(0)), 1760000000000);
+    std::vector<std::string_view> entries;
+    ProtoLogFields fields;
+    for (auto _ : state) {
+        entries.clear();
+        scan_proto_batch(batch.data(), batch.size(), entries);
+        for (std::string_view entry : entries) {
+            scan_proto_log(entry.data(), entry.size(), fields);
+        }
+        benchmark::DoNotOptimize(fields);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * batch.size()));
+}
+BENCHMARK(BM_ScanProtoBatch)->Arg(100)->Arg(1000);
+
+} // namespace
@@ -0,0 +1,143 @@
+#include "fixtures.h"
+#include "config.h"
+#include "redis_consumer.h"
+#include "resp_scanner.h"
+#include <benchmark/benchmark.h>
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <stdexcept>
+
+using namespace ingester;
+using namespace ingester::bench;
+
+namespace {
+
+constexpr int64_t kBaseMs = 1760000000000;
+
+std::string recorded_json_reply(Payload payload, size_t messages) {
+    std::vector<std::string> payloads;
+    for (size_t i = 0; i < messages; ++i) payloads.push_back(json_payload(payload, i));
+    return xreadgroup_reply("logs:stream", "data", payloads, kBaseMs);
+}
+
+std::string recorded_proto_reply(size_t messages, size_t logs_per_message) {
+    std::vector<std::string> payloads;
+    for (size_t i = 0; i < messages; ++i) payloads.push_back(proto_batch(logs_per_message, kBaseMs));
+    return xreadgroup_reply("logs:stream", "pb", payloads, kBaseMs);
+}
+
+// hiredis' own reply parser over recorded RESP bytes
+redisReply* read_reply(const std::string& resp) {
+    redisReader* reader = redisReaderCreate();
+    redisReaderFeed(reader, resp.data(), resp.size());
+    void* reply = nullptr;
+    if (redisReaderGetReply(reader, &reply) != REDIS_OK || !reply) {
+        redisReaderFree(reader);
+        throw std::runtime_error("recorded reply does not parse");
+    }
+    redisReaderFree(reader);
+    return static_cast<redisReply*>(reply);
+}
+
+// RESP bytes -> redisReply tree: the hiredis work per XREADGROUP
+void BM_HiredisReadReply(benchmark::State& state) {
+    const std::string resp = recorded_json_reply(Payload::kPlain, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        redisReply* reply = read_reply(resp);
+        benchmark::DoNotOptimize(reply);
+        freeReplyObject(reply);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * resp.size()));
+}
+BENCHMARK(BM_HiredisReadReply)->Arg(100)->Arg(1000);
+
+// The same bytes sliced in place: what RAW_REPLIES=1 does instead
+void BM_RespScanReply(benchmark::State& state) {
+    const std::string resp = recorded_json_reply(Payload::kPlain, static_cast<size_t>(state.range(0)));
+    std::vector<StreamEntrySlice> entries;
+    for (auto _ : state) {
+        size_t consumed = 0;
+        if (scan_stream_reply(resp.data(), resp.size(), entries, consumed) != RespStatus::kOk) {
+            throw std::runtime_error("recorded reply does not scan");
+        }
+        benchmark::DoNotOptimize(entries.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * state.range(0)));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * resp.size()));
+}
+BENCHMARK(BM_RespScanReply)->Arg(100)->Arg(1000);
+
+/**
+ * Reply walking and parse_message for every entry, published into rings
+ * that are drained like a writer would (no Redis connection involved)
+ */
+class DispatchFixture {
+public:
+    explicit DispatchFixture(size_t rings) : consumer_(config_, "bench", "logs:stream", 0) {
+        for (size_t i = 0; i < rings; ++i) {
+            buffers_.push_back(std::make_unique<LockFreeRingBuffer<LogEntry>>(1 << 17));
+        }
+    }
+
+    size_t dispatch(redisReply* reply) {
+        size_t count = consumer_.dispatch_reply(reply, buffers_);
+        for (auto& ring : buffers_) drain(*ring);
+        return count;
+    }
+
+    size_t dispatch_raw(const std::string& resp) {
+        size_t count = consumer_.dispatch_raw(resp.data(), resp.size(), buffers_);
+        for (auto& ring : buffers_) drain(*ring);
+        return count;
+    }
+
+private:
+    Config config_;
+    RedisConsumer consumer_;
+    std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>> buffers_;
+};
+
+void BM_DispatchJsonReply(benchmark::State& state) {
+    const auto payload = static_cast<Payload>(state.range(0));
+    const size_t messages = static_cast<size_t>(state.range(1));
+    redisReply* reply = read_reply(recorded_json_reply(payload, messages));
+    DispatchFixture fixture(4);
+    size_t rows = 0;
+    for (auto _ : state) {
+        rows += fixture.dispatch(reply);
+    }
+    freeReplyObject(reply);
+    state.SetLabel(payload_name(payload));
+    state.SetItemsProcessed(static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_DispatchJsonReply)->ArgsProduct({{0, 1, 2}, {1000}});
+
+void BM_DispatchRawReply(benchmark::State& state) {
+    const auto payload = static_cast<Payload>(state.range(0));
+    const size_t messages = static_cast<size_t>(state.range(1));
+    const std::string resp = recorded_json_reply(payload, messages);
+    DispatchFixture fixture(4);
+    size_t rows = 0;
+    for (auto _ : state) {
+        rows += fixture.dispatch_raw(resp);
+    }
+    state.SetLabel(payload_name(payload));
+    state.SetItemsProcessed(static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_DispatchRawReply)->ArgsProduct({{0, 1, 2}, {1000}});
+
+void BM_DispatchProtoReply(benchmark::State& state) {
+    const size_t messages = static_cast<size_t>(state.range(0));
+    redisReply* reply = read_reply(recorded_proto_reply(messages, 100));
+    DispatchFixture fixture(4);
+    size_t rows = 0;
+    for (auto _ : state) {
+        rows += fixture.dispatch(reply);
+    }
+    freeReplyObject(reply);
+    state.SetItemsProcessed(static_cast<int64_t>(rows));
+}
+BENCHMARK(BM_DispatchProtoReply)->Arg(10)->Arg(100);
+
+} // namespace
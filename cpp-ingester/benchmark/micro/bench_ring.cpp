@@ -0,0 +1,107 @@
+#include "fixtures.h"
+#include "ring_buffer.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using namespace ingester;
+using namespace ingester::bench;
+
+namespace {
+
+constexpr size_t kRingCapacity = 1 << 16;
+
+// Same thread: the cost of the index protocol without cross-core traffic
+void BM_RingPushPopSameThread(benchmark::State& state) {
+    LockFreeRingBuffer<LogEntry> ring(kRingCapacity);
+    const size_t batch = static_cast<size_t>(state.range(0));
+    std::vector<LogEntry> entries = sample_entries(batch, Payload::kPlain);
+    for (auto _ : state) {
+        auto span = ring.reserve_write(batch);
+        for (size_t i = 0; i < span.size(); ++i) span[i] = entries[i];
+        ring.commit_write(span.size());
+        auto read = ring.peek_read(batch);
+        benchmark::DoNotOptimize(read.first);
+        ring.commit_read(read.size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * batch));
+}
+BENCHMARK(BM_RingPushPopSameThread)->Arg(1)->Arg(64)->Arg(1000);
+
+// Producer and consumer on two threads (pin with taskset to pick the cores).
+// Thread 0 pushes bulk spans, thread 1 drains; items/s is the transfer rate.
+std::unique_ptr<LockFreeRingBuffer<LogEntry>> g_ring;
+std::atomic<bool> g_producing{false};
+
+void BM_RingThroughputCrossThread(benchmark::State& state) {
+    const size_t batch = static_cast<size_t>(state.range(0));
+    if (state.thread_index() == 0) {
+        g_ring = std::make_unique<LockFreeRingBuffer<LogEntry>>(kRingCapacity);
+        g_producing.store(true);
+    }
+    // Threads start together; the consumer waits for the ring to exist
+    while (!g_producing.load()) std::this_thread::yield();
+
+    std::vector<LogEntry> entries = state.thread_index() == 0 ? sample_entries(batch, Payload::kPlain)
+                                                              : std::vector<LogEntry>();
+    size_t moved = 0;
+    for (auto _ : state) {
+        if (state.thread_index() == 0) {
+            size_t done = 0;
+            while (done < batch) {
+                auto span = g_ring->reserve_write(batch - done);
+                for (size_t i = 0; i < span.size(); ++i) span[i] = entries[done + i];
+                g_ring->commit_write(span.size());
+                done += span.size();
+                if (span.size() == 0) cpu_relax();
+            }
+            moved += batch;
+        } else {
+            size_t done = 0;
+            while (done < batch) {
+                auto span = g_ring->peek_read(batch - done);
+                g_ring->commit_read(span.size());
+                done += span.size();
+                if (span.size() == 0) cpu_relax();
+            }
+            moved += batch;
+        }
+    }
+    // Counted once, on the producer: both threads see every item
+    if (state.thread_index() == 0) {
+        state.SetItemsProcessed(static_cast<int64_t>(moved));
+        g_producing.store(false);
+    }
+}
+BENCHMARK(BM_RingThroughputCrossThread)->Arg(1)->Arg(64)->Arg(1000)->Threads(2)->UseRealTime();
+
+// One-entry round trip over a pair of rings: reported time is the
+// cross-core hand-off latency times two
+void BM_RingPingPong(benchmark::State& state) {
+    LockFreeRingBuffer<LogEntry> ping(1024);
+    LockFreeRingBuffer<LogEntry> pong(1024);
+    std::atomic<bool> stop{false};
+    std::thread echo([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (auto entry = ping.try_pop()) {
+                while (!pong.try_push(std::move(*entry))) cpu_relax();
+            } else {
+                cpu_relax();
+            }
+        }
+    });
+
+    LogEntry entry;
+    for (auto _ : state) {
+        while (!ping.try_push(LogEntry(entry))) cpu_relax();
+        std::optional<LogEntry> back;
+        while (!(back = pong.try_pop())) cpu_relax();
+        benchmark::DoNotOptimize(back);
+    }
+    stop.store(true);
+    echo.join();
+}
+BENCHMARK(BM_RingPingPong)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "log_entry.h"
+#include "ring_buffer.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ingester::bench {
+
+/**
+ * Payload shapes seen in production streams
+ */
+enum class Payload {
+    kPlain,         // Short ASCII fields, empty metadata
+    kEscaped,       // Quotes, newlines and \u escapes in message and metadata
+    kLargeMetadata, // ~2 KB escaped metadataString
+};
+
+inline const char* payload_name(Payload payload) {
+    switch (payload) {
+        case Payload::kPlain: return "plain";
+        case Payload::kEscaped: return "escaped";
+        case Payload::kLargeMetadata: return "large_metadata";
+    }
+    return "?";
+}
+
+inline std::string json_payload(Payload payload, size_t n) {
+    const std::string index = std::to_string(n);
+    std::string message = "Order " + index + " placed for customer 42";
+    std::string metadata = "{}";
+    if (payload == Payload::kEscaped) {
+        message = "Request failed: \\\"timeout\\\" after 30s\\n\\tat handler.js:" + index +
+                  " caf\\u00e9 \\ud83d\\ude80";
+        metadata = "{\\\"path\\\":\\\"/api/v1/orders\\\",\\\"status\\\":504,\\\"retry\\\":true}";
+    } else if (payload == Payload::kLargeMetadata) {
+        metadata = "{";
+        for (int i = 0; i < 48; ++i) {
+            if (i > 0) metadata += ",";
+            metadata += "\\\"attribute_" + std::to_string(i) + "\\\":\\\"value-" + index + "-abcdefghij\\\"";
+        }
+        metadata += "}";
+    }
+    return "{\"appId\":\"checkout-service\",\"level\":\"ERROR\",\"message\":\"" + message +
+           "\",\"source\":\"api-7f9c4\",\"environment\":\"production\",\"metadataString\":\"" + metadata +
+           "\",\"traceId\":\"4bf92f3577b34da6a3ce929d0e0e4736\",\"userId\":\"user-" + index + "\"}";
+}
+
+// Minimal protobuf writer for logs.LogEntryBatch
+class ProtoWriter {
+public:
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            out_ += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out_ += static_cast<char>(value);
+    }
+    void tag(uint32_t field, uint32_t wire_type) { varint((field << 3) | wire_type); }
+    void bytes(uint32_t field, std::string_view value) {
+        tag(field, 2);
+        varint(value.size());
+        out_.append(value);
+    }
+    void uint(uint32_t field, uint64_t value) {
+        tag(field, 0);
+        varint(value);
+    }
+    std::string& str() { return out_; }
+
+private:
+    std::string out_;
+};
+
+inline std::string proto_batch(size_t entries, int64_t base_ms) {
+    ProtoWriter batch;
+    for (size_t i = 0; i < entries; ++i) {
+        ProtoWriter entry;
+        entry.bytes(2, "checkout-service");
+        entry.uint(3, static_cast<uint64_t>(base_ms + static_cast<int64_t>(i)));
+        entry.uint(4, 3);
+        entry.bytes(5, "Order " + std::to_string(i) + " placed for customer 42");
+        entry.bytes(6, "api-7f9c4");
+        entry.bytes(7, "production");
+        for (int m = 0; m < 4; ++m) {
+            ProtoWriter kv;
+            kv.bytes(1, "key" + std::to_string(m));
+            kv.bytes(2, "value \"" + std::to_string(i) + "\"");
+            entry.bytes(8, kv.str());
+        }
+        entry.bytes(9, "4bf92f3577b34da6a3ce929d0e0e4736");
+        entry.bytes(10, "user-" + std::to_string(i));
+        batch.bytes(1, entry.str());
+    }
+    return batch.str();
+}
+
+/**
+ * RESP bytes of an XREADGROUP reply for one stream, as Redis sends them
+ */
+inline std::string xreadgroup_reply(std::string_view stream, std::string_view field,
+                                    const std::vector<std::string>& payloads, int64_t base_ms) {
+    auto bulk = [](std::string& out, std::string_view s) {
+        out += "$" + std::to_string(s.size()) + "\r\n";
+        out.append(s);
+        out += "\r\n";
+    };
+    std::string out = "*1\r\n*2\r\n";
+    bulk(out, stream);
+    out += "*" + std::to_string(payloads.size()) + "\r\n";
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        out += "*2\r\n";
+        bulk(out, std::to_string(base_ms + static_cast<int64_t>(i / 4)) + "-" + std::to_string(i % 4));
+        out += "*2\r\n";
+        bulk(out, field);
+        bulk(out, payloads[i]);
+    }
+    return out;
+}
+
+/**
+ * Rows as a writer sees them; static strings, no arena
+ */
+inline std::vector<LogEntry> sample_entries(size_t count, Payload payload) {
+    static std::vector<std::string> storage;
+    storage.clear();
+    storage.reserve(count * 2);
+    std::vector<LogEntry> entries(count);
+    uint64_t state = 42;
+    for (size_t i = 0; i < count; ++i) {
+        LogEntry& e = entries[i];
+        e.timestamp_ms = 1760000000000 + static_cast<int64_t>(i);
+        e.id = make_uuid_v7(e.timestamp_ms, splitmix64(state), splitmix64(state));
+        e.app_id = i % 7 == 0 ? "billing-service" : "checkout-service";
+        storage.push_back(payload == Payload::kPlain ? "Order " + std::to_string(i) + " placed"
+                                                     : json_payload(payload, i));
+        e.message = storage.back();
+        e.source = "api-7f9c4";
+        e.level = static_cast<int8_t>(1 + i % 5);
+        e.environment = "production";
+        e.metadata = payload == Payload::kLargeMetadata ? std::string_view(storage.back()) : "{}";
+        e.trace_id = i % 3 == 0 ? std::string_view() : "4bf92f3577b34da6a3ce929d0e0e4736";
+        storage.push_back("user-" + std::to_string(i % 1000));
+        e.user_id = storage.back();
+        e.redis_id = "1760000000000-0";
+    }
+    return entries;
+}
+
+// Consume everything in a ring the way a writer does
+inline size_t drain(LockFreeRingBuffer<LogEntry>& ring) {
+    size_t total = 0;
+    while (true) {
+        auto span = ring.peek_read(ring.capacity());
+        if (span.size() == 0) return total;
+        release_arenas(span.first, span.first_len);
+        release_arenas(span.second, span.second_len);
+        ring.commit_read(span.size());
+        total += span.size();
+    }
+}
+
+} // namespace ingester::bench
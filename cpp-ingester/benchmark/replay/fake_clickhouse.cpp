@@ -0,0 +1,214 @@
+#include "fake_clickhouse.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace ingester::replay {
+
+namespace {
+
+// Packet codes
+constexpr uint64_t kClientHello = 0;
+constexpr uint64_t kClientData = 2;
+constexpr uint64_t kServerHello = 0;
+constexpr uint64_t kServerData = 1;
+constexpr uint64_t kServerException = 2;
+constexpr uint64_t kServerEndOfStream = 5;
+
+// Protocol revisions that change what is on the wire
+constexpr uint64_t kRevisionCustomSerialization = 54454;  // Per-column "has custom" byte
+constexpr uint64_t kRevisionParameters = 54459;           // Query parameters after the query text
+constexpr uint64_t kRevisionPasswordRules = 54461;        // Password complexity rules in the hello
+constexpr uint64_t kRevisionNonce = 54462;                // Interserver nonce in the hello
+constexpr uint64_t kMaxRevision = kRevisionNonce;
+
+class WireWriter {
+public:
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            out_ += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out_ += static_cast<char>(value);
+    }
+    void string(std::string_view s) {
+        varint(s.size());
+        out_.append(s);
+    }
+    template<typename T> void fixed(T value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    // Block info (overflows = 0, bucket = -1), then an empty column list
+    void empty_block() {
+        varint(1);
+        fixed<uint8_t>(0);
+        varint(2);
+        fixed<int32_t>(-1);
+        varint(0);
+        varint(0);
+        varint(0);
+    }
+
+    bool send(int fd) { return send_all(fd, out_.data(), out_.size()); }
+
+private:
+    std::string out_;
+};
+
+bool starts_with(const std::string& s, std::string_view prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+} // namespace
+
+FakeClickHouse::FakeClickHouse(SinkOptions options) : options_(options) {}
+
+FakeClickHouse::~FakeClickHouse() {
+    stop();
+}
+
+bool FakeClickHouse::handshake(SocketReader& reader, int fd, uint64_t& revision) {
+    // Hello: name, major, minor, revision, database, user, password
+    uint64_t code = 0, major = 0, minor = 0;
+    std::string name;
+    if (!reader.read_varint(code) || code != kClientHello || !reader.read_string(name) ||
+        !reader.read_varint(major) || !reader.read_varint(minor) || !reader.read_varint(revision) ||
+        !reader.skip_string() || !reader.skip_string() || !reader.skip_string()) {
+        return false;
+    }
+    // Same revision both ways, so every version-gated field agrees
+    revision = std::min(revision, kMaxRevision);
+
+    WireWriter hello;
+    hello.varint(kServerHello);
+    hello.string("ClickHouse");
+    hello.varint(24);
+    hello.varint(8);
+    hello.varint(revision);
+    hello.string("UTC");
+    hello.string("replay-sink");
+    hello.varint(0);
+    if (revision >= kRevisionPasswordRules) hello.varint(0);
+    if (revision >= kRevisionNonce) hello.fixed<uint64_t>(0);
+    return hello.send(fd);
+}
+
+void FakeClickHouse::serve(int fd) {
+    SocketReader reader(fd);
+    uint64_t revision = 0;
+    if (!handshake(reader, fd, revision)) return;
+
+    std::mt19937 rng(static_cast<uint32_t>(fd));
+    while (!stopping()) {
+        // The query text ends the Query packet of an INSERT; skipping to it
+        // also passes over client info, settings and the hello addendum
+        if (!reader.skip_past(" VALUES")) return;
+        std::string parameters;
+        if (revision >= kRevisionParameters && (!reader.read_string(parameters) || !parameters.empty())) {
+            ++decode_errors_;
+            return;
+        }
+
+        // Empty block for external tables, then the table header goes back
+        uint64_t code = 0, rows = 0;
+        if (!reader.read_varint(code) || code != kClientData || !read_block(reader, revision, rows)) {
+            ++decode_errors_;
+            return;
+        }
+        WireWriter header;
+        header.varint(kServerData);
+        header.string("");
+        header.empty_block();
+        if (!header.send(fd)) return;
+
+        // Data blocks until an empty one
+        uint64_t total = 0;
+        do {
+            if (!reader.read_varint(code) || code != kClientData || !read_block(reader, revision, rows)) {
+                ++decode_errors_;
+                return;
+            }
+            total += rows;
+        } while (rows > 0);
+
+        int delay_ms = options_.insert_latency_ms;
+        if (options_.insert_jitter_ms > 0) {
+            delay_ms += std::uniform_int_distribution<int>(0, options_.insert_jitter_ms)(rng);
+        }
+        if (delay_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+
+        WireWriter reply;
+        const uint64_t seq = ++insert_seq_;
+        if (options_.fail_every > 0 && seq % options_.fail_every == 0) {
+            // code, name, message, stack trace, has nested
+            reply.varint(kServerException);
+            reply.fixed<int32_t>(252);
+            reply.string("DB::Exception");
+            reply.string("Injected by the replay sink");
+            reply.string("");
+            reply.fixed<uint8_t>(0);
+            ++failed_;
+        } else {
+            reply.varint(kServerEndOfStream);
+            rows_ += total;
+            ++inserts_;
+        }
+        if (!reply.send(fd)) return;
+    }
+}
+
+bool FakeClickHouse::read_block(SocketReader& reader, uint64_t revision, uint64_t& rows) {
+    // Temporary table name, block info fields up to 0, columns, rows
+    if (!reader.skip_string()) return false;
+    for (uint64_t field = 0;;) {
+        if (!reader.read_varint(field)) return false;
+        if (field == 0) break;
+        if (field == 1 && !reader.skip(1)) return false;
+        if (field == 2 && !reader.skip(4)) return false;
+        if (field > 2) return false;
+    }
+    uint64_t columns = 0;
+    if (!reader.read_varint(columns) || !reader.read_varint(rows)) return false;
+
+    std::string name, type;
+    for (uint64_t c = 0; c < columns; ++c) {
+        if (!reader.read_string(name) || !reader.read_string(type)) return false;
+        uint8_t custom = 0;
+        if (revision >= kRevisionCustomSerialization && (!reader.read_u8(custom) || custom != 0)) return false;
+        if (rows > 0 && !read_column(reader, type, rows)) return false;
+    }
+    return true;
+}
+
+bool FakeClickHouse::read_column(SocketReader& reader, const std::string& type, uint64_t rows) {
+    if (type == "String") {
+        for (uint64_t i = 0; i < rows; ++i) {
+            if (!reader.skip_string()) return false;
+        }
+        return true;
+    }
+    if (starts_with(type, "Nullable(")) {
+        // Null map, then the nested column
+        return reader.skip(rows) && read_column(reader, type.substr(9, type.size() - 10), rows);
+    }
+    if (starts_with(type, "LowCardinality(")) {
+        // Key version; index type and flags, dictionary, row count, indexes
+        uint64_t version = 0, flags = 0, keys = 0, indexes = 0;
+        if (!reader.read_u64(version) || !reader.read_u64(flags) || !reader.read_u64(keys)) return false;
+        for (uint64_t i = 0; i < keys; ++i) {
+            if (!reader.skip_string()) return false;
+        }
+        if (!reader.read_u64(indexes) || indexes != rows || (flags & 0xff) > 3) return false;
+        return reader.skip(indexes << (flags & 0xff));
+    }
+
+    size_t width = 0;
+    if (starts_with(type, "Enum8(") || type == "Int8" || type == "UInt8") width = 1;
+    else if (starts_with(type, "Enum16(") || type == "Int16" || type == "UInt16") width = 2;
+    else if (type == "DateTime" || type == "Int32" || type == "UInt32" || type == "Float32") width = 4;
+    else if (starts_with(type, "DateTime64(") || type == "Int64" || type == "UInt64" || type == "Float64") width = 8;
+    else if (type == "UUID") width = 16;
+    return width > 0 && reader.skip(rows * width);
+}
+
+} // namespace ingester::replay
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "loopback_server.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ingester::replay {
+
+struct SinkOptions {
+    int insert_latency_ms = 0;      // Held before each insert completes
+    int insert_jitter_ms = 0;       // Plus a uniform 0..jitter on top
+    size_t fail_every = 0;          // Every n-th insert ends in a server exception (0 = never)
+};
+
+/**
+ * ClickHouse native-protocol sink for INSERT ... VALUES
+ *
+ * Answers the handshake at the client's own revision (capped at the
+ * newest one modelled here), sends the empty table header the client
+ * waits for, then decodes every data block column by column for the
+ * types of the logs table, so a malformed block is counted instead of
+ * silently accepted. Nothing is stored.
+ *
+ * Blocks must be uncompressed (CLICKHOUSE_COMPRESSION=none): the LZ4
+ * frames carry CityHash checksums this sink does not verify or produce.
+ */
+class FakeClickHouse : public LoopbackServer {
+public:
+    explicit FakeClickHouse(SinkOptions options);
+    ~FakeClickHouse() override;
+
+    uint64_t rows() const { return rows_.load(); }
+    uint64_t inserts() const { return inserts_.load(); }
+    uint64_t failed_inserts() const { return failed_.load(); }
+    uint64_t decode_errors() const { return decode_errors_.load(); }
+
+protected:
+    void serve(int fd) override;
+
+private:
+    bool handshake(SocketReader& reader, int fd, uint64_t& revision);
+    bool read_block(SocketReader& reader, uint64_t revision, uint64_t& rows);
+    bool read_column(SocketReader& reader, const std::string& type, uint64_t rows);
+
+    const SinkOptions options_;
+    std::atomic<uint64_t> rows_{0};
+    std::atomic<uint64_t> inserts_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> decode_errors_{0};
+    std::atomic<uint64_t> insert_seq_{0};
+};
+
+} // namespace ingester::replay
@@ -0,0 +1,192 @@
+#include "fake_redis.h"
+#include <algorithm>
+#include <cstdlib>
+#include <strings.h>
+#include <thread>
+
+namespace ingester::replay {
+
+namespace {
+
+void append_bulk(std::string& out, std::string_view s) {
+    out += '$';
+    out += std::to_string(s.size());
+    out += "\r\n";
+    out.append(s);
+    out += "\r\n";
+}
+
+bool is(const std::string& arg, const char* name) {
+    return strcasecmp(arg.c_str(), name) == 0;
+}
+
+int64_t wall_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+FakeRedis::FakeRedis(const StreamDump& dump, size_t entries)
+    : dump_(dump), entries_(entries), delivered_at_(entries), acked_flags_(entries, false) {}
+
+FakeRedis::~FakeRedis() {
+    stop();
+}
+
+size_t FakeRedis::delivered() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_;
+}
+
+size_t FakeRedis::acked() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return acked_;
+}
+
+bool FakeRedis::wait_acked(Clock::duration timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return acked_cv_.wait_for(lock, timeout, [this] { return acked_ >= entries_; });
+}
+
+FakeRedis::Clock::duration FakeRedis::active_time() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return acked_ > 0 ? last_ack_ - first_delivery_ : Clock::duration::zero();
+}
+
+void FakeRedis::serve(int fd) {
+    SocketReader reader(fd);
+    std::vector<std::string> argv;
+    std::string line, out;
+    while (!stopping()) {
+        // hiredis only sends arrays of bulk strings
+        if (!reader.read_line(line) || line.empty() || line[0] != '*') return;
+        const long argc = std::atol(line.c_str() + 1);
+        argv.resize(static_cast<size_t>(std::max(0L, argc)));
+        for (auto& arg : argv) {
+            if (!reader.read_line(line) || line.empty() || line[0] != '$') return;
+            arg.resize(static_cast<size_t>(std::atol(line.c_str() + 1)));
+            if (!reader.read(arg.data(), arg.size()) || !reader.skip(2)) return;
+        }
+        if (argv.empty()) return;
+
+        out.clear();
+        handle(argv, out);
+        if (!send_all(fd, out.data(), out.size())) return;
+    }
+}
+
+void FakeRedis::handle(const std::vector<std::string>& argv, std::string& out) {
+    const std::string& cmd = argv[0];
+    if (is(cmd, "XREADGROUP")) {
+        read_group(argv, out);
+    } else if (is(cmd, "XACK")) {
+        out = ":" + std::to_string(ack(argv)) + "\r\n";
+    } else if (is(cmd, "XAUTOCLAIM")) {
+        // Nobody else consumes: nothing is ever idle elsewhere
+        out = "*3\r\n$3\r\n0-0\r\n*0\r\n*0\r\n";
+    } else if (is(cmd, "XDEL")) {
+        out = ":" + std::to_string(argv.size() > 2 ? argv.size() - 2 : 0) + "\r\n";
+    } else if (is(cmd, "XTRIM")) {
+        out = ":0\r\n";
+    } else if (is(cmd, "XLEN")) {
+        out = ":" + std::to_string(entries_) + "\r\n";
+    } else if (is(cmd, "XGROUP") || is(cmd, "AUTH") || is(cmd, "SELECT") || is(cmd, "CLIENT")) {
+        out = "+OK\r\n";
+    } else if (is(cmd, "PING")) {
+        out = "+PONG\r\n";
+    } else {
+        out = "-ERR unknown command '" + cmd + "'\r\n";
+    }
+}
+
+void FakeRedis::read_group(const std::vector<std::string>& argv, std::string& out) {
+    // XREADGROUP GROUP g c [BLOCK ms] [COUNT n] STREAMS key id
+    long block_ms = -1;
+    size_t count = 1;
+    size_t streams = 0;
+    for (size_t i = 4; i + 1 < argv.size(); ++i) {
+        if (is(argv[i], "BLOCK")) block_ms = std::atol(argv[++i].c_str());
+        else if (is(argv[i], "COUNT")) count = static_cast<size_t>(std::atol(argv[++i].c_str()));
+        else if (is(argv[i], "STREAMS")) { streams = i + 1; break; }
+    }
+    if (streams == 0 || streams + 1 >= argv.size()) {
+        out = "-ERR syntax error\r\n";
+        return;
+    }
+    const std::string& key = argv[streams];
+    const std::string& id = argv[streams + 1];
+
+    // History reads (crash recovery): the PEL starts empty every run
+    if (id != ">") {
+        out = "*1\r\n*2\r\n";
+        append_bulk(out, key);
+        out += "*0\r\n";
+        return;
+    }
+
+    // Claim a range of deliveries; the reply is built outside the lock
+    size_t first = 0, n = 0;
+    int64_t ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        first = next_;
+        n = std::min(count, entries_ - next_);
+        next_ += n;
+        last_ms_ = std::max(last_ms_, wall_ms());
+        ms = last_ms_;
+        const auto now = Clock::now();
+        if (first == 0 && n > 0) first_delivery_ = now;
+        std::fill(delivered_at_.begin() + static_cast<std::ptrdiff_t>(first),
+                  delivered_at_.begin() + static_cast<std::ptrdiff_t>(first + n), now);
+    }
+
+    if (n == 0) {
+        // Replay done: hold BLOCK reads like an idle stream would
+        const auto deadline = Clock::now() + std::chrono::milliseconds(std::max(0L, block_ms));
+        while (block_ms > 0 && !stopping() && Clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        out = "*-1\r\n";
+        return;
+    }
+
+    out = "*1\r\n*2\r\n";
+    append_bulk(out, key);
+    out += '*';
+    out += std::to_string(n);
+    out += "\r\n";
+    const std::string prefix = std::to_string(ms) + "-";
+    for (size_t i = first; i < first + n; ++i) {
+        const StreamEntry& entry = dump_[i % dump_.size()];
+        out += "*2\r\n";
+        append_bulk(out, prefix + std::to_string(i));
+        out += "*2\r\n";
+        append_bulk(out, entry.field);
+        append_bulk(out, entry.value);
+    }
+}
+
+size_t FakeRedis::ack(const std::vector<std::string>& argv) {
+    // XACK key group id...
+    const auto now = Clock::now();
+    size_t count = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 3; i < argv.size(); ++i) {
+        const size_t dash = argv[i].find('-');
+        if (dash == std::string::npos) continue;
+        const size_t index = std::strtoull(argv[i].c_str() + dash + 1, nullptr, 10);
+        if (index >= next_ || acked_flags_[index]) continue;
+        acked_flags_[index] = true;
+        ack_latency_.record(now - delivered_at_[index]);
+        ++count;
+    }
+    if (count > 0) {
+        acked_ += count;
+        last_ack_ = now;
+        if (acked_ >= entries_) acked_cv_.notify_all();
+    }
+    return count;
+}
+
+} // namespace ingester::replay
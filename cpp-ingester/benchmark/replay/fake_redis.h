@@ -0,0 +1,70 @@
+#pragma once
+
+#include "loopback_server.h"
+#include "stream_dump.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ingester::replay {
+
+/**
+ * RESP server that replays a stream dump to one consumer group
+ *
+ * Speaks what the ingester sends: XGROUP CREATE, XREADGROUP (">" delivers
+ * the next entries, an explicit ID reads an always-empty PEL), XAUTOCLAIM,
+ * XACK, XDEL, XTRIM, XLEN and PING. The dump is cycled until `entries`
+ * have been delivered, shared by every stream key and consumer.
+ *
+ * IDs are "<now ms>-<n>" with n the global delivery index, so they stay
+ * increasing, the ingester's e2e lag sees the delivery time, and an XACK
+ * finds its delivery time without a map.
+ */
+class FakeRedis : public LoopbackServer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FakeRedis(const StreamDump& dump, size_t entries);
+    ~FakeRedis() override;
+
+    size_t delivered() const;
+    size_t acked() const;
+
+    // Block until every entry is ACKed or `timeout` passes
+    bool wait_acked(Clock::duration timeout);
+
+    // First delivery to last new ACK
+    Clock::duration active_time() const;
+
+    // Delivery (reply sent) -> XACK received, per entry
+    const LatencyHistogram& ack_latency() const { return ack_latency_; }
+
+protected:
+    void serve(int fd) override;
+
+private:
+    void handle(const std::vector<std::string>& argv, std::string& out);
+    void read_group(const std::vector<std::string>& argv, std::string& out);
+    size_t ack(const std::vector<std::string>& argv);
+
+    const StreamDump& dump_;
+    const size_t entries_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable acked_cv_;
+    size_t next_ = 0;
+    size_t acked_ = 0;
+    int64_t last_ms_ = 0;
+    std::vector<Clock::time_point> delivered_at_;
+    std::vector<bool> acked_flags_;
+    Clock::time_point first_delivery_{};
+    Clock::time_point last_ack_{};
+    LatencyHistogram ack_latency_;
+};
+
+} // namespace ingester::replay
@@ -0,0 +1,173 @@
+#include "loopback_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ingester::replay {
+
+LoopbackServer::~LoopbackServer() {
+    stop();
+}
+
+bool LoopbackServer::start() {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) return false;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, 64) != 0 ||
+        ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    running_.store(true);
+    accept_thread_ = std::thread(&LoopbackServer::accept_loop, this);
+    return true;
+}
+
+void LoopbackServer::stop() {
+    if (!running_.exchange(false)) return;
+    if (accept_thread_.joinable()) accept_thread_.join();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+
+    // Wake connection threads blocked in recv
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        for (int fd : connection_fds_) ::shutdown(fd, SHUT_RDWR);
+        threads.swap(connection_threads_);
+    }
+    for (auto& t : threads) t.join();
+}
+
+void LoopbackServer::accept_loop() {
+    while (running_.load()) {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 100) <= 0) continue;
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connection_fds_.push_back(fd);
+        connection_threads_.emplace_back([this, fd] {
+            serve(fd);
+            std::lock_guard<std::mutex> guard(connections_mutex_);
+            connection_fds_.erase(std::find(connection_fds_.begin(), connection_fds_.end(), fd));
+            ::close(fd);
+        });
+    }
+}
+
+bool send_all(int fd, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool SocketReader::fill(size_t want) {
+    while (buf_.size() - pos_ < want) {
+        // Compact once the consumed prefix dominates
+        if (pos_ > 0 && pos_ >= buf_.size() / 2) {
+            buf_.erase(buf_.begin(), buf_.begin() + static_cast<std::ptrdiff_t>(pos_));
+            pos_ = 0;
+        }
+        const size_t old_size = buf_.size();
+        buf_.resize(old_size + std::max<size_t>(64 << 10, want));
+        ssize_t n = ::recv(fd_, buf_.data() + old_size, buf_.size() - old_size, 0);
+        buf_.resize(old_size + static_cast<size_t>(std::max<ssize_t>(n, 0)));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+    }
+    return true;
+}
+
+bool SocketReader::read(void* out, size_t len) {
+    if (!fill(len)) return false;
+    std::memcpy(out, buf_.data() + pos_, len);
+    pos_ += len;
+    return true;
+}
+
+bool SocketReader::skip(size_t len) {
+    if (!fill(len)) return false;
+    pos_ += len;
+    return true;
+}
+
+bool SocketReader::read_varint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (!read_u8(byte)) return false;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool SocketReader::read_string(std::string& out) {
+    uint64_t len;
+    if (!read_varint(len) || !fill(len)) return false;
+    out.assign(buf_.data() + pos_, len);
+    pos_ += len;
+    return true;
+}
+
+bool SocketReader::skip_string() {
+    uint64_t len;
+    return read_varint(len) && skip(len);
+}
+
+bool SocketReader::read_line(std::string& out) {
+    size_t scanned = 0;  // Relative to pos_, as in skip_past
+    while (true) {
+        std::string_view window(buf_.data() + pos_, buf_.size() - pos_);
+        size_t end = window.find('\n', scanned);
+        if (end != std::string_view::npos) {
+            size_t len = end > 0 && window[end - 1] == '\r' ? end - 1 : end;
+            out.assign(window.data(), len);
+            pos_ += end + 1;
+            return true;
+        }
+        scanned = window.size();
+        if (!fill(window.size() + 1)) return false;
+    }
+}
+
+bool SocketReader::skip_past(std::string_view marker) {
+    size_t scanned = 0;  // Relative to pos_, so compaction in fill() is harmless
+    while (true) {
+        std::string_view window(buf_.data() + pos_, buf_.size() - pos_);
+        size_t found = window.find(marker, scanned);
+        if (found != std::string_view::npos) {
+            pos_ += found + marker.size();
+            return true;
+        }
+        if (window.size() >= marker.size()) scanned = window.size() - marker.size() + 1;
+        if (!fill(window.size() + 1)) return false;
+    }
+}
+
+} // namespace ingester::replay
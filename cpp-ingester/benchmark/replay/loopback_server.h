@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace ingester::replay {
+
+/**
+ * TCP server on 127.0.0.1 with an ephemeral port and one thread per connection
+ *
+ * Subclasses implement serve(); stop() shuts every connection down so
+ * blocked reads return. Subclass destructors must call stop() before their
+ * own members go away.
+ */
+class LoopbackServer {
+public:
+    LoopbackServer() = default;
+    virtual ~LoopbackServer();
+
+    LoopbackServer(const LoopbackServer&) = delete;
+    LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+    bool start();
+    void stop();
+
+    int port() const { return port_; }
+
+protected:
+    // Runs on the connection's own thread; the fd is closed afterwards
+    virtual void serve(int fd) = 0;
+
+    bool stopping() const { return !running_.load(); }
+
+private:
+    void accept_loop();
+
+    int listen_fd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> running_{false};
+    std::thread accept_thread_;
+    std::mutex connections_mutex_;
+    std::vector<int> connection_fds_;
+    std::vector<std::thread> connection_threads_;
+};
+
+bool send_all(int fd, const void* data, size_t len);
+
+/**
+ * Buffered blocking reads from a socket
+ *
+ * Every read returns false once the peer is gone (or the server stops),
+ * which is how connection threads end.
+ */
+class SocketReader {
+public:
+    explicit SocketReader(int fd) : fd_(fd) {}
+
+    bool read(void* out, size_t len);
+    bool skip(size_t len);
+    bool read_u8(uint8_t& value) { return read(&value, 1); }
+    bool read_u64(uint64_t& value) { return read(&value, sizeof(value)); }
+
+    // ClickHouse wire: LEB128 varint and varint-length-prefixed string
+    bool read_varint(uint64_t& value);
+    bool read_string(std::string& out);
+    bool skip_string();
+
+    // RESP: one line without the trailing \r\n
+    bool read_line(std::string& out);
+
+    // Consume everything up to and including `marker`
+    bool skip_past(std::string_view marker);
+
+private:
+    bool fill(size_t want);
+
+    int fd_;
+    std::vector<char> buf_;
+    size_t pos_ = 0;
+};
+
+} // namespace ingester::replay
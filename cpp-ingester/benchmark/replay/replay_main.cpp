@@ -0,0 +1,263 @@
+#include "fake_clickhouse.h"
+#include "fake_redis.h"
+#include "stream_dump.h"
+#include "ack_pipeline.h"
+#include "affinity.h"
+#include "batch_queue.h"
+#include "clickhouse_writer.h"
+#include "config.h"
+#include "logger.h"
+#include "metrics.h"
+#include "redis_consumer.h"
+#include "ring_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ingester;
+using namespace ingester::replay;
+
+namespace {
+
+struct Options {
+    std::string dump_path;
+    std::string payload = "plain";
+    size_t entries = 200000;
+    std::vector<int> writers = {1, 2, 4};
+    std::vector<size_t> batches = {1000, 10000};
+    int timeout_s = 120;
+    SinkOptions sink;
+    std::string capture_path;
+};
+
+struct RunResult {
+    bool completed = false;
+    uint64_t rows = 0;
+    uint64_t inserts = 0;
+    uint64_t failed_inserts = 0;
+    uint64_t decode_errors = 0;
+    double seconds = 0;
+    uint64_t ack_p50_ns = 0, ack_p99_ns = 0;
+    uint64_t insert_p50_ns = 0, insert_p99_ns = 0;
+};
+
+template<typename T>
+std::vector<T> parse_list(const char* arg) {
+    std::vector<T> out;
+    std::stringstream in(arg);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) out.push_back(static_cast<T>(std::strtoull(item.c_str(), nullptr, 10)));
+    }
+    return out;
+}
+
+void usage() {
+    std::cout << "Usage: ingester_replay [options]\n"
+              << "  --dump FILE             Replay a captured dump (default: synthetic entries)\n"
+              << "  --payload KIND          Synthetic entries: plain | escaped | large_metadata | proto\n"
+              << "  --entries N             Stream entries delivered per run (default 200000)\n"
+              << "  --writers LIST          writer_threads to sweep, e.g. 1,2,4\n"
+              << "  --batch LIST            batch_size to sweep, e.g. 1000,10000\n"
+              << "  --insert-latency-ms N   Sink latency per insert\n"
+              << "  --insert-jitter-ms N    Plus uniform 0..N ms\n"
+              << "  --fail-every N          Every N-th insert fails with a server exception\n"
+              << "  --timeout-s N           Give up on a run after N seconds (default 120)\n"
+              << "  --capture FILE          Dump --entries entries of STREAM_KEY from REDIS_HOST and exit\n"
+              << "Other settings come from the ingester's environment variables.\n";
+}
+
+bool parse_options(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        auto is = [&](const char* name) { return std::strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if (is("--dump")) opt.dump_path = argv[++i];
+        else if (is("--payload")) opt.payload = argv[++i];
+        else if (is("--entries")) opt.entries = std::strtoull(argv[++i], nullptr, 10);
+        else if (is("--writers")) opt.writers = parse_list<int>(argv[++i]);
+        else if (is("--batch")) opt.batches = parse_list<size_t>(argv[++i]);
+        else if (is("--insert-latency-ms")) opt.sink.insert_latency_ms = std::atoi(argv[++i]);
+        else if (is("--insert-jitter-ms")) opt.sink.insert_jitter_ms = std::atoi(argv[++i]);
+        else if (is("--fail-every")) opt.sink.fail_every = std::strtoull(argv[++i], nullptr, 10);
+        else if (is("--timeout-s")) opt.timeout_s = std::atoi(argv[++i]);
+        else if (is("--capture")) opt.capture_path = argv[++i];
+        else {
+            usage();
+            return false;
+        }
+    }
+    return opt.entries > 0 && !opt.writers.empty() && !opt.batches.empty();
+}
+
+/**
+ * One pass of the real pipeline (readers, writers, acker) against fresh
+ * fake servers, wired as main() does, until every entry is ACKed
+ */
+RunResult run_once(Config config, const StreamDump& dump, const Options& opt) {
+    RunResult result;
+    FakeRedis redis(dump, opt.entries);
+    FakeClickHouse clickhouse(opt.sink);
+    if (!redis.start() || !clickhouse.start()) {
+        std::cerr << "cannot listen on loopback\n";
+        return result;
+    }
+    config.redis_host = "127.0.0.1";
+    config.redis_port = redis.port();
+    config.clickhouse_host = "127.0.0.1";
+    config.clickhouse_native_port = clickhouse.port();
+    config.clickhouse_compression = "none";
+    metrics().insert.reset();
+
+    const int reader_count = config.effective_reader_threads();
+    const int writer_count = config.writer_pool_size();
+    const size_t ring_size = std::max<size_t>(1024, config.ring_buffer_size / reader_count);
+    std::vector<std::unique_ptr<Parker>> writer_parkers;
+    std::vector<std::unique_ptr<Parker>> reader_parkers;
+    for (int w = 0; w < writer_count; ++w) writer_parkers.push_back(std::make_unique<Parker>());
+    for (int r = 0; r < reader_count; ++r) reader_parkers.push_back(std::make_unique<Parker>());
+
+    std::vector<std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>> reader_buffers(reader_count);
+    std::vector<ClickHouseWriter::BufferSet> writer_buffers(writer_count);
+    std::unique_ptr<BatchQueue> dispatch_queue;
+    if (config.shared_dispatch) {
+        size_t chunks = config.ring_buffer_size * writer_count / std::max<size_t>(1, config.read_batch_size);
+        dispatch_queue = std::make_unique<BatchQueue>(std::max<size_t>(16, chunks));
+    } else {
+        for (int r = 0; r < reader_count; ++r) {
+            for (int w = 0; w < writer_count; ++w) {
+                reader_buffers[r].push_back(std::make_unique<LockFreeRingBuffer<LogEntry>>(
+                    ring_size, writer_parkers[w].get(), reader_parkers[r].get()));
+                writer_buffers[w].push_back(reader_buffers[r].back().get());
+                const auto& ring = *reader_buffers[r].back();
+                place_on_node(ring.slots(), ring.slots_bytes(), spec_node(config.writer_cpus, w));
+            }
+        }
+    }
+
+    ClickHouseWriter writer(config);
+    std::vector<std::unique_ptr<RedisConsumer>> consumers;
+    std::vector<std::string> stream_keys;
+    for (int r = 0; r < reader_count; ++r) {
+        consumers.push_back(std::make_unique<RedisConsumer>(
+            config, config.reader_consumer_name(r), config.reader_stream_key(r),
+            static_cast<uint16_t>(r)));
+        consumers.back()->set_shared_queue(dispatch_queue.get());
+        consumers.back()->set_writer_limits({&writer.active_threads()});
+        if (!consumers.back()->connect()) {
+            std::cerr << "reader " << r << " cannot connect to the fake Redis\n";
+            return result;
+        }
+        stream_keys.push_back(consumers.back()->stream_key());
+    }
+
+    AckPipeline acker(config, std::move(stream_keys));
+    if (!acker.start(writer_count)) return result;
+    auto on_flush = [&acker](int thread_id, uint16_t reader_id, std::vector<std::string>&& ids) {
+        acker.enqueue(thread_id, reader_id, std::move(ids));
+    };
+    bool started = dispatch_queue ? writer.start(*dispatch_queue, on_flush)
+                                  : writer.start(writer_buffers, on_flush);
+    if (!started) {
+        acker.stop();
+        return result;
+    }
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < reader_count; ++r) {
+        readers.emplace_back([&, r] {
+            RedisConsumer& consumer = *consumers[r];
+            pin_thread(config.reader_cpus, static_cast<size_t>(r), "reader");
+            consumer.start_recovery();
+            while (running.load() && consumer.is_running()) consumer.read_batch(reader_buffers[r]);
+            consumer.drain_reads(reader_buffers[r]);
+        });
+    }
+
+    result.completed = redis.wait_acked(std::chrono::seconds(opt.timeout_s));
+
+    running.store(false);
+    for (auto& t : readers) t.join();
+    for (auto& consumer : consumers) consumer->stop();
+    acker.release_writers();
+    writer.stop();
+    acker.stop();
+
+    result.rows = clickhouse.rows();
+    result.inserts = clickhouse.inserts();
+    result.failed_inserts = clickhouse.failed_inserts();
+    result.decode_errors = clickhouse.decode_errors();
+    result.seconds = std::chrono::duration<double>(redis.active_time()).count();
+    result.ack_p50_ns = redis.ack_latency().quantile_ns(0.5);
+    result.ack_p99_ns = redis.ack_latency().quantile_ns(0.99);
+    result.insert_p50_ns = metrics().insert.quantile_ns(0.5);
+    result.insert_p99_ns = metrics().insert.quantile_ns(0.99);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parse_options(argc, argv, opt)) return 1;
+    Config base = Config::from_env();
+    std::string config_error;
+    if (!base.validate(config_error)) {
+        std::cerr << "Invalid configuration: " << config_error << "\n";
+        return 1;
+    }
+
+    // Quiet unless LOG_LEVEL asks otherwise; the table goes to stdout
+    LogLevel level = LogLevel::kWarn;
+    if (std::getenv("LOG_LEVEL")) Logger::parse_level(base.log_level, level);
+    logger().start(level, Logger::Format::kText);
+
+    StreamDump dump;
+    if (!opt.capture_path.empty()) {
+        bool ok = capture_dump(base, opt.entries, dump) && save_dump(opt.capture_path, dump);
+        logger().stop();
+        if (!ok) return 1;
+        std::cout << "Captured " << dump.size() << " entries of " << base.stream_key
+                  << " to " << opt.capture_path << "\n";
+        return 0;
+    }
+    bool loaded = opt.dump_path.empty() ? synthetic_dump(opt.payload, dump) : load_dump(opt.dump_path, dump);
+    if (!loaded) {
+        std::cerr << "no entries to replay (payload '" << opt.payload << "')\n";
+        logger().stop();
+        return 1;
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%7s %7s %10s %8s %12s %10s %10s %10s %10s %7s",
+                  "writers", "batch", "rows", "seconds", "rows/s", "ack p50", "ack p99",
+                  "ins p50", "ins p99", "inserts");
+    std::cout << line << "\n";
+    for (int writers : opt.writers) {
+        for (size_t batch : opt.batches) {
+            Config config = base;
+            config.writer_threads = writers;
+            config.batch_size = batch;
+            RunResult r = run_once(config, dump, opt);
+
+            auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+            const double rate = r.seconds > 0 ? static_cast<double>(r.rows) / r.seconds : 0;
+            std::snprintf(line, sizeof(line), "%7d %7zu %10llu %8.2f %12.0f %8.1fms %8.1fms %8.1fms %8.1fms %7llu%s",
+                          writers, batch, static_cast<unsigned long long>(r.rows), r.seconds, rate,
+                          ms(r.ack_p50_ns), ms(r.ack_p99_ns), ms(r.insert_p50_ns), ms(r.insert_p99_ns),
+                          static_cast<unsigned long long>(r.inserts),
+                          !r.completed ? "  (timed out)" : r.decode_errors ? "  (decode errors)" : "");
+            std::cout << line << "\n" << std::flush;
+        }
+    }
+    logger().stop();
+    return 0;
+}
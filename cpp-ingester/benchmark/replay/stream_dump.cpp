@@ -0,0 +1,151 @@
+#include "stream_dump.h"
+#include "micro/fixtures.h"
+#include <hiredis/hiredis.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace ingester::replay {
+
+namespace {
+
+constexpr char kBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const std::string& in) {
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3) {
+        uint32_t v = (uint8_t(in[i]) << 16) | (uint8_t(in[i + 1]) << 8) | uint8_t(in[i + 2]);
+        out += kBase64[v >> 18];
+        out += kBase64[(v >> 12) & 63];
+        out += kBase64[(v >> 6) & 63];
+        out += kBase64[v & 63];
+    }
+    if (i < in.size()) {
+        uint32_t v = uint8_t(in[i]) << 16;
+        if (i + 1 < in.size()) v |= uint8_t(in[i + 1]) << 8;
+        out += kBase64[v >> 18];
+        out += kBase64[(v >> 12) & 63];
+        out += i + 1 < in.size() ? kBase64[(v >> 6) & 63] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+bool base64_decode(const std::string& in, std::string& out) {
+    out.clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : in) {
+        if (c == '=') break;
+        const char* p = std::find(kBase64, kBase64 + 64, c);
+        if (p == kBase64 + 64) return false;
+        acc = (acc << 6) | static_cast<uint32_t>(p - kBase64);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((acc >> bits) & 0xff);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool load_dump(const std::string& path, StreamDump& out) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "cannot open dump " << path << "\n";
+        return false;
+    }
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        if (line[0] == '{') {
+            out.push_back({"data", line});
+            continue;
+        }
+        size_t tab = line.find('\t');
+        StreamEntry entry;
+        if (tab == std::string::npos || !base64_decode(line.substr(tab + 1), entry.value)) {
+            std::cerr << path << ":" << line_no << ": expected <field>\\t<base64>\n";
+            return false;
+        }
+        entry.field = line.substr(0, tab);
+        out.push_back(std::move(entry));
+    }
+    return !out.empty();
+}
+
+bool save_dump(const std::string& path, const StreamDump& dump) {
+    std::ofstream out(path);
+    for (const StreamEntry& entry : dump) {
+        out << entry.field << '\t' << base64_encode(entry.value) << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool synthetic_dump(const std::string& payload, StreamDump& out) {
+    using namespace ingester::bench;
+    if (payload == "proto") {
+        for (size_t i = 0; i < 10; ++i) out.push_back({"pb", proto_batch(100, 1760000000000)});
+        return true;
+    }
+    Payload shape;
+    if (payload == "plain") shape = Payload::kPlain;
+    else if (payload == "escaped") shape = Payload::kEscaped;
+    else if (payload == "large_metadata") shape = Payload::kLargeMetadata;
+    else return false;
+    for (size_t i = 0; i < 1000; ++i) out.push_back({"data", json_payload(shape, i)});
+    return true;
+}
+
+bool capture_dump(const Config& config, size_t count, StreamDump& out) {
+    struct timeval timeout = {5, 0};
+    redisContext* ctx = redisConnectWithTimeout(config.redis_host.c_str(), config.redis_port, timeout);
+    if (!ctx || ctx->err) {
+        std::cerr << "cannot connect to Redis at " << config.redis_host << ":" << config.redis_port << "\n";
+        if (ctx) redisFree(ctx);
+        return false;
+    }
+
+    // Exclusive start "(<id>" pages forward (Redis 6.2+)
+    std::string start = "-";
+    while (out.size() < count) {
+        const std::string page = std::to_string(std::min<size_t>(1000, count - out.size()));
+        const char* argv[] = {"XRANGE", config.stream_key.c_str(), start.c_str(), "+", "COUNT", page.c_str()};
+        size_t argvlen[] = {6, config.stream_key.size(), start.size(), 1, 5, page.size()};
+        redisReply* reply = static_cast<redisReply*>(redisCommandArgv(ctx, 6, argv, argvlen));
+        if (!reply || reply->type != REDIS_REPLY_ARRAY) {
+            std::cerr << "XRANGE failed: " << (reply && reply->str ? reply->str : ctx->errstr) << "\n";
+            if (reply) freeReplyObject(reply);
+            redisFree(ctx);
+            return false;
+        }
+        const size_t entries = reply->elements;
+        for (size_t i = 0; i < entries; ++i) {
+            // [id, [field, value, ...]]
+            redisReply* entry = reply->element[i];
+            if (entry->type != REDIS_REPLY_ARRAY || entry->elements < 2) continue;
+            start = "(" + std::string(entry->element[0]->str, entry->element[0]->len);
+            redisReply* fields = entry->element[1];
+            for (size_t f = 0; f + 1 < fields->elements; f += 2) {
+                std::string name(fields->element[f]->str, fields->element[f]->len);
+                if (name == "data" || name == "pb") {
+                    out.push_back({name, std::string(fields->element[f + 1]->str, fields->element[f + 1]->len)});
+                    break;
+                }
+            }
+        }
+        freeReplyObject(reply);
+        if (entries == 0) break;
+    }
+    redisFree(ctx);
+    return !out.empty();
+}
+
+} // namespace ingester::replay
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ingester::replay {
+
+/**
+ * One stream entry as the ingester reads it: the `data` (JSON) or `pb`
+ * (protobuf LogEntryBatch) field and its value
+ */
+struct StreamEntry {
+    std::string field;
+    std::string value;
+};
+
+using StreamDump = std::vector<StreamEntry>;
+
+/**
+ * Dump file format: one entry per line, `<field>\t<base64 value>`.
+ * Lines starting with `{` are taken as a bare `data` JSON payload, so
+ * hand-written dumps need no encoding. Returns false if nothing was read.
+ */
+bool load_dump(const std::string& path, StreamDump& out);
+bool save_dump(const std::string& path, const StreamDump& dump);
+
+/**
+ * Generated entries in the shapes of the microbenchmark fixtures:
+ * plain | escaped | large_metadata (JSON) or proto (100 logs per entry)
+ */
+bool synthetic_dump(const std::string& payload, StreamDump& out);
+
+/**
+ * Copy up to `count` entries of config.stream_key from a live Redis with
+ * XRANGE, oldest first, without touching the consumer group
+ */
+bool capture_dump(const Config& config, size_t count, StreamDump& out);
+
+} // namespace ingester::replay
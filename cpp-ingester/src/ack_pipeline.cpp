@@ -0,0 +1,266 @@
+#include "ack_pipeline.h"
+#include "affinity.h"
+#include "log_entry.h"
+#include "logger.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+namespace ingester {
+
+namespace {
+
+constexpr size_t kAckQueueCapacity = 1024;      // Batches per writer queue
+constexpr size_t kMaxIdsPerCommand = 10000;     // Keep single XACKs bounded
+constexpr size_t kMaxIdsPerRound = 100000;      // Flush early past this
+constexpr size_t kMaxHeldIds = 4 * kMaxIdsPerRound;  // Stop draining the queues past this
+constexpr int kShutdownRetries = 3;
+constexpr std::chrono::milliseconds kIdleWait{100};  // Park timeout with nothing to ACK
+
+} // namespace
+
+AckPipeline::AckPipeline(const Config& config, std::vector<std::string> stream_keys)
+    : config_(config)
+    , stream_keys_(std::move(stream_keys))
+    , coalesced_(stream_keys_.size()) {}
+
+AckPipeline::~AckPipeline() {
+    stop();
+    if (redis_) redisFree(redis_);
+}
+
+void AckPipeline::disconnect() {
+    // Also drops commands still buffered for a round that failed half-way
+    if (redis_) redisFree(redis_);
+    redis_ = nullptr;
+}
+
+bool AckPipeline::connect() {
+    struct timeval timeout = {5, 0};
+    redis_ = redisConnectWithTimeout(config_.redis_host.c_str(), config_.redis_port, timeout);
+    if (redis_ == nullptr || redis_->err) {
+        INGESTER_LOG_EVERY(LogLevel::kError, "ack", 1) << "connection error: " << (redis_ ? redis_->errstr : "alloc fail");
+        if (redis_) redisFree(redis_);
+        redis_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool AckPipeline::start(int producers) {
+    if (running_.load()) return false;
+    if (!connect()) return false;
+
+    queues_.clear();
+    for (int i = 0; i < producers; ++i) {
+        queues_.push_back(std::make_unique<LockFreeRingBuffer<AckBatch>>(kAckQueueCapacity, &parker_));
+    }
+
+    running_.store(true);
+    last_trim_ = std::chrono::steady_clock::now();
+    thread_ = std::thread(&AckPipeline::ack_thread, this);
+    return true;
+}
+
+void AckPipeline::stop() {
+    if (!running_.load()) return;
+    running_.store(false);
+    parker_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void AckPipeline::enqueue(int producer, uint16_t reader_id, std::vector<std::string>&& ids) {
+    if (ids.empty()) return;
+
+    pending_ids_ += ids.size();
+    AckBatch batch;
+    batch.reader_id = reader_id;
+    batch.ids = std::move(ids);
+    batch.written_at = std::chrono::steady_clock::now();
+
+    auto& queue = *queues_[producer];
+    while (!queue.try_push(std::move(batch))) {
+        queue.wait_for_space(std::chrono::milliseconds(100));
+    }
+}
+
+bool AckPipeline::drain_queues() {
+    // While rounds fail IDs pile up here; past the cap they wait in the
+    // queues, and writers block in enqueue once those are full too
+    const size_t cap = draining_.load() ? SIZE_MAX : kMaxHeldIds;
+    bool got = false;
+    for (auto& queue : queues_) {
+        while (coalesced_count_ < cap) {
+            auto batch = queue->try_pop();
+            if (!batch) break;
+            if (coalesced_count_ == 0 || batch->written_at < oldest_write_) {
+                oldest_write_ = batch->written_at;
+            }
+            const std::string& first = batch->ids.front();
+            timings_.push_back({batch->written_at, stream_id_millis(first.data(), first.size())});
+            auto& ids = coalesced_[batch->reader_id];
+            ids.insert(ids.end(),
+                       std::make_move_iterator(batch->ids.begin()),
+                       std::make_move_iterator(batch->ids.end()));
+            coalesced_count_ += batch->ids.size();
+            got = true;
+        }
+    }
+    return got;
+}
+
+bool AckPipeline::queues_empty() const {
+    for (const auto& queue : queues_) {
+        if (!queue->empty()) return false;
+    }
+    return true;
+}
+
+bool AckPipeline::append_command(const char* cmd, size_t cmd_len, bool with_group,
+                                 uint16_t reader_id, const std::string* ids, size_t count) {
+    const std::string& key = stream_keys_[reader_id];
+
+    argv_.clear();
+    argvlen_.clear();
+    argv_.push_back(cmd);
+    argvlen_.push_back(cmd_len);
+    argv_.push_back(key.c_str());
+    argvlen_.push_back(key.size());
+    if (with_group) {
+        argv_.push_back(config_.group_name.c_str());
+        argvlen_.push_back(config_.group_name.size());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        argv_.push_back(ids[i].c_str());
+        argvlen_.push_back(ids[i].size());
+    }
+
+    return redisAppendCommandArgv(redis_, static_cast<int>(argv_.size()), argv_.data(), argvlen_.data()) == REDIS_OK;
+}
+
+bool AckPipeline::flush() {
+    if (!redis_ && !connect()) return false;
+
+    // Queue every command first, then collect replies: one round trip
+    xack_ids_.clear();
+    bool queued = true;
+    for (size_t r = 0; queued && r < coalesced_.size(); ++r) {
+        const auto& ids = coalesced_[r];
+        for (size_t off = 0; queued && off < ids.size(); off += kMaxIdsPerCommand) {
+            size_t n = std::min(kMaxIdsPerCommand, ids.size() - off);
+            queued = append_command("XACK", 4, true, static_cast<uint16_t>(r), &ids[off], n);
+            xack_ids_.push_back(n);
+            if (queued && config_.ack_delete) {
+                queued = append_command("XDEL", 4, false, static_cast<uint16_t>(r), &ids[off], n);
+                xack_ids_.push_back(0);
+            }
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (queued && config_.stream_maxlen > 0 && now - last_trim_ >= std::chrono::seconds(1)) {
+        std::string maxlen = std::to_string(config_.stream_maxlen);
+        for (const auto& key : stream_keys_) {
+            const char* argv[] = {"XTRIM", key.c_str(), "MAXLEN", "~", maxlen.c_str()};
+            size_t argvlen[] = {5, key.size(), 6, 1, maxlen.size()};
+            if (redisAppendCommandArgv(redis_, 5, argv, argvlen) != REDIS_OK) {
+                queued = false;
+                break;
+            }
+            xack_ids_.push_back(0);
+        }
+        last_trim_ = now;
+    }
+    if (!queued) {
+        INGESTER_LOG_EVERY(LogLevel::kError, "ack", 1) << "cannot queue XACK round: " << redis_->errstr;
+        ++errors_;
+        disconnect();
+        return false;  // IDs stay coalesced and are retried
+    }
+
+    // An XACK error reply (NOGROUP, WRONGTYPE) will not succeed on retry:
+    // its IDs stay in the PEL for recovery and are counted as errors
+    size_t acked = 0;
+    for (size_t ids : xack_ids_) {
+        void* raw = nullptr;
+        if (redisGetReply(redis_, &raw) != REDIS_OK) {
+            INGESTER_LOG_EVERY(LogLevel::kError, "ack", 1) << "XACK round failed: " << redis_->errstr;
+            ++errors_;
+            disconnect();
+            return false;  // IDs stay coalesced and are retried
+        }
+        redisReply* reply = static_cast<redisReply*>(raw);
+        if (reply->type == REDIS_REPLY_INTEGER) {
+            acked += ids;
+        } else {
+            INGESTER_LOG_EVERY(LogLevel::kError, "ack", 10) << (ids > 0 ? "XACK" : "XDEL/XTRIM") << " failed: "
+                                                            << (reply->type == REDIS_REPLY_ERROR ? reply->str : "unexpected reply");
+            ++errors_;
+        }
+        freeReplyObject(reply);
+    }
+
+    const auto done = std::chrono::steady_clock::now();
+    const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (const AckTiming& timing : timings_) {
+        metrics().ack.record(done - timing.written_at);
+        if (timing.origin_ms > 0) metrics().e2e_lag.record(std::chrono::milliseconds(now_ms - timing.origin_ms));
+    }
+    timings_.clear();
+
+    auto lag = std::chrono::duration_cast<std::chrono::microseconds>(done - oldest_write_).count();
+    last_lag_us_.store(static_cast<uint64_t>(lag));
+    if (static_cast<uint64_t>(lag) > max_lag_us_.load()) {
+        max_lag_us_.store(static_cast<uint64_t>(lag));
+    }
+
+    acked_ += acked;
+    pending_ids_ -= coalesced_count_;
+    ++ack_rounds_;
+    for (auto& ids : coalesced_) ids.clear();
+    coalesced_count_ = 0;
+    return true;
+}
+
+void AckPipeline::ack_thread() {
+    pin_thread(config_.ack_cpus, 0, "ack");
+    const auto linger = std::chrono::milliseconds(config_.ack_linger_ms);
+    int shutdown_failures = 0;
+
+    while (true) {
+        bool got = drain_queues();
+        bool stopping = !running_.load();
+
+        if (coalesced_count_ == 0) {
+            if (stopping) {
+                // Writers are joined before stop(): one last look and exit
+                if (!drain_queues()) break;
+                continue;
+            }
+            if (!got) parker_.park_unless([this] { return !queues_empty() || !running_.load(); }, kIdleWait);
+            continue;
+        }
+
+        bool due = stopping || coalesced_count_ >= kMaxIdsPerRound ||
+                   std::chrono::steady_clock::now() - oldest_write_ >= linger;
+        if (!due) {
+            // Until the linger window of the oldest ID closes, or more IDs arrive
+            const auto left = oldest_write_ + linger - std::chrono::steady_clock::now();
+            if (!got) parker_.park_unless([this] { return !queues_empty() || !running_.load(); }, left);
+            continue;
+        }
+
+        if (!flush()) {
+            if (stopping && ++shutdown_failures >= kShutdownRetries) {
+                // Left in the PEL; recovery picks them up on restart
+                LOG_ERROR("ack") << "giving up on " << coalesced_count_ << " ACKs at shutdown";
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+} // namespace ingester
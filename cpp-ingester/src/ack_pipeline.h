@@ -0,0 +1,130 @@
+#pragma once
+
+#include "config.h"
+#include "ring_buffer.h"
+
+#include <hiredis/hiredis.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * IDs of one written batch, handed from a writer to the ack thread
+ */
+struct AckBatch {
+    uint16_t reader_id = 0;                 // Index into the stream key list
+    std::vector<std::string> ids;
+    std::chrono::steady_clock::time_point written_at;
+};
+
+// When a coalesced batch was written, and when Redis accepted its oldest entry
+struct AckTiming {
+    std::chrono::steady_clock::time_point written_at;
+    int64_t origin_ms = 0;
+};
+
+/**
+ * Dedicated XACK thread with its own Redis connection
+ *
+ * Optimizations:
+ * - One SPSC ring per writer thread: enqueue never takes a lock
+ * - IDs from all writers are coalesced per stream over a short linger window
+ * - XACK (and optional XDEL / XTRIM) commands are pipelined in one round trip
+ * - Failed rounds keep their IDs and retry after reconnecting (XACK is idempotent);
+ *   past a cap of held IDs the queues are left full, which pushes back on
+ *   the writers instead of growing without bound while Redis is away
+ * - The ack thread parks on one futex shared by all queues until IDs or
+ *   the linger deadline arrive
+ */
+class AckPipeline {
+public:
+    /**
+     * `stream_keys[reader_id]` is the stream an entry of that reader came from
+     */
+    AckPipeline(const Config& config, std::vector<std::string> stream_keys);
+    ~AckPipeline();
+
+    // Non-copyable
+    AckPipeline(const AckPipeline&) = delete;
+    AckPipeline& operator=(const AckPipeline&) = delete;
+
+    /**
+     * Connect and start the ack thread with one queue per producer (writer)
+     */
+    bool start(int producers);
+
+    /**
+     * Stop the ack thread after ACKing everything already enqueued
+     */
+    void stop();
+
+    /**
+     * Queue IDs written by `producer`. Waits only if its queue is full.
+     */
+    void enqueue(int producer, uint16_t reader_id, std::vector<std::string>&& ids);
+
+    /**
+     * Writers are about to stop: take their IDs past the cap too, so a
+     * final flush never waits on a Redis that is down. Call before
+     * stopping the writers.
+     */
+    void release_writers() {
+        draining_.store(true);
+        parker_.notify_all();
+    }
+
+    // Stats
+    size_t acked() const { return acked_.load(); }
+    size_t ack_rounds() const { return ack_rounds_.load(); }
+    size_t errors() const { return errors_.load(); }          // Failed rounds and XACK error replies
+    size_t pending() const { return pending_ids_.load(); }
+
+    // Insert-to-XACK latency of the last round / worst round, in microseconds
+    uint64_t last_ack_lag_us() const { return last_lag_us_.load(); }
+    uint64_t max_ack_lag_us() const { return max_lag_us_.load(); }
+
+private:
+    void ack_thread();
+    bool drain_queues();
+    bool queues_empty() const;
+    bool flush();
+    bool connect();
+    void disconnect();
+    bool append_command(const char* cmd, size_t cmd_len, bool with_group,
+                        uint16_t reader_id, const std::string* ids, size_t count);
+
+    const Config& config_;
+    const std::vector<std::string> stream_keys_;
+    redisContext* redis_ = nullptr;
+
+    std::vector<std::unique_ptr<LockFreeRingBuffer<AckBatch>>> queues_;
+    Parker parker_;                         // Data parker of every queue
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> draining_{false};     // release_writers(): no cap
+
+    // Ack-thread state: coalesced IDs per stream, oldest pending write
+    std::vector<std::vector<std::string>> coalesced_;
+    size_t coalesced_count_ = 0;
+    std::chrono::steady_clock::time_point oldest_write_;
+    std::vector<AckTiming> timings_;        // One per coalesced batch, for the histograms
+    std::chrono::steady_clock::time_point last_trim_;
+    std::vector<const char*> argv_;
+    std::vector<size_t> argvlen_;
+    std::vector<size_t> xack_ids_;          // Per pipelined command: IDs if it is an XACK, else 0
+
+    // Stats
+    std::atomic<size_t> acked_{0};
+    std::atomic<size_t> ack_rounds_{0};
+    std::atomic<size_t> errors_{0};
+    std::atomic<size_t> pending_ids_{0};
+    std::atomic<uint64_t> last_lag_us_{0};
+    std::atomic<uint64_t> max_lag_us_{0};
+};
+
+} // namespace ingester
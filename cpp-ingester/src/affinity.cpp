@@ -0,0 +1,162 @@
+#include "affinity.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ingester {
+
+namespace {
+
+constexpr int kMaxCpus = 1024;          // glibc CPU_SETSIZE
+
+constexpr size_t kNodeMaskWords = 4;    // Up to 256 nodes
+
+#if defined(__linux__)
+// <linux/mempolicy.h> values; numaif.h is part of libnuma
+constexpr int kMpolPreferred = 1;
+constexpr unsigned kMpolMfMove = 1u << 1;
+#endif
+
+// Kernel list format: "0-3,8,10-11"
+bool parse_list(const std::string& text, std::vector<int>& out) {
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (end == item.c_str() || first < 0) return false;
+        if (*end == '-') {
+            const char* second = end + 1;
+            last = std::strtol(second, &end, 10);
+            if (end == second || last < first) return false;
+        }
+        if (*end != '\0' && *end != '\n') return false;
+        for (long cpu = first; cpu <= last; ++cpu) out.push_back(static_cast<int>(cpu));
+    }
+    return true;
+}
+
+bool node_cpus(int node, std::vector<int>& out) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    return std::getline(in, list) && parse_list(list, out) && !out.empty();
+}
+
+// The cpuN directory holds a nodeM link on NUMA kernels
+int cpu_node(int cpu) {
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return -1;
+    int node = -1;
+    while (dirent* entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+const CpuSlot* pick(const std::string& spec, size_t index, std::vector<CpuSlot>& slots) {
+    if (spec.empty()) return nullptr;
+    if (!parse_cpu_spec(spec, slots)) {
+        INGESTER_LOG_EVERY(LogLevel::kWarn, "affinity", 1) << "ignoring invalid CPU spec '" << spec << "'";
+        return nullptr;
+    }
+    return slots.empty() ? nullptr : &slots[index % slots.size()];
+}
+
+} // namespace
+
+bool parse_cpu_spec(const std::string& spec, std::vector<CpuSlot>& out) {
+    out.clear();
+    if (spec.empty()) return true;
+
+    std::vector<int> ids;
+    if (spec.compare(0, 5, "node:") == 0) {
+        if (!parse_list(spec.substr(5), ids)) return false;
+        for (int node : ids) {
+            CpuSlot slot;
+            slot.node = node;
+            if (!node_cpus(node, slot.cpus)) return false;
+            out.push_back(std::move(slot));
+        }
+        return !out.empty();
+    }
+
+    if (!parse_list(spec, ids)) return false;
+    for (int cpu : ids) {
+        if (cpu >= kMaxCpus) return false;
+        out.push_back(CpuSlot{{cpu}, cpu_node(cpu)});
+    }
+    return !out.empty();
+}
+
+int pin_thread(const std::string& spec, size_t index, const char* role) {
+    std::vector<CpuSlot> slots;
+    const CpuSlot* slot = pick(spec, index, slots);
+    if (!slot) return -1;
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : slot->cpus) CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        LOG_WARN("affinity") << role << " " << index << ": cannot pin to '" << spec << "': " << std::strerror(rc);
+        return -1;
+    }
+#else
+    INGESTER_LOG_EVERY(LogLevel::kWarn, "affinity", 1) << "CPU pinning needs Linux, " << role << " threads run unpinned";
+    return -1;
+#endif
+    LOG_DEBUG("affinity") << role << " " << index << " pinned to " << slot->cpus.size() << " cpu(s) from "
+                          << slot->cpus.front() << " (node " << slot->node << ")";
+    return slot->node;
+}
+
+int spec_node(const std::string& spec, size_t index) {
+    std::vector<CpuSlot> slots;
+    const CpuSlot* slot = pick(spec, index, slots);
+    return slot ? slot->node : -1;
+}
+
+bool place_on_node(const void* data, size_t len, int node) {
+    if (node < 0 || len == 0) return true;
+    if (static_cast<size_t>(node) >= kNodeMaskWords * 64) return false;
+
+    // Only whole pages: partial ones are shared with neighbouring allocations
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + len) & ~(page - 1);
+    if (end <= begin) return true;
+
+#if defined(__linux__)
+    unsigned long mask[kNodeMaskWords] = {};
+    mask[node / 64] = 1UL << (node % 64);
+    if (syscall(SYS_mbind, begin, end - begin, kMpolPreferred, mask, kNodeMaskWords * 64 + 1, kMpolMfMove) != 0) {
+        INGESTER_LOG_EVERY(LogLevel::kWarn, "affinity", 1) << "mbind to node " << node << " failed: "
+                                                           << std::strerror(errno);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace ingester
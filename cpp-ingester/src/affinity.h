@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * CPU pinning and NUMA placement (Linux, no libnuma)
+ *
+ * A CPU spec assigns the threads of one role round-robin:
+ * - "0-3,8"     one slot per listed core
+ * - "node:0,1"  one slot per NUMA node, spanning all its cores
+ * - ""          unpinned
+ *
+ * Threads pin themselves before allocating anything, so first-touch
+ * memory lands on their node and threads they start inherit the mask.
+ */
+struct CpuSlot {
+    std::vector<int> cpus;
+    int node = -1;              // NUMA node of the slot (-1 = unknown)
+};
+
+/**
+ * Parse a CPU spec into slots. Returns false on a syntax error or an
+ * unknown node; an empty spec yields no slots.
+ */
+bool parse_cpu_spec(const std::string& spec, std::vector<CpuSlot>& out);
+
+/**
+ * Pin the calling thread to slot `index % slots` of `spec`
+ * Returns the slot's NUMA node, or -1 when unpinned or unknown.
+ */
+int pin_thread(const std::string& spec, size_t index, const char* role);
+
+/**
+ * NUMA node thread `index` of `spec` would run on, without pinning
+ */
+int spec_node(const std::string& spec, size_t index);
+
+/**
+ * Move the pages fully inside [data, data + len) to `node` (preferred,
+ * so allocation still succeeds when the node is full). No-op for node < 0.
+ */
+bool place_on_node(const void* data, size_t len, int node);
+
+} // namespace ingester
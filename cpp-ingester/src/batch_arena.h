@@ -0,0 +1,117 @@
+#pragma once
+
+#include "memory_budget.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+namespace ingester {
+
+/**
+ * Refcounted bump-allocated slab holding the bytes of one XREADGROUP reply
+ *
+ * Optimizations:
+ * - One malloc per reply instead of up to nine per log
+ * - One free per reply, on whichever writer thread drops the last ref
+ * - Refs are taken/released in bulk (per reply / per run of entries),
+ *   so the counter is touched a handful of times per batch, not per log
+ *
+ * The reader creates the arena holding one ref for itself, takes a ref for
+ * every parsed entry before publishing, and returns the unpublished ones
+ * once the reply has been dispatched. Writers release their entries after
+ * the batch is written.
+ */
+class BatchArena {
+public:
+    static BatchArena* create(size_t capacity, size_t refs) {
+        void* mem = ::operator new(sizeof(BatchArena) + capacity);
+        return new (mem) BatchArena(capacity, refs);
+    }
+
+    BatchArena(const BatchArena&) = delete;
+    BatchArena& operator=(const BatchArena&) = delete;
+
+    /**
+     * Reserve `n` bytes. Only the creating (reader) thread may allocate.
+     * Falls back to a chained overflow block if the size estimate was short.
+     */
+    char* allocate(size_t n) {
+        if (used_ + n <= capacity_) {
+            char* p = data() + used_;
+            used_ += n;
+            return p;
+        }
+        void* mem = ::operator new(sizeof(Overflow) + n);
+        Overflow* block = new (mem) Overflow{overflow_};
+        overflow_ = block;
+        return reinterpret_cast<char*>(block + 1);
+    }
+
+    std::string_view copy(const char* src, size_t len) {
+        if (len == 0) return {};
+        char* dst = allocate(len);
+        std::memcpy(dst, src, len);
+        return {dst, len};
+    }
+
+    // Only while the caller still holds a ref, i.e. the arena cannot go away
+    void retain(size_t n) {
+        refs_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void release(size_t n = 1) {
+        if (refs_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+            destroy();
+        }
+    }
+
+    /**
+     * Budget charges of the published entries, returned when the arena is
+     * destroyed. Reader thread, before publishing.
+     */
+    void set_charges(const MemoryBudget::Charge* charges, size_t count) {
+        if (count == 0) return;
+        char* raw = allocate(count * sizeof(MemoryBudget::Charge) + alignof(MemoryBudget::Charge) - 1);
+        const uintptr_t align = alignof(MemoryBudget::Charge);
+        charges_ = reinterpret_cast<MemoryBudget::Charge*>((reinterpret_cast<uintptr_t>(raw) + align - 1) & ~(align - 1));
+        std::memcpy(static_cast<void*>(charges_), charges, count * sizeof(MemoryBudget::Charge));
+        charge_count_ = count;
+    }
+
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_; }
+
+private:
+    struct Overflow {
+        Overflow* next;
+    };
+
+    BatchArena(size_t capacity, size_t refs) : refs_(refs), capacity_(capacity) {}
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+
+    void destroy() {
+        if (charge_count_ > 0) memory_budget().release(charges_, charge_count_);
+        Overflow* block = overflow_;
+        while (block) {
+            Overflow* next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+        this->~BatchArena();
+        ::operator delete(this);
+    }
+
+    std::atomic<size_t> refs_;
+    const size_t capacity_;
+    size_t used_ = 0;
+    Overflow* overflow_ = nullptr;
+    MemoryBudget::Charge* charges_ = nullptr;
+    size_t charge_count_ = 0;
+};
+
+} // namespace ingester
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "log_entry.h"
+#include "wait_strategy.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Bounded lock-free Multi-Producer Multi-Consumer queue (Vyukov)
+ *
+ * Each cell carries a sequence number, so producers and consumers claim
+ * cells with one CAS on their own index and never touch the other side's.
+ */
+template<typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity)
+        : capacity_(next_power_of_2(capacity < 2 ? 2 : capacity))
+        , mask_(capacity_ - 1)
+        , cells_(new Cell[capacity_])
+    {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        out = std::move(cell->data);
+        cell->seq.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate under concurrency
+    size_t size() const {
+        size_t head = enqueue_pos_.load(std::memory_order_acquire);
+        size_t tail = dequeue_pos_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    static size_t next_power_of_2(size_t n) {
+        n--;
+        n |= n >> 1;
+        n |= n >> 2;
+        n |= n >> 4;
+        n |= n >> 8;
+        n |= n >> 16;
+        n |= n >> 32;
+        return n + 1;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+/**
+ * Parsed entries of one XREADGROUP reply, moved between threads as a unit
+ */
+struct EntryChunk {
+    std::vector<LogEntry> entries;
+    size_t consumed = 0;        // Entries already taken by the current writer
+};
+
+/**
+ * Shared dispatch queue: all readers publish whole chunks, idle writers pull
+ *
+ * Load-aware by construction: a writer stuck in a slow insert or reconnect
+ * simply stops pulling, and at most one partially consumed chunk waits on it.
+ * Chunks (and their vectors' capacity) are recycled through a free list.
+ */
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity_chunks)
+        : ready_(capacity_chunks)
+        , free_(capacity_chunks) {}
+
+    ~BatchQueue() {
+        EntryChunk* chunk = nullptr;
+        while (ready_.try_pop(chunk)) {
+            release_arenas(chunk->entries.data() + chunk->consumed,
+                           chunk->entries.size() - chunk->consumed);
+            delete chunk;
+        }
+        while (free_.try_pop(chunk)) delete chunk;
+    }
+
+    BatchQueue(const BatchQueue&) = delete;
+    BatchQueue& operator=(const BatchQueue&) = delete;
+
+    // Producer side
+    EntryChunk* acquire_chunk() {
+        EntryChunk* chunk = nullptr;
+        if (free_.try_pop(chunk)) return chunk;
+        return new EntryChunk();
+    }
+
+    bool try_publish(EntryChunk* chunk) {
+        if (!ready_.try_push(chunk)) return false;
+        rows_.fetch_add(chunk->entries.size(), std::memory_order_relaxed);
+        data_parker_.notify();
+        return true;
+    }
+
+    // Consumer side
+    EntryChunk* try_take() {
+        EntryChunk* chunk = nullptr;
+        if (!ready_.try_pop(chunk)) return nullptr;
+        rows_.fetch_sub(chunk->entries.size(), std::memory_order_relaxed);
+        space_parker_.notify();
+        return chunk;
+    }
+
+    void recycle(EntryChunk* chunk) {
+        chunk->entries.clear();
+        chunk->consumed = 0;
+        if (!free_.try_push(chunk)) delete chunk;
+    }
+
+    bool empty() const { return ready_.empty(); }
+    bool full() const { return ready_.size() >= ready_.capacity(); }
+    size_t chunks() const { return ready_.size(); }
+    size_t rows() const { return rows_.load(std::memory_order_relaxed); }
+
+    Parker& data_parker() { return data_parker_; }    // Writers park here
+    Parker& space_parker() { return space_parker_; }  // Readers park here
+
+private:
+    MpmcQueue<EntryChunk*> ready_;
+    MpmcQueue<EntryChunk*> free_;
+    std::atomic<size_t> rows_{0};
+    Parker data_parker_;
+    Parker space_parker_;
+};
+
+} // namespace ingester
@@ -1,209 +1,834 @@
 #include "clickhouse_writer.h"
+#include "affinity.h"
+#include "compression_policy.h"
+#include "dedup_stage.h"
+#include "flush_policy.h"
+#include "insert_pipeline.h"
+#include "logger.h"
 #include <clickhouse/client.h>
-#include <iostream>
+#include <clickhouse/exceptions.h>
+#include <clickhouse/base/buffer.h>
+#include <clickhouse/base/compressed.h>
+#include <clickhouse/base/output.h>
+#include <clickhouse/base/wire_format.h>
+#include <clickhouse/columns/factory.h>
 #include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 
 namespace ingester {
 
 using namespace clickhouse;
 
-ClickHouseWriter::ClickHouseWriter(const Config& config) : config_(config) {}
+namespace {
+
+/**
+ * Read-only clickhouse-cpp column over one of ColumnarBatch's wire buffers
+ * SavePrefix/SaveBody stream the pre-encoded bytes; nothing is rebuilt.
+ */
+template<typename Buffer>
+class WireColumn : public Column {
+public:
+    WireColumn(TypeRef type, const Buffer& buffer)
+        : Column(std::move(type)), buffer_(buffer) {}
+
+    void Append(ColumnRef) override { unsupported(); }
+    void Reserve(size_t) override {}
+    bool LoadBody(InputStream*, size_t) override { unsupported(); return false; }
+
+    void SavePrefix(OutputStream* output) override {
+        buffer_.write_prefix([output](const void* data, size_t len) {
+            WireFormat::WriteBytes(*output, data, len);
+        });
+    }
+
+    void SaveBody(OutputStream* output) override {
+        buffer_.write_body([output](const void* data, size_t len) {
+            WireFormat::WriteBytes(*output, data, len);
+        });
+    }
+
+    void Clear() override { unsupported(); }
+    size_t Size() const override { return buffer_.rows(); }
+    ColumnRef Slice(size_t, size_t) const override { unsupported(); return nullptr; }
+    ColumnRef CloneEmpty() const override { return CreateColumnByType(Type()->GetName()); }
+    void Swap(Column&) override { unsupported(); }
+
+private:
+    [[noreturn]] static void unsupported() {
+        throw std::logic_error("WireColumn is write-only");
+    }
+
+    const Buffer& buffer_;
+};
+
+TypeRef create_type(ColumnType type) {
+    switch (type) {
+        case ColumnType::kString:
+            return Type::CreateString();
+        case ColumnType::kLowCardinalityString:
+            return Type::CreateLowCardinality(Type::CreateString());
+        case ColumnType::kNullableString:
+            return Type::CreateNullable(Type::CreateString());
+        case ColumnType::kLevelEnum8: {
+            std::vector<Type::EnumItem> items;
+            for (size_t i = 0; i < std::size(kLogLevels); ++i) {
+                items.push_back({std::string(kLogLevels[i]), static_cast<int16_t>(i + 1)});
+            }
+            return Type::CreateEnum8(items);
+        }
+        case ColumnType::kDateTime64Ms:
+            return Type::CreateDateTime64(3);
+        case ColumnType::kUuid:
+            return Type::CreateUUID();
+    }
+    throw std::logic_error("unknown column type");
+}
+
+// Spilled column bytes, already in wire format
+struct RawWireBuffer {
+    std::string_view prefix;
+    std::string_view body;
+    size_t row_count;
+
+    size_t rows() const { return row_count; }
+    template<typename Sink> void write_prefix(Sink&& sink) const {
+        if (!prefix.empty()) sink(prefix.data(), prefix.size());
+    }
+    template<typename Sink> void write_body(Sink&& sink) const { sink(body.data(), body.size()); }
+};
+
+CompressionMethod wire_method(Compression method) {
+    switch (method) {
+        case Compression::kNone: return CompressionMethod::None;
+        case Compression::kLz4: return CompressionMethod::LZ4;
+        case Compression::kZstd: return CompressionMethod::ZSTD;
+    }
+    return CompressionMethod::LZ4;
+}
+
+// The client connects to the first replica that answers, starting at `first`
+ClientOptions client_options(const Config& config, Compression method,
+                             const std::vector<HostPort>& replicas, size_t first) {
+    std::vector<Endpoint> endpoints;
+    for (size_t i = 0; i < replicas.size(); ++i) {
+        const HostPort& replica = replicas[(first + i) % replicas.size()];
+        endpoints.push_back({replica.host, static_cast<uint16_t>(replica.port)});
+    }
+    ClientOptions options;
+    options.SetEndpoints(endpoints);
+    options.SetDefaultDatabase(config.clickhouse_database);
+    options.SetUser(config.clickhouse_user);
+    options.SetPassword(config.clickhouse_password);
+    options.SetSendRetries(3);
+    options.SetRetryTimeout(std::chrono::seconds(5));
+    options.SetConnectionRecvTimeout(std::chrono::seconds(5));
+    options.SetConnectionSendTimeout(std::chrono::seconds(5));
+    options.SetCompressionMethod(wire_method(method));
+    return options;
+}
+
+/**
+ * insert_deduplication_token of a block, from its id column (wire bytes):
+ * first and last id, row count and a fold over every id. With
+ * deterministic ids the same rows always give the same token, whether
+ * the batch is retried, sent to another replica or replayed from the
+ * spill log.
+ */
+std::string insert_token(const char* ids, size_t len) {
+    const size_t rows = len / sizeof(Uuid);
+    if (rows == 0) return {};
+    Uuid first;
+    Uuid last;
+    std::memcpy(&first, ids, sizeof(Uuid));
+    std::memcpy(&last, ids + (rows - 1) * sizeof(Uuid), sizeof(Uuid));
+    
+    uint64_t fold = rows;
+    for (size_t i = 0; i < rows; ++i) {
+        Uuid id;
+        std::memcpy(&id, ids + i * sizeof(Uuid), sizeof(Uuid));
+        uint64_t state = fold ^ id.high;
+        fold = splitmix64(state) ^ id.low;
+    }
+    
+    char token[96];
+    std::snprintf(token, sizeof(token), "%016llx%016llx-%016llx%016llx-%zu-%016llx",
+                  static_cast<unsigned long long>(first.high), static_cast<unsigned long long>(first.low),
+                  static_cast<unsigned long long>(last.high), static_cast<unsigned long long>(last.low),
+                  rows, static_cast<unsigned long long>(fold));
+    return token;
+}
+
+// Plain Insert, or one with the token in the query's SETTINGS
+void insert_block(Client& client, const std::string& table, const Block& block, const std::string& token) {
+    if (token.empty()) {
+        client.Insert(table, block);
+        return;
+    }
+    static const std::string columns = [] {
+        std::string out;
+        for (const ColumnSpec& spec : kLogSchema) {
+            if (!out.empty()) out += ", ";
+            out += spec.name;
+        }
+        return out;
+    }();
+    client.BeginInsert("INSERT INTO " + table + " (" + columns + ") SETTINGS insert_deduplication_token = '" +
+                       token + "' VALUES");
+    client.SendInsertBlock(block);
+    client.EndInsert();
+}
+
+// Built once; column objects share them
+const std::vector<TypeRef>& schema_types() {
+    static const std::vector<TypeRef> types = [] {
+        std::vector<TypeRef> out;
+        for (const ColumnSpec& spec : kLogSchema) out.push_back(create_type(spec.type));
+        return out;
+    }();
+    return types;
+}
+
+// Server errors that pass with time: load, replication, a table that is
+// being (re)created. Any other code means the server will not take these
+// rows however often they are sent.
+bool transient_server_error(int code) {
+    switch (code) {
+    case 60:    // UNKNOWN_TABLE
+    case 81:    // UNKNOWN_DATABASE
+    case 159:   // TIMEOUT_EXCEEDED
+    case 164:   // READONLY
+    case 202:   // TOO_MANY_SIMULTANEOUS_QUERIES
+    case 209:   // SOCKET_TIMEOUT
+    case 210:   // NETWORK_ERROR
+    case 241:   // MEMORY_LIMIT_EXCEEDED
+    case 242:   // TABLE_IS_READ_ONLY
+    case 252:   // TOO_MANY_PARTS
+    case 285:   // TOO_FEW_LIVE_REPLICAS
+    case 319:   // UNKNOWN_STATUS_OF_INSERT
+    case 999:   // KEEPER_EXCEPTION
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+ClickHouseWriter::ClickHouseWriter(const Config& config, int first_thread)
+    : config_(config), first_thread_(first_thread), settings_(config) {}
 
 ClickHouseWriter::~ClickHouseWriter() {
     stop();
 }
 
-bool ClickHouseWriter::start(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers, OnFlushCallback on_flush) {
+bool ClickHouseWriter::start(const std::vector<BufferSet>& buffers, OnFlushCallback on_flush) {
     if (running_.load()) return false;
-    running_.store(true);
     
-    if (buffers.size() != config_.writer_threads) {
-        std::cerr << "Error: Buffer count (" << buffers.size() << ") != Writer threads (" << config_.writer_threads << ")\n";
+    if (buffers.size() != static_cast<size_t>(config_.writer_pool_size())) {
+        LOG_ERROR("writer") << "buffer count (" << buffers.size() << ") != writer pool size (" << config_.writer_pool_size() << ")";
         return false;
     }
+    running_.store(true);
     
-    // Start writer threads
-    for (int i = 0; i < config_.writer_threads; ++i) {
-        threads_.emplace_back(&ClickHouseWriter::writer_thread, this, i, 
-                              buffers[i].get(), on_flush);
+    buffers_ = buffers;
+    on_flush_ = std::move(on_flush);
+    
+    if (!config_.spill_dir.empty()) {
+        spill_ = std::make_unique<SpillLog>(config_.spill_dir, config_.spill_segment_mb << 20,
+                                            config_.spill_max_mb << 20);
+        if (spill_->open()) {
+            replay_thread_ = std::thread(&ClickHouseWriter::replay_thread, this);
+            LOG_INFO("spill") << "spill log: " << config_.spill_dir;
+        } else {
+            LOG_ERROR("spill") << "spill log disabled: cannot open " << config_.spill_dir;
+            spill_.reset();
+        }
     }
     
-    std::cout << "Started " << config_.writer_threads << " writer threads\n";
+    // Start writer threads
+    const int count = std::max(1, config_.writer_threads);
+    active_threads_.store(count, std::memory_order_release);
+    start_threads(count);
+    
+    LOG_INFO("writer") << "started " << count << " writer threads for " << config_.clickhouse_table
+                       << (pool_size() > count ? " (up to " + std::to_string(pool_size()) + ")" : "");
     return true;
 }
 
+void ClickHouseWriter::start_threads(int count) {
+    for (int i = static_cast<int>(threads_.size()); i < count; ++i) {
+        threads_.emplace_back(&ClickHouseWriter::writer_thread, this, first_thread_ + i, 
+                              buffers_[i], on_flush_);
+    }
+}
+
+Config ClickHouseWriter::settings() const {
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    return settings_;
+}
+
+void ClickHouseWriter::reconfigure(const Config& config) {
+    if (!running_.load()) return;
+    {
+        std::lock_guard<std::mutex> lock(settings_mutex_);
+        settings_.batch_size = config.batch_size;
+        settings_.max_batch_bytes = config.max_batch_bytes;
+        settings_.max_linger_ms = config.max_linger_ms;
+        settings_.adaptive_batching = config.adaptive_batching;
+        settings_.min_batch_rows = config.min_batch_rows;
+        settings_.min_insert_interval_ms = config.min_insert_interval_ms;
+        settings_.clickhouse_compression = config.clickhouse_compression;
+    }
+    settings_version_.fetch_add(1, std::memory_order_release);
+    
+    const int count = std::clamp(config.writer_threads, 1, pool_size());
+    if (count != config.writer_threads) {
+        LOG_WARN("writer") << config_.clickhouse_table << ": " << config.writer_threads << " writers requested, pool has rings for "
+                           << pool_size() << " (MAX_WRITER_THREADS)";
+    }
+    const int previous = active_threads_.exchange(count, std::memory_order_acq_rel);
+    if (count == previous) return;
+    
+    // Running first, then published to: a new writer sees itself active
+    start_threads(count);
+    for (int i = 0; i < pool_size(); ++i) {
+        if (!buffers_[i].empty()) buffers_[i].front()->data_parker().notify_all();
+    }
+    if (shared_queue_) shared_queue_->data_parker().notify_all();
+    LOG_INFO("writer") << config_.clickhouse_table << ": " << previous << " -> " << count << " writer threads";
+}
+
+bool ClickHouseWriter::start(BatchQueue& queue, OnFlushCallback on_flush) {
+    if (running_.load()) return false;
+    shared_queue_ = &queue;
+    // No rings: every writer's set is empty and the queue feeds them all
+    return start(std::vector<BufferSet>(config_.writer_pool_size()), std::move(on_flush));
+}
+
 void ClickHouseWriter::stop() {
     if (!running_.load()) return;
     running_.store(false);
     
+    // Wake parked writers so they drain and exit promptly
+    for (auto& set : buffers_) {
+        if (!set.empty()) set.front()->data_parker().notify_all();
+    }
+    if (shared_queue_) shared_queue_->data_parker().notify_all();
+    spill_room_.notify_all();
+    
     for (auto& t : threads_) {
         if (t.joinable()) {
             t.join();
         }
     }
     threads_.clear();
+    
+    // Whatever is not replayed yet stays on disk for the next run
+    replay_parker_.notify_all();
+    if (replay_thread_.joinable()) replay_thread_.join();
 }
 
 void ClickHouseWriter::flush() {
     // Let threads naturally drain their buffers
 }
 
-void ClickHouseWriter::writer_thread(int thread_id, LockFreeRingBuffer<LogEntry>* buffer, 
+void ClickHouseWriter::writer_thread(int thread_id, BufferSet buffers, 
                                       OnFlushCallback on_flush) {
-    // Each thread has its own ClickHouse connection
-    ClientOptions options;
-    options.SetHost(config_.clickhouse_host);
-    options.SetPort(config_.clickhouse_native_port);
-    options.SetDefaultDatabase(config_.clickhouse_database);
-    options.SetUser(config_.clickhouse_user);
-    options.SetPassword(config_.clickhouse_password);
-    options.SetSendRetries(3);
-    options.SetRetryTimeout(std::chrono::seconds(5));
-    options.SetConnectionRecvTimeout(std::chrono::seconds(5));
-    options.SetConnectionSendTimeout(std::chrono::seconds(5));
-    options.SetCompressionMethod(CompressionMethod::LZ4);  // Disable to test
+    // Pinned first, so the batch buffers are first-touched on this node
+    // and the insert lanes inherit the mask
+    pin_thread(config_.writer_cpus, static_cast<size_t>(thread_id), "writer");
     
-    std::unique_ptr<Client> client;
+    // Scaled down when past the active count: readers no longer publish here
+    const int index = thread_id - first_thread_;
+    auto active = [this, index] { return index < active_threads_.load(std::memory_order_acquire); };
+    uint64_t settings_seen = settings_version_.load(std::memory_order_acquire);
+    const Config live = settings();
+    
+    // One connection per insert lane; a single one without pipelining
+    const size_t lanes = std::max<size_t>(1, config_.insert_pipeline_depth);
+    
+    // Block compression, fixed or chosen per writer from measured inserts
+    Compression initial;
+    bool automatic;
+    if (!parse_compression(live.clickhouse_compression, initial, automatic)) {
+        INGESTER_LOG_EVERY(LogLevel::kWarn, "writer", 1) << "unknown CLICKHOUSE_COMPRESSION '"
+                                                         << live.clickhouse_compression << "', using lz4";
+    }
+    CompressionPolicy compression(initial, automatic, lanes);
+    
+    // Each thread has its own ClickHouse connection(s); a lane reconnects
+    // when the policy switches method. Lanes start on different replicas.
+    const std::vector<HostPort> replicas = config_.clickhouse_replicas();
+    std::vector<std::unique_ptr<Client>> clients(lanes);
+    std::vector<Compression> lane_compression(lanes, initial);
+    std::vector<size_t> lane_replica(lanes);
+    for (size_t lane = 0; lane < lanes; ++lane) lane_replica[lane] = (thread_id + lane) % replicas.size();
+    auto connect = [&](size_t lane, Compression method) {
+        clients[lane] = std::make_unique<Client>(client_options(config_, method, replicas, lane_replica[lane]));
+    };
     try {
-        client = std::make_unique<Client>(options);
-        std::cout << "Writer thread " << thread_id << " connected to ClickHouse\n";
+        for (size_t lane = 0; lane < lanes; ++lane) connect(lane, initial);
+        LOG_INFO("writer") << "thread " << thread_id << " connected to ClickHouse ("
+                           << lanes << " connection" << (lanes > 1 ? "s" : "") << ")";
     } catch (const std::exception& e) {
-        std::cerr << "Writer thread " << thread_id << " failed to connect: " << e.what() << "\n";
-        return;
+        LOG_ERROR("writer") << "thread " << thread_id << " failed to connect: " << e.what();
+        // With a spill log the writer can start in an outage and spill until the server is up
+        if (!spill_) return;
+        outage_.store(true);
     }
     
-    // Pre-allocated batch buffer
-    std::vector<LogEntry> batch;
-    batch.reserve(config_.batch_size);
+    FlushPolicy policy(live);
+    DedupStage dedup(config_);
 
-    auto write_with_retry = [&](std::vector<LogEntry>& b) {
-        int retries = 3;
-        while (retries > 0) {
-            if (write_batch(b, *client, thread_id)) {
+    auto write_with_retry = [&](const ColumnarBatch& b, size_t lane) {
+        // During an outage go straight to the spill log; the replay thread
+        // probes the server and ends the outage
+        if (outage_.load()) return false;
+        
+        std::unique_ptr<Client>& client = clients[lane];
+        const Compression method = compression.current();
+        if (client && lane_compression[lane] != method) client.reset();
+        lane_compression[lane] = method;
+        
+        if (!client) {
+            try {
+                connect(lane, method);
+            } catch (const std::exception& e) {
+                LOG_WARN("writer") << "thread " << thread_id << " reconnection failed: " << e.what();
+            }
+        }
+        
+        // Three rounds over the replicas: a failed insert moves on to the
+        // next replica at once, and only a round where all failed waits
+        const size_t attempts = 3 * replicas.size();
+        for (size_t attempt = 1; attempt <= attempts; ++attempt) {
+            if (client && write_batch(b, *client, thread_id)) {
                 return true;
             }
-            std::cerr << "Thread " << thread_id << " write failed. Retrying... (" << retries << " left)\n";
+            LOG_WARN("writer") << "thread " << thread_id << " write failed, retrying (" << attempts - attempt + 1 << " left)";
             
-            // Reconnect attempt
+            // Reconnect, starting at the next replica
+            if (replicas.size() > 1) {
+                lane_replica[lane] = (lane_replica[lane] + 1) % replicas.size();
+                ++failovers_;
+            }
             try {
-                client = std::make_unique<Client>(options);
-                std::cout << "Thread " << thread_id << " reconnected\n";
+                connect(lane, method);
+                LOG_INFO("writer") << "thread " << thread_id << " reconnected";
             } catch (const std::exception& e) {
-                std::cerr << "Thread " << thread_id << " reconnection failed: " << e.what() << "\n";
+                LOG_WARN("writer") << "thread " << thread_id << " reconnection failed: " << e.what();
             }
             
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            retries--;
+            if (attempt % replicas.size() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(500));
         }
         return false;
     };
     
-    while (running_.load() || !buffer->empty()) {
-        // Pop logs from ring buffer
-        size_t popped = buffer->pop_batch(batch, config_.batch_size - batch.size());
-        
-        // Flush when batch is full or timeout (simple: just check size)
-        if (batch.size() >= config_.batch_size) {
-            if (write_with_retry(batch)) {
-                // Collect Redis IDs for ACK
-                if (on_flush) {
-                    std::vector<std::string> ids;
-                    ids.reserve(batch.size());
-                    for (const auto& entry : batch) {
-                        if (!entry.redis_id.empty()) {
-                            ids.push_back(entry.redis_id);
-                        }
-                    }
-                    on_flush(ids);
+    Parker& parker = shared_queue_ ? shared_queue_->data_parker() : buffers.front()->data_parker();
+    
+    // Pipelined: lanes insert while this thread fills the next batch.
+    // Otherwise one reused batch, inserted inline.
+    std::unique_ptr<InsertPipeline> pipeline;
+    ColumnarBatch inline_batch;
+    ColumnarBatch* batch = &inline_batch;
+    if (lanes > 1) {
+        pipeline = std::make_unique<InsertPipeline>(lanes, write_with_retry, &parker);
+        batch = pipeline->try_acquire();
+    }
+    
+    // Per reader: the entry left open by the last completed batch lost rows
+    // in a batch that was neither written nor spilled
+    std::vector<uint8_t> broken_groups;
+    
+    // Feed the result back into the policy and hand the IDs to the acker
+    // (always on this thread: the ack queue is single-producer). Batches
+    // complete in fill order, so an entry split across batches is ACKed
+    // only if every batch with its rows was written.
+    auto complete = [&](ColumnarBatch& done, bool written,
+                        FlushPolicy::Clock::duration latency, FlushPolicy::Clock::time_point finished) {
+        policy.on_flush(done.rows(), latency, finished);
+        if (written && compression.on_insert(done.rows(), latency)) {
+            LOG_INFO("writer") << "thread " << thread_id << " switching to " << compression_name(compression.current())
+                               << " compression";
+        }
+        if (compression.want_sample()) compression.on_sample(measure_compression(done));
+        if (!written && spill_) {
+            bool spilled = spill_->append(done);
+            if (!spilled) {
+                // Spill full: the outage goes on, so hold this batch (and with
+                // it the readers) until replay frees room. On shutdown it stays
+                // pending in Redis.
+                INGESTER_LOG_EVERY(LogLevel::kWarn, "spill", 1) << "spill log full, thread " << thread_id
+                                                                 << " waits for replay";
+                while (!spilled && running_.load()) {
+                    spill_room_.park_unless([this] { return !running_.load(); }, std::chrono::milliseconds(100));
+                    spilled = spill_->append(done);
                 }
             }
-            batch.clear();
-        } else if (popped == 0) {
-            // No data, small sleep to avoid busy spinning
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            
-            // Flush partial batch if we've been waiting
-            if (!batch.empty()) {
-                if (write_with_retry(batch)) {
-                    if (on_flush) {
-                        std::vector<std::string> ids;
-                        for (const auto& entry : batch) {
-                            if (!entry.redis_id.empty()) {
-                                ids.push_back(entry.redis_id);
-                            }
-                        }
-                        on_flush(ids);
-                    }
+            if (spilled) {
+                // Durable on disk: ACK now, the replay thread inserts it later
+                written = true;
+                ++spilled_batches_;
+                outage_.store(true);
+                replay_parker_.notify();
+            }
+        }
+        if (dedup.enabled()) dedup.on_complete(done, written);
+        if (broken_groups.size() < done.edge_count()) broken_groups.resize(done.edge_count());
+        for (size_t r = 0; r < done.reader_count(); ++r) {
+            std::vector<std::string> ids = done.take_redis_ids(r);
+            if (r < done.edge_count() && done.group_edge(r).rows) {
+                const ColumnarBatch::GroupEdge& edge = done.group_edge(r);
+                if (written && broken_groups[r] && !edge.closing_id.empty()) {
+                    // Left pending: redelivered and inserted whole
+                    auto it = std::find(ids.begin(), ids.end(), edge.closing_id);
+                    if (it != ids.end()) ids.erase(it);
+                    ++acks_withheld_;
                 }
-                batch.clear();
+                broken_groups[r] = edge.open && (!written || (broken_groups[r] && edge.closing_id.empty()));
+            }
+            if (written && on_flush && !ids.empty()) {
+                on_flush(thread_id, static_cast<uint16_t>(r), std::move(ids));
             }
         }
-    }
+    };
     
-    // Final flush
-    if (!batch.empty()) {
-        if (write_with_retry(batch)) {
-            if (on_flush) {
-                std::vector<std::string> ids;
-                for (const auto& entry : batch) {
-                    if (!entry.redis_id.empty()) {
-                        ids.push_back(entry.redis_id);
-                    }
-                }
-                on_flush(ids);
+    auto reap = [&](bool block) {
+        InsertPipeline::Completion done;
+        while (block ? pipeline->wait(done) : pipeline->poll(done)) {
+            complete(*done.batch, done.written, done.latency, done.finished);
+            pipeline->recycle(done.batch);
+            block = false;
+        }
+    };
+    
+    // Rows go through the dedup stage when it is on; it holds some of them
+    // until the flush, so the policy counts rows plus what the stage took
+    size_t collapsed = 0;
+    size_t dropped = 0;
+    auto add_row = [&](const LogEntry& entry) {
+        batch->track_group(entry.reader_id, entry.redis_id);
+        if (!dedup.enabled()) {
+            batch->append(entry);
+            return;
+        }
+        switch (dedup.add(entry, *batch)) {
+            case DedupStage::Result::kCollapsed: ++collapsed; break;
+            case DedupStage::Result::kDropped: ++dropped; break;
+            default: break;
+        }
+    };
+    auto batch_rows = [&]() { return batch->rows() + dedup.pending(); };
+    auto batch_bytes = [&]() { return batch->bytes() + dedup.pending_bytes(); };
+    auto room = [&]() { return policy.room(batch_rows(), batch_bytes()); };
+    
+    // A reload lands between two batches, so the flush policy never sees
+    // a half-filled batch under different limits
+    auto pick_up_settings = [&]() {
+        const uint64_t version = settings_version_.load(std::memory_order_acquire);
+        if (version == settings_seen || batch_rows() > 0) return;
+        settings_seen = version;
+        const Config updated = settings();
+        policy.reconfigure(updated);
+        Compression method;
+        bool is_auto;
+        if (!parse_compression(updated.clickhouse_compression, method, is_auto)) {
+            INGESTER_LOG_EVERY(LogLevel::kWarn, "writer", 1) << "unknown CLICKHOUSE_COMPRESSION '"
+                                                             << updated.clickhouse_compression << "', using lz4";
+        }
+        if (compression.reset(method, is_auto)) {
+            LOG_INFO("writer") << "thread " << thread_id << " switching to " << compression_name(compression.current())
+                               << " compression";
+        }
+    };
+    
+    auto flush_batch = [&]() {
+        if (dedup.enabled()) {
+            dedup.finish(*batch, FlushPolicy::Clock::now());
+            rows_collapsed_ += collapsed;
+            replays_dropped_ += dropped;
+            collapsed = dropped = 0;
+        }
+        policy.on_submit(batch->rows(), batch->bytes());
+        if (!pipeline) {
+            auto started = FlushPolicy::Clock::now();
+            bool written = write_with_retry(*batch, 0);
+            auto finished = FlushPolicy::Clock::now();
+            complete(*batch, written, finished - started, finished);
+            batch->clear();
+            return;
+        }
+        
+        pipeline->submit(batch);
+        // Block only when every batch in the pool is in flight
+        while (!(batch = pipeline->try_acquire())) reap(true);
+    };
+    
+    auto all_empty = [&buffers]() {
+        for (auto* buffer : buffers) {
+            if (!buffer->empty()) return false;
+        }
+        return true;
+    };
+    
+    // Shared dispatch: pull whole chunks while the batch has room. A chunk
+    // larger than the room is carried over into the next batch.
+    BatchQueue* shared = shared_queue_;
+    EntryChunk* chunk = nullptr;
+    auto take_shared = [&](bool more) -> size_t {
+        size_t taken = 0;
+        while (room() > 0) {
+            if (!chunk && (!more || !(chunk = shared->try_take()))) break;
+            LogEntry* first = chunk->entries.data() + chunk->consumed;
+            size_t n = std::min(room(), chunk->entries.size() - chunk->consumed);
+            for (size_t i = 0; i < n; ++i) {
+                add_row(first[i]);
+            }
+            release_arenas(first, n);
+            chunk->consumed += n;
+            taken += n;
+            if (chunk->consumed == chunk->entries.size()) {
+                shared->recycle(chunk);
+                chunk = nullptr;
             }
         }
+        return taken;
+    };
+    
+    // A scaled-down writer still drains its rings, but takes no new chunks
+    auto has_data = [&]() {
+        return !all_empty() || (shared && active() && !shared->empty());
+    };
+    auto has_completions = [&]() {
+        return pipeline && pipeline->has_completions();
+    };
+    
+    size_t next_buffer = 0;
+    bool idle = false;      // Scaled down and drained: connections closed
+    while (running_.load() || has_data() || chunk) {
+        pick_up_settings();
+        const bool retired = !active();
+        if (!retired) idle = false;
+        
+        // Consume ring slots in place, straight into the column buffers
+        size_t popped = 0;
+        for (size_t n = 0; n < buffers.size() && room() > 0; ++n) {
+            auto* buffer = buffers[next_buffer];
+            next_buffer = (next_buffer + 1) % buffers.size();
+            
+            auto span = buffer->peek_read(room());
+            for (size_t i = 0; i < span.size(); ++i) {
+                add_row(span[i]);
+            }
+            // Rows are copied out, so the arena slabs can go now
+            release_arenas(span.first, span.first_len);
+            release_arenas(span.second, span.second_len);
+            buffer->commit_read(span.size());
+            popped += span.size();
+        }
+        if (shared) popped += take_shared(!retired);
+        if (has_completions()) reap(false);
+        
+        // Flush on row target, byte cap or linger deadline - never just because
+        // the ring was momentarily empty. A retired writer flushes what it
+        // has as soon as its rings are empty: nothing else is coming.
+        auto now = FlushPolicy::Clock::now();
+        policy.note_rows(batch_rows(), now);
+        if (policy.should_flush(batch_rows(), batch_bytes(), now) ||
+            (retired && popped == 0 && batch_rows() > 0)) {
+            flush_batch();
+        } else if (popped == 0) {
+            if (retired && !idle && (!pipeline || pipeline->in_flight() == 0) && !has_completions()) {
+                // Lanes are done with the clients; write_with_retry reconnects if scaled up again
+                for (auto& client : clients) client.reset();
+                idle = true;
+                LOG_INFO("writer") << "thread " << thread_id << " idle";
+            }
+            // No data: spin, yield, then park until a reader publishes,
+            // the linger deadline hits, or we are told to stop
+            auto timeout = std::min<FlushPolicy::Clock::duration>(
+                std::chrono::milliseconds(100), policy.time_to_deadline(now));
+            hybrid_wait(parker, [&] { return has_data() || has_completions() || !running_.load(); }, timeout);
+        }
+    }
+    
+    // Final flush, then wait for everything still in flight
+    if (batch_rows() > 0) {
+        flush_batch();
     }
+    if (pipeline) reap(true);
 }
 
-bool ClickHouseWriter::write_batch(const std::vector<LogEntry>& batch, Client& client, int thread_id) {
-    if (batch.empty()) return true;
+void ClickHouseWriter::replay_thread() {
+    Compression method;
+    bool automatic;
+    parse_compression(config_.clickhouse_compression, method, automatic);
+    const std::vector<HostPort> replicas = config_.clickhouse_replicas();
+    size_t replica = 0;
+    std::unique_ptr<Client> client;
+    std::unique_ptr<SpillLog> quarantine;
     
-    try {
-        // Build columns for batch insert
-        auto app_id = std::make_shared<ColumnString>();
-        auto message = std::make_shared<ColumnString>();
-        auto source = std::make_shared<ColumnString>();
-        auto level = std::make_shared<ColumnString>();
-        auto environment = std::make_shared<ColumnString>();
-        auto metadata = std::make_shared<ColumnString>();
-        auto trace_id = std::make_shared<ColumnString>();
-        auto user_id = std::make_shared<ColumnString>();
+    // Server still down: wait and probe again with the same record,
+    // starting at the next replica
+    auto back_off = [&] {
+        client.reset();
+        replica = (replica + 1) % replicas.size();
+        ++errors_;
+        replay_parker_.park_unless([this] { return !running_.load(); }, std::chrono::milliseconds(1000));
+    };
+    
+    while (running_.load()) {
+        SpillRecord record;
+        if (!spill_->peek(record)) {
+            replay_parker_.park_unless([this] { return !running_.load() || !spill_->empty(); },
+                                       std::chrono::milliseconds(1000));
+            continue;
+        }
         
-        // Fill columns
-        for (const auto& entry : batch) {
-            app_id->Append(entry.app_id);
-            message->Append(entry.message);
-            source->Append(entry.source);
-            level->Append(entry.level);
-            environment->Append(entry.environment);
-            metadata->Append(entry.metadata);
-            trace_id->Append(entry.trace_id);
-            user_id->Append(entry.user_id);
+        bool compatible = true;
+        for (size_t i = 0; i < kLogColumnCount; ++i) {
+            compatible = compatible && record.type[i] == kLogSchema[i].type;
+        }
+        if (!compatible) {
+            LOG_WARN("spill") << "skipping a batch written with another schema (" << record.rows << " rows)";
+            spill_->consume();
+            spill_room_.notify();
+            continue;
         }
         
-        // Build block
+        try {
+            if (!client) client = std::make_unique<Client>(client_options(config_, method, replicas, replica));
+            
+            // Columns reference these until the insert returns
+            RawWireBuffer raw[kLogColumnCount];
+            Block block;
+            const auto& types = schema_types();
+            for (size_t i = 0; i < kLogColumnCount; ++i) {
+                raw[i] = RawWireBuffer{record.prefix[i], record.body[i], record.rows};
+                block.AppendColumn(kLogSchema[i].name,
+                                   std::make_shared<WireColumn<RawWireBuffer>>(types[i], raw[i]));
+            }
+            const std::string token = config_.deterministic_ids
+                ? insert_token(record.body[kId].data(), record.body[kId].size()) : std::string();
+            insert_block(*client, config_.clickhouse_table, block, token);
+            
+            spill_->consume();
+            spill_room_.notify();
+            logs_written_ += record.rows;
+            ++batches_written_;
+            ++replayed_batches_;
+            if (outage_.exchange(false)) {
+                LOG_INFO("spill") << "ClickHouse is back, replaying " << spill_->pending_records() << " spilled batches";
+            }
+        } catch (const clickhouse::ServerException& e) {
+            if (transient_server_error(e.GetCode())) {
+                back_off();
+                continue;
+            }
+            
+            // The server is up and refuses these rows: retrying cannot help,
+            // so they go aside (same format, for inspection) and replay moves on
+            LOG_ERROR("spill") << "ClickHouse rejected a spilled batch of " << record.rows << " rows (code "
+                               << e.GetCode() << "): " << e.what();
+            if (!quarantine) {
+                quarantine = std::make_unique<SpillLog>(config_.spill_dir + "/quarantine",
+                                                        config_.spill_segment_mb << 20, config_.spill_max_mb << 20);
+                if (!quarantine->open()) quarantine.reset();
+            }
+            if (!quarantine || !quarantine->append(record)) {
+                LOG_ERROR("spill") << "cannot quarantine the batch, dropping it";
+            }
+            client.reset();
+            spill_->consume();
+            spill_room_.notify();
+            ++quarantined_batches_;
+            outage_.store(false);
+        } catch (const std::exception& e) {
+            back_off();
+        }
+    }
+}
+
+CompressionSample ClickHouseWriter::measure_compression(const ColumnarBatch& batch) {
+    CompressionSample sample;
+    sample.rows = batch.rows();
+    if (batch.empty()) return sample;
+    
+    // The block as the client sends it: counts, then name, type and data per column
+    Buffer raw;
+    {
+        BufferOutput out(&raw);
+        const auto& types = schema_types();
+        size_t index = 0;
+        WireFormat::WriteVarint64(out, kLogColumnCount);
+        WireFormat::WriteVarint64(out, batch.rows());
+        batch.for_each_column([&](const ColumnSpec& spec, const auto& buffer) {
+            WireColumn<std::decay_t<decltype(buffer)>> column(types[index], buffer);
+            WireFormat::WriteString(out, spec.name);
+            WireFormat::WriteString(out, types[index++]->GetName());
+            column.SavePrefix(&out);
+            column.SaveBody(&out);
+        });
+        out.Flush();
+    }
+    sample.raw_bytes = raw.size();
+    sample.wire_bytes[static_cast<size_t>(Compression::kNone)] = raw.size();
+    
+    // Same chunking as the client, so the framing overhead matches too
+    const size_t chunk = ClientOptions().max_compression_chunk_size;
+    for (Compression method : {Compression::kLz4, Compression::kZstd}) {
+        Buffer compressed;
+        auto started = std::chrono::steady_clock::now();
+        {
+            BufferOutput sink(&compressed);
+            CompressedOutput out(&sink, chunk, wire_method(method));
+            out.Write(raw.data(), raw.size());
+            out.Flush();
+        }
+        sample.cpu[static_cast<size_t>(method)] = std::chrono::steady_clock::now() - started;
+        sample.wire_bytes[static_cast<size_t>(method)] = compressed.size();
+    }
+    return sample;
+}
+
+bool ClickHouseWriter::write_batch(const ColumnarBatch& batch, Client& client, int thread_id) {
+    if (batch.empty()) return true;
+    
+    try {
+        // Columns are views over the reused wire buffers, typed as in the table
         Block block;
-        block.AppendColumn("app_id", app_id);
-        block.AppendColumn("message", message);
-        block.AppendColumn("source", source);
-        block.AppendColumn("level", level);
-        block.AppendColumn("environment", environment);
-        block.AppendColumn("metadata", metadata);
-        block.AppendColumn("trace_id", trace_id);
-        block.AppendColumn("user_id", user_id);
+        const auto& types = schema_types();
+        size_t index = 0;
+        std::string token;
+        batch.for_each_column([&](const ColumnSpec& spec, const auto& buffer) {
+            using Buffer = std::decay_t<decltype(buffer)>;
+            if (config_.deterministic_ids && index == kId) {
+                buffer.write_body([&token](const void* data, size_t len) {
+                    token = insert_token(static_cast<const char*>(data), len);
+                });
+            }
+            block.AppendColumn(spec.name, std::make_shared<WireColumn<Buffer>>(types[index++], buffer));
+        });
         
         // Use passed client
-        std::cout << "Thread " << thread_id << " inserting batch of " << batch.size() << "\n";
-        client.Insert(config_.clickhouse_table, block);
-        std::cout << "Thread " << thread_id << " insert complete\n";
+        auto started = std::chrono::steady_clock::now();
+        insert_block(client, config_.clickhouse_table, block, token);
+        auto latency = std::chrono::steady_clock::now() - started;
+        metrics().insert.record(latency);
+        LOG_DEBUG("writer") << "thread " << thread_id << " inserted " << batch.rows() << " rows in "
+                            << std::chrono::duration_cast<std::chrono::microseconds>(latency).count() << " us";
         
-        logs_written_ += batch.size();
+        logs_written_ += batch.rows();
         ++batches_written_;
         return true;
         
     } catch (const std::exception& e) {
-        std::cerr << "Write error (thread " << thread_id << "): " << e.what() << "\n";
+        INGESTER_LOG_EVERY(LogLevel::kError, "writer", 10) << "write error (thread " << thread_id << "): " << e.what();
         ++errors_;
         return false;
     }
@@ -2,7 +2,13 @@
 
 #include "config.h"
 #include "log_entry.h"
+#include "column_batch.h"
+#include "compression_policy.h"
 #include "ring_buffer.h"
+#include "batch_queue.h"
+#include "spill_log.h"
+#include "metrics.h"
+#include "wait_strategy.h"
 
 #include <atomic>
 #include <vector>
@@ -24,13 +30,26 @@ namespace ingester {
  * - RowBinary format (fastest binary format)
  * - Thread pool for parallel batch insertions
  * - Connection pooling
- * - Pre-allocated write buffers
+ * - Reused columnar buffers in wire format (no per-insert column rebuild)
+ * - Optional pull-based dispatch: idle writers take work, busy ones don't
+ * - Optional spill log: outages are absorbed on disk instead of stalling reads
+ * - Optional insert pipelining: the next batch is filled while previous
+ *   ones are compressed and sent on their own connections
+ * - Replica failover: a failed insert is retried on the next replica of
+ *   clickhouse_host at once instead of reconnecting to the same node
+ * - Live reconfiguration: batching, compression and the number of writers
+ *   change without a restart (reconfigure)
  */
 class ClickHouseWriter {
 public:
-    using OnFlushCallback = std::function<void(const std::vector<std::string>&)>;
+    using OnFlushCallback = std::function<void(int thread_id, uint16_t reader_id, std::vector<std::string>&& ids)>;
+    using BufferSet = std::vector<LockFreeRingBuffer<LogEntry>*>;
     
-    explicit ClickHouseWriter(const Config& config);
+    /**
+     * `first_thread` numbers this pool's threads from there on (placement,
+     * ACK lanes), so several pools can share one AckPipeline
+     */
+    explicit ClickHouseWriter(const Config& config, int first_thread = 0);
     ~ClickHouseWriter();
     
     // Non-copyable
@@ -39,8 +58,17 @@ public:
     
     /**
      * Initialize connections and start writer threads
+     * `buffers[i]` holds the rings writer i drains (one per reader), for
+     * all writer_pool_size() writers; writer_threads of them are started.
+     */
+    bool start(const std::vector<BufferSet>& buffers, OnFlushCallback on_flush);
+    
+    /**
+     * Start writer threads that all pull from one shared queue
+     * An idle writer takes the next chunk, so a writer stuck in a slow
+     * insert or reconnect only holds up the rows it already took.
      */
-    bool start(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers, OnFlushCallback on_flush);
+    bool start(BatchQueue& queue, OnFlushCallback on_flush);
     
     /**
      * Stop writer threads and flush remaining data
@@ -52,23 +80,87 @@ public:
      */
     void flush();
     
+    /**
+     * Apply the reloadable settings of `config` (this pool's route spec):
+     * batch_size, max_batch_bytes, max_linger_ms, the adaptive bounds,
+     * clickhouse_compression and writer_threads
+     *
+     * Writers take new batching and compression between two batches.
+     * writer_threads is clamped to the pool size; added writers are started
+     * (or woken), and readers stop publishing to removed ones, which flush,
+     * drain their rings and idle without connections until scaled up again.
+     * Call from the thread that calls start() and stop().
+     */
+    void reconfigure(const Config& config);
+    
+    // Readers publish to the first active_threads() writers of the pool
+    const std::atomic<int>& active_threads() const { return active_threads_; }
+    int pool_size() const { return static_cast<int>(buffers_.size()); }
+    
     // Stats
     size_t logs_written() const { return logs_written_.load(); }
     size_t batches_written() const { return batches_written_.load(); }
     size_t errors() const { return errors_.load(); }
+    size_t spilled_batches() const { return spilled_batches_.load(); }
+    size_t replayed_batches() const { return replayed_batches_.load(); }
+    size_t quarantined_batches() const { return quarantined_batches_.load(); }
+    size_t rows_collapsed() const { return rows_collapsed_.load(); }
+    size_t replays_dropped() const { return replays_dropped_.load(); }
+    size_t spill_pending() const { return spill_ ? spill_->pending_records() : 0; }
+    bool in_outage() const { return outage_.load(); }
+    size_t failovers() const { return failovers_.load(); }
+    size_t acks_withheld() const { return acks_withheld_.load(); }
+    
+    /**
+     * Serialize a batch as a native block and compress it with each method
+     * Used by the auto policy and the compression bench; no connection needed.
+     */
+    static CompressionSample measure_compression(const ColumnarBatch& batch);
     
 private:
-    void writer_thread(int thread_id, LockFreeRingBuffer<LogEntry>* buffer, OnFlushCallback on_flush);
-    bool write_batch(const std::vector<LogEntry>& batch, clickhouse::Client& client, int thread_id);
+    void writer_thread(int thread_id, BufferSet buffers, OnFlushCallback on_flush);
+    void start_threads(int count);
+    Config settings() const;
+    bool write_batch(const ColumnarBatch& batch, clickhouse::Client& client, int thread_id);
+    
+    // Inserts spilled batches, oldest first, whenever the server takes them
+    void replay_thread();
     
     const Config& config_;
+    const int first_thread_;
     std::vector<std::thread> threads_;
+    std::vector<BufferSet> buffers_;
+    BatchQueue* shared_queue_ = nullptr;
     std::atomic<bool> running_{false};
+    OnFlushCallback on_flush_;
     
-    // Stats
-    std::atomic<size_t> logs_written_{0};
-    std::atomic<size_t> batches_written_{0};
-    std::atomic<size_t> errors_{0};
+    // Reloadable settings; writers copy them once settings_version_ moves
+    mutable std::mutex settings_mutex_;
+    Config settings_;
+    std::atomic<uint64_t> settings_version_{0};
+    std::atomic<int> active_threads_{0};
+    
+    // Spill log: failed batches are stored and ACKed, then replayed.
+    // While in an outage writers spill without trying the server first;
+    // with the log full they wait on spill_room_ until replay catches up.
+    // Batches the server rejects for good go to <spill_dir>/quarantine.
+    std::unique_ptr<SpillLog> spill_;
+    std::thread replay_thread_;
+    Parker replay_parker_;
+    Parker spill_room_;
+    std::atomic<bool> outage_{false};
+    
+    // Stats (sharded: every writer thread and insert lane bumps them)
+    ShardedCounter logs_written_;
+    ShardedCounter batches_written_;
+    ShardedCounter errors_;
+    std::atomic<size_t> spilled_batches_{0};
+    std::atomic<size_t> replayed_batches_{0};
+    std::atomic<size_t> quarantined_batches_{0};
+    std::atomic<size_t> rows_collapsed_{0};
+    std::atomic<size_t> replays_dropped_{0};
+    std::atomic<size_t> failovers_{0};
+    std::atomic<size_t> acks_withheld_{0};
 };
 
 } // namespace ingester
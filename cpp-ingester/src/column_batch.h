@@ -0,0 +1,409 @@
+#pragma once
+
+#include "log_entry.h"
+#include "log_schema.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * String column buffer kept in ClickHouse Native wire format
+ *
+ * Rows are stored back to back as `varint(len) + bytes`, exactly as the
+ * server expects a String column body, so the insert path can stream the
+ * buffer in a single write. Capacity survives clear() and is reused.
+ */
+class WireStringBuffer {
+public:
+    WireStringBuffer() = default;
+    ~WireStringBuffer() { std::free(data_); }
+
+    WireStringBuffer(const WireStringBuffer&) = delete;
+    WireStringBuffer& operator=(const WireStringBuffer&) = delete;
+
+    void append(std::string_view value) {
+        ensure(size_ + value.size() + 10);
+        uint64_t len = value.size();
+        while (len >= 0x80) {
+            data_[size_++] = static_cast<char>(len | 0x80);
+            len >>= 7;
+        }
+        data_[size_++] = static_cast<char>(len);
+        std::memcpy(data_ + size_, value.data(), value.size());
+        size_ += value.size();
+        ++rows_;
+    }
+
+    void clear() {
+        size_ = 0;
+        rows_ = 0;
+    }
+
+    void reserve(size_t bytes) { ensure(bytes); }
+
+    const char* data() const { return data_; }
+    size_t size_bytes() const { return size_; }
+    size_t rows() const { return rows_; }
+
+    template<typename Sink> void write_prefix(Sink&&) const {}
+    template<typename Sink> void write_body(Sink&& sink) const { sink(data_, size_); }
+
+private:
+    void ensure(size_t needed) {
+        if (needed <= capacity_) return;
+        size_t cap = capacity_ ? capacity_ : 4096;
+        while (cap < needed) cap *= 2;
+        char* grown = static_cast<char*>(std::realloc(data_, cap));
+        if (!grown) throw std::bad_alloc();
+        data_ = grown;
+        capacity_ = cap;
+    }
+
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    size_t rows_ = 0;
+};
+
+/**
+ * Fixed-width column buffer (Enum8, DateTime64, UUID): the body is the
+ * values back to back in host (little-endian) order
+ */
+template<typename T>
+class WireFixedBuffer {
+public:
+    void append(const T& value) { values_.push_back(value); }
+    void clear() { values_.clear(); }
+
+    size_t size_bytes() const { return values_.size() * sizeof(T); }
+    size_t rows() const { return values_.size(); }
+
+    template<typename Sink> void write_prefix(Sink&&) const {}
+    template<typename Sink> void write_body(Sink&& sink) const { sink(values_.data(), size_bytes()); }
+
+private:
+    std::vector<T> values_;
+};
+
+/**
+ * Nullable(String): a null map (one byte per row) followed by the nested
+ * String body, where null rows hold empty strings. Empty values are NULL.
+ */
+class WireNullableStringBuffer {
+public:
+    void append(std::string_view value) {
+        nulls_.push_back(value.empty() ? 1 : 0);
+        values_.append(value);
+    }
+
+    void clear() {
+        nulls_.clear();
+        values_.clear();
+    }
+
+    size_t size_bytes() const { return nulls_.size() + values_.size_bytes(); }
+    size_t rows() const { return nulls_.size(); }
+
+    template<typename Sink> void write_prefix(Sink&&) const {}
+    template<typename Sink> void write_body(Sink&& sink) const {
+        sink(nulls_.data(), nulls_.size());
+        values_.write_body(sink);
+    }
+
+private:
+    std::vector<uint8_t> nulls_;
+    WireStringBuffer values_;
+};
+
+/**
+ * LowCardinality(String) with a per-batch dictionary
+ *
+ * Optimizations:
+ * - Each distinct value is sent once per insert; rows carry only an index
+ * - Indexes go out in the narrowest width the dictionary allows
+ * - Open-addressing table over offsets into one key buffer (no per-key allocation)
+ *
+ * Wire layout (shared dictionaries with additional keys, as clickhouse-cpp
+ * writes it): prefix = key version; body = index type and flags,
+ * dictionary size, dictionary String body, row count, indexes.
+ * Dictionary slot 0 holds the default value "".
+ */
+class WireLowCardinalityBuffer {
+public:
+    WireLowCardinalityBuffer() { clear(); }
+
+    void append(std::string_view value) { indexes_.push_back(intern(value)); }
+
+    /**
+     * Value interned by a reader: after the first row of a symbol in this
+     * batch, the dictionary index comes from a direct lookup, no hashing.
+     * Only the first kRemapSymbols symbols of a reader get a lookup slot, so
+     * the table stays small per batch; later ones are hashed like plain values.
+     */
+    void append(std::string_view value, uint16_t reader_id, Symbol symbol) {
+        if (symbol >= kRemapSymbols) {
+            append(value);
+            return;
+        }
+        if (reader_id >= remap_.size()) remap_.resize(reader_id + 1);
+        auto& remap = remap_[reader_id];
+        if (symbol >= remap.size()) remap.resize(symbol + 1, 0);
+        uint32_t& index_plus_one = remap[symbol];
+        if (index_plus_one == 0) {
+            index_plus_one = intern(value) + 1;
+            remapped_.emplace_back(reader_id, symbol);
+        }
+        indexes_.push_back(index_plus_one - 1);
+    }
+
+    void clear() {
+        dictionary_.clear();
+        keys_.clear();
+        key_spans_.clear();
+        indexes_.clear();
+        if (slots_.empty()) slots_.resize(64);
+        else std::fill(slots_.begin(), slots_.end(), Slot{});
+        for (const auto& [reader_id, symbol] : remapped_) remap_[reader_id][symbol] = 0;
+        remapped_.clear();
+        intern(std::string_view());
+    }
+
+    size_t size_bytes() const { return dictionary_.size_bytes() + indexes_.size() * index_width(); }
+    size_t rows() const { return indexes_.size(); }
+    size_t dictionary_size() const { return key_spans_.size(); }
+
+    template<typename Sink> void write_prefix(Sink&& sink) const {
+        const uint64_t version = kSharedDictionariesWithAdditionalKeys;
+        sink(&version, sizeof(version));
+    }
+
+    template<typename Sink> void write_body(Sink&& sink) const {
+        const size_t width = index_width();
+        const uint64_t flags = index_type(width) | kHasAdditionalKeysBit;
+        const uint64_t dictionary_rows = dictionary_.rows();
+        const uint64_t rows = indexes_.size();
+        sink(&flags, sizeof(flags));
+        sink(&dictionary_rows, sizeof(dictionary_rows));
+        dictionary_.write_body(sink);
+        sink(&rows, sizeof(rows));
+
+        // Narrow the indexes in one scratch buffer, written in one go
+        narrowed_.resize(indexes_.size() * width);
+        char* out = narrowed_.data();
+        for (uint32_t index : indexes_) {
+            std::memcpy(out, &index, width);  // Little-endian: low bytes first
+            out += width;
+        }
+        sink(narrowed_.data(), narrowed_.size());
+    }
+
+private:
+    static constexpr Symbol kRemapSymbols = 4096;     // 16 KB per reader at most
+    static constexpr uint64_t kSharedDictionariesWithAdditionalKeys = 1;
+    static constexpr uint64_t kHasAdditionalKeysBit = 1ULL << 9;
+
+    struct Slot {
+        uint32_t hash = 0;
+        uint32_t index_plus_one = 0;   // 0 = empty
+    };
+
+    size_t index_width() const {
+        const size_t n = key_spans_.size();
+        return n <= 0xff ? 1 : n <= 0xffff ? 2 : 4;
+    }
+
+    static uint64_t index_type(size_t width) {
+        return width == 1 ? 0 : width == 2 ? 1 : 2;   // UInt8 / UInt16 / UInt32
+    }
+
+    static uint32_t hash_of(std::string_view value) {
+        uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+        for (unsigned char c : value) {
+            h = (h ^ c) * 0x100000001b3ULL;
+        }
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    std::string_view key(uint32_t index) const {
+        const auto& span = key_spans_[index];
+        return std::string_view(keys_.data() + span.first, span.second);
+    }
+
+    uint32_t intern(std::string_view value) {
+        const uint32_t hash = hash_of(value);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot& slot = slots_[i];
+            if (slot.index_plus_one == 0) {
+                const uint32_t index = static_cast<uint32_t>(key_spans_.size());
+                key_spans_.emplace_back(static_cast<uint32_t>(keys_.size()),
+                                        static_cast<uint32_t>(value.size()));
+                keys_.append(value.data(), value.size());
+                dictionary_.append(value);
+                slot = Slot{hash, index + 1};
+                if (key_spans_.size() * 2 > slots_.size()) grow();
+                return index;
+            }
+            if (slot.hash == hash && key(slot.index_plus_one - 1) == value) {
+                return slot.index_plus_one - 1;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        const size_t mask = slots_.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.index_plus_one == 0) continue;
+            size_t i = slot.hash & mask;
+            while (slots_[i].index_plus_one != 0) i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    WireStringBuffer dictionary_;
+    std::string keys_;
+    std::vector<std::pair<uint32_t, uint32_t>> key_spans_;   // offset, length into keys_
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> indexes_;
+    mutable std::vector<char> narrowed_;
+
+    // (reader, symbol) -> dictionary index + 1 for this batch, and what to reset
+    std::vector<std::vector<uint32_t>> remap_;
+    std::vector<std::pair<uint16_t, Symbol>> remapped_;
+};
+
+/**
+ * Buffer type for each ColumnType
+ */
+template<ColumnType> struct ColumnBuffer;
+template<> struct ColumnBuffer<ColumnType::kString> { using type = WireStringBuffer; };
+template<> struct ColumnBuffer<ColumnType::kLowCardinalityString> { using type = WireLowCardinalityBuffer; };
+template<> struct ColumnBuffer<ColumnType::kNullableString> { using type = WireNullableStringBuffer; };
+template<> struct ColumnBuffer<ColumnType::kLevelEnum8> { using type = WireFixedBuffer<int8_t>; };
+template<> struct ColumnBuffer<ColumnType::kDateTime64Ms> { using type = WireFixedBuffer<int64_t>; };
+template<> struct ColumnBuffer<ColumnType::kUuid> { using type = WireFixedBuffer<Uuid>; };
+
+/**
+ * Per-writer columnar batch builder
+ *
+ * Optimizations:
+ * - Rows go from the ring straight into per-column wire buffers
+ * - Buffers are reused across batches (no per-insert column allocation)
+ * - Arena refs can be dropped as soon as a row is appended
+ * - Columns are sent in the table's own types (kLogSchema), so the server
+ *   does no String -> Enum8/LowCardinality/UUID conversion on insert
+ */
+class ColumnarBatch {
+public:
+    void append(const LogEntry& entry) {
+        std::get<kId>(columns_).append(entry.id);
+        std::get<kAppId>(columns_).append(entry.app_id, entry.reader_id, entry.app_id_symbol);
+        std::get<kTimestamp>(columns_).append(entry.timestamp_ms);
+        std::get<kLevel>(columns_).append(entry.level);
+        std::get<kMessage>(columns_).append(entry.message);
+        std::get<kSource>(columns_).append(entry.source, entry.reader_id, entry.source_symbol);
+        std::get<kEnvironment>(columns_).append(entry.environment, entry.reader_id, entry.environment_symbol);
+        std::get<kMetadata>(columns_).append(entry.metadata);
+        std::get<kTraceId>(columns_).append(entry.trace_id);
+        std::get<kUserId>(columns_).append(entry.user_id);
+        if (!entry.redis_id.empty()) add_redis_id(entry.reader_id, entry.redis_id);
+        ++rows_;
+    }
+
+    // ACK an entry with this batch without adding a row (deduplicated entries)
+    void add_redis_id(uint16_t reader_id, std::string_view redis_id) {
+        if (reader_id >= redis_ids_.size()) {
+            redis_ids_.resize(reader_id + 1);
+        }
+        redis_ids_[reader_id].emplace_back(redis_id);
+    }
+
+    /**
+     * Where a reader's pb entries cross this batch's edges. Only an entry's
+     * last row carries its redis_id, so one split across batches is ACKed
+     * by the batch that closes it (`closing_id`, the first id of the reader
+     * in row order) and left open by the batch with its first rows.
+     */
+    struct GroupEdge {
+        bool rows = false;          // The reader has rows in this batch
+        bool open = false;          // Its last row leaves an entry open
+        std::string closing_id;
+    };
+
+    // Record a row in arrival order, whether or not it is appended (dedup)
+    void track_group(uint16_t reader_id, std::string_view redis_id) {
+        if (reader_id >= edges_.size()) edges_.resize(reader_id + 1);
+        GroupEdge& edge = edges_[reader_id];
+        if (!redis_id.empty() && edge.closing_id.empty()) edge.closing_id.assign(redis_id);
+        edge.rows = true;
+        edge.open = redis_id.empty();
+    }
+
+    void clear() {
+        for_each_column([](const ColumnSpec&, auto& column) { column.clear(); });
+        for (auto& ids : redis_ids_) ids.clear();
+        for (auto& edge : edges_) edge = GroupEdge{};
+        rows_ = 0;
+    }
+
+    size_t rows() const { return rows_; }
+    bool empty() const { return rows_ == 0; }
+
+    size_t bytes() const {
+        size_t total = 0;
+        for_each_column([&total](const ColumnSpec&, const auto& column) { total += column.size_bytes(); });
+        return total;
+    }
+
+    /**
+     * Call `fn(spec, buffer)` for every column, in schema order
+     */
+    template<typename Fn> void for_each_column(Fn&& fn) const {
+        visit(std::forward<Fn>(fn), std::make_index_sequence<kLogColumnCount>{});
+    }
+    template<typename Fn> void for_each_column(Fn&& fn) {
+        visit(std::forward<Fn>(fn), std::make_index_sequence<kLogColumnCount>{});
+    }
+
+    // Redis IDs to ACK, grouped by the reader (stream/consumer) they came from
+    size_t reader_count() const { return redis_ids_.size(); }
+    const std::vector<std::string>& redis_ids(size_t reader_id) const { return redis_ids_[reader_id]; }
+    std::vector<std::string> take_redis_ids(size_t reader_id) { return std::move(redis_ids_[reader_id]); }
+    size_t edge_count() const { return edges_.size(); }
+    const GroupEdge& group_edge(size_t reader_id) const { return edges_[reader_id]; }
+
+private:
+    template<size_t... I>
+    static auto make_columns(std::index_sequence<I...>)
+        -> std::tuple<typename ColumnBuffer<kLogSchema[I].type>::type...>;
+    using Columns = decltype(make_columns(std::make_index_sequence<kLogColumnCount>{}));
+
+    template<typename Fn, size_t... I>
+    void visit(Fn&& fn, std::index_sequence<I...>) const {
+        (fn(kLogSchema[I], std::get<I>(columns_)), ...);
+    }
+    template<typename Fn, size_t... I>
+    void visit(Fn&& fn, std::index_sequence<I...>) {
+        (fn(kLogSchema[I], std::get<I>(columns_)), ...);
+    }
+
+    Columns columns_;
+    std::vector<std::vector<std::string>> redis_ids_;
+    std::vector<GroupEdge> edges_;
+    size_t rows_ = 0;
+};
+
+} // namespace ingester
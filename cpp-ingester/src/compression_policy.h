@@ -0,0 +1,194 @@
+#pragma once
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace ingester {
+
+/**
+ * Block compression on the native protocol
+ * clickhouse-cpp picks the ZSTD level itself; there is no level to tune.
+ */
+enum class Compression { kNone, kLz4, kZstd };
+
+inline constexpr size_t kCompressionCount = 3;
+inline constexpr const char* kCompressionNames[kCompressionCount] = {"none", "lz4", "zstd"};
+
+inline const char* compression_name(Compression method) {
+    return kCompressionNames[static_cast<size_t>(method)];
+}
+
+/**
+ * "none" | "lz4" | "zstd", or "auto" (starts with LZ4). False if unknown.
+ */
+inline bool parse_compression(const std::string& name, Compression& method, bool& automatic) {
+    automatic = name == "auto";
+    if (automatic) {
+        method = Compression::kLz4;
+        return true;
+    }
+    for (size_t i = 0; i < kCompressionCount; ++i) {
+        if (name == kCompressionNames[i]) {
+            method = static_cast<Compression>(i);
+            return true;
+        }
+    }
+    method = Compression::kLz4;
+    return false;
+}
+
+/**
+ * One batch serialized as on the wire and compressed with every method
+ */
+struct CompressionSample {
+    size_t rows = 0;
+    size_t raw_bytes = 0;
+    size_t wire_bytes[kCompressionCount] = {};
+    std::chrono::nanoseconds cpu[kCompressionCount] = {};
+};
+
+/**
+ * Per-writer compression choice (CLICKHOUSE_COMPRESSION=auto)
+ *
+ * Insert latency per row is tracked for each method; it already contains
+ * the client-side compression, the transfer and the server's work, so on
+ * a bandwidth-bound link ZSTD wins and on a CPU-bound local cluster LZ4
+ * or none does. The writer runs the best method, and every kReprobeEvery
+ * inserts tries the others for kProbeInserts inserts each to follow
+ * changes in the link or the payloads.
+ *
+ * Sampled compression time keeps probing cheap: a method whose compression
+ * alone costs more per row than a whole insert with the best method cannot
+ * win and is not probed (no reconnect, no slow inserts).
+ *
+ * current() is read by insert lanes; everything else runs on the writer thread.
+ */
+class CompressionPolicy {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kSampleEvery = 64;      // Batches between compression samples
+    static constexpr size_t kProbeInserts = 8;      // Inserts per probed method
+    static constexpr size_t kReprobeEvery = 512;    // Inserts between probe rounds
+
+    CompressionPolicy(Compression initial, bool automatic, size_t lanes)
+        : automatic_(automatic), lanes_(std::max<size_t>(1, lanes)), current_(initial) {
+        // Start with a probe round so every method has a measurement
+        if (automatic_) probe_left_ = kProbeInserts;
+    }
+
+    Compression current() const { return current_.load(std::memory_order_relaxed); }
+    bool automatic() const { return automatic_; }
+
+    /**
+     * Another CLICKHOUSE_COMPRESSION after a config reload; measurements
+     * are kept. Returns true if current() changed.
+     */
+    bool reset(Compression initial, bool automatic) {
+        automatic_ = automatic;
+        start_probe_round();
+        probe_left_ = automatic_ ? kProbeInserts : 0;
+        if (automatic_) return false;   // The probe round picks the method
+        return switch_to(initial);
+    }
+
+    // True for the batches to sample (the first, then every kSampleEvery-th)
+    bool want_sample() { return automatic_ && batches_++ % kSampleEvery == 0; }
+
+    void on_sample(const CompressionSample& sample) {
+        if (sample.rows == 0) return;
+        for (size_t m = 0; m < kCompressionCount; ++m) {
+            cpu_ns_per_row_[m] = ewma(cpu_ns_per_row_[m],
+                                      static_cast<double>(sample.cpu[m].count()) / sample.rows);
+        }
+    }
+
+    /**
+     * A successful insert of `rows`. Returns true if current() changed;
+     * lanes reconnect with the new method on their next insert.
+     */
+    bool on_insert(size_t rows, Clock::duration latency) {
+        if (!automatic_ || rows == 0) return false;
+        // Inserts still under the previous method or paying for the reconnect
+        if (settle_ > 0) {
+            --settle_;
+            return false;
+        }
+        const size_t cur = static_cast<size_t>(current());
+        insert_ns_per_row_[cur] = ewma(insert_ns_per_row_[cur],
+                                       static_cast<double>(std::chrono::nanoseconds(latency).count()) / rows);
+
+        if (probe_left_ > 0) {
+            if (--probe_left_ > 0) return false;
+            return switch_to(next_probe());
+        }
+        if (++since_probe_ >= kReprobeEvery) {
+            start_probe_round();
+            return switch_to(next_probe());
+        }
+        return false;
+    }
+
+    // Smoothed insert time per row of a method (0 = not measured yet)
+    double insert_ns_per_row(Compression method) const { return insert_ns_per_row_[static_cast<size_t>(method)]; }
+    double cpu_ns_per_row(Compression method) const { return cpu_ns_per_row_[static_cast<size_t>(method)]; }
+
+private:
+    static double ewma(double current, double sample) {
+        constexpr double kAlpha = 0.25;
+        return current == 0.0 ? sample : current + kAlpha * (sample - current);
+    }
+
+    Compression best() const {
+        size_t best = static_cast<size_t>(current());
+        for (size_t m = 0; m < kCompressionCount; ++m) {
+            if (insert_ns_per_row_[m] > 0 && insert_ns_per_row_[m] < insert_ns_per_row_[best]) best = m;
+        }
+        return static_cast<Compression>(best);
+    }
+
+    void start_probe_round() {
+        std::fill(std::begin(probed_), std::end(probed_), false);
+        since_probe_ = 0;
+    }
+
+    // Next method of the round worth probing, else the best one
+    Compression next_probe() {
+        const double best_ns = insert_ns_per_row_[static_cast<size_t>(best())];
+        probed_[static_cast<size_t>(current())] = true;
+        for (size_t m = 0; m < kCompressionCount; ++m) {
+            if (probed_[m]) continue;
+            probed_[m] = true;
+            if (best_ns > 0 && cpu_ns_per_row_[m] >= best_ns) continue;
+            probe_left_ = kProbeInserts;
+            return static_cast<Compression>(m);
+        }
+        return best();
+    }
+
+    bool switch_to(Compression method) {
+        if (method == current()) return false;
+        current_.store(method, std::memory_order_relaxed);
+        settle_ = lanes_;
+        return true;
+    }
+
+    bool automatic_;
+    const size_t lanes_;
+    std::atomic<Compression> current_;
+
+    size_t batches_ = 0;
+    size_t settle_ = 0;
+    size_t probe_left_ = 0;
+    size_t since_probe_ = 0;
+    bool probed_[kCompressionCount] = {};
+    double insert_ns_per_row_[kCompressionCount] = {};
+    double cpu_ns_per_row_[kCompressionCount] = {};
+};
+
+} // namespace ingester
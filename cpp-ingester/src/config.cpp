@@ -1,64 +1,313 @@
 #include "config.h"
+#include <cerrno>
+#include <climits>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <unistd.h>
 
 namespace ingester {
 
-static std::string get_env(const char* name, const std::string& default_value) {
-    const char* value = std::getenv(name);
+namespace {
+
+// Settings from the environment and a CONFIG_FILE's overrides; a value that
+// does not parse keeps the default and is reported through Config::validate
+struct EnvReader {
+    const Config::EnvOverrides& overrides;
+    std::vector<std::string>& invalid;
+    
+    const char* lookup(const char* name) const {
+        auto it = overrides.find(name);
+        return it != overrides.end() ? it->second.c_str() : std::getenv(name);
+    }
+};
+
+std::string get_env(const EnvReader& env, const char* name, const std::string& default_value) {
+    const char* value = env.lookup(name);
     return value ? std::string(value) : default_value;
 }
 
-static int get_env_int(const char* name, int default_value) {
-    const char* value = std::getenv(name);
-    return value ? std::atoi(value) : default_value;
+bool parse_number(const EnvReader& env, const char* name, long long& out) {
+    const char* value = env.lookup(name);
+    if (!value) return false;
+    char* end = nullptr;
+    errno = 0;
+    out = std::strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE) {
+        env.invalid.push_back(std::string(name) + "=" + value + " is not a number");
+        return false;
+    }
+    return true;
+}
+
+int get_env_int(const EnvReader& env, const char* name, int default_value) {
+    long long parsed = 0;
+    if (!parse_number(env, name, parsed)) return default_value;
+    if (parsed < INT_MIN || parsed > INT_MAX) {
+        env.invalid.push_back(std::string(name) + "=" + std::to_string(parsed) + " is out of range");
+        return default_value;
+    }
+    return static_cast<int>(parsed);
+}
+
+// size_t settings: a negative value would wrap to a huge size
+size_t get_env_size(const EnvReader& env, const char* name, size_t default_value) {
+    long long parsed = 0;
+    if (!parse_number(env, name, parsed)) return default_value;
+    if (parsed < 0) {
+        env.invalid.push_back(std::string(name) + "=" + std::to_string(parsed) + " must not be negative");
+        return default_value;
+    }
+    return static_cast<size_t>(parsed);
+}
+
+} // namespace
+
+bool Config::read_env_file(const std::string& path, EnvOverrides& out) {
+    std::ifstream in(path);
+    if (!in) return false;
+    
+    auto trim = [](std::string& s) {
+        s.erase(0, s.find_first_not_of(" \t\r"));
+        s.erase(s.find_last_not_of(" \t\r") + 1);
+    };
+    std::string line;
+    while (std::getline(in, line)) {
+        trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        trim(key);
+        trim(value);
+        if (!key.empty()) out[key] = value;
+    }
+    return true;
 }
 
-Config Config::from_env() {
+Config Config::from_env(const EnvOverrides& overrides) {
     Config cfg;
+    const EnvReader env{overrides, cfg.invalid_settings};
     
     // Redis
-    cfg.redis_host = get_env("REDIS_HOST", cfg.redis_host);
-    cfg.redis_port = get_env_int("REDIS_PORT", cfg.redis_port);
-    cfg.stream_key = get_env("STREAM_KEY", cfg.stream_key);
-    cfg.group_name = get_env("GROUP_NAME", cfg.group_name);
+    cfg.redis_host = get_env(env, "REDIS_HOST", cfg.redis_host);
+    cfg.redis_port = get_env_int(env, "REDIS_PORT", cfg.redis_port);
+    cfg.stream_key = get_env(env, "STREAM_KEY", cfg.stream_key);
+    cfg.group_name = get_env(env, "GROUP_NAME", cfg.group_name);
+    cfg.consumer_name = get_env(env, "CONSUMER_NAME", cfg.consumer_name);
+    cfg.stream_shards = get_env_int(env, "STREAM_SHARDS", cfg.stream_shards);
     
     // ClickHouse
-    cfg.clickhouse_host = get_env("CLICKHOUSE_HOST", cfg.clickhouse_host);
-    cfg.clickhouse_native_port = get_env_int("CLICKHOUSE_NATIVE_PORT", cfg.clickhouse_native_port);
-    cfg.clickhouse_database = get_env("CLICKHOUSE_DATABASE", cfg.clickhouse_database);
-    cfg.clickhouse_user = get_env("CLICKHOUSE_USER", cfg.clickhouse_user);
-    cfg.clickhouse_password = get_env("CLICKHOUSE_PASSWORD", cfg.clickhouse_password);
+    cfg.clickhouse_host = get_env(env, "CLICKHOUSE_HOST", cfg.clickhouse_host);
+    cfg.clickhouse_native_port = get_env_int(env, "CLICKHOUSE_NATIVE_PORT", cfg.clickhouse_native_port);
+    cfg.clickhouse_database = get_env(env, "CLICKHOUSE_DATABASE", cfg.clickhouse_database);
+    cfg.clickhouse_user = get_env(env, "CLICKHOUSE_USER", cfg.clickhouse_user);
+    cfg.clickhouse_password = get_env(env, "CLICKHOUSE_PASSWORD", cfg.clickhouse_password);
+    cfg.clickhouse_compression = get_env(env, "CLICKHOUSE_COMPRESSION", cfg.clickhouse_compression);
+    cfg.routes = get_env(env, "ROUTES", cfg.routes);
+    cfg.clickhouse_shards = get_env(env, "CLICKHOUSE_SHARDS", cfg.clickhouse_shards);
+    cfg.clickhouse_local_table = get_env(env, "CLICKHOUSE_LOCAL_TABLE", cfg.clickhouse_local_table);
+    cfg.shard_key = get_env(env, "SHARD_KEY", cfg.shard_key);
     
     // Performance
-    cfg.batch_size = get_env_int("BATCH_SIZE", cfg.batch_size);
-    cfg.writer_threads = get_env_int("WRITER_THREADS", cfg.writer_threads);
-    cfg.polling_interval_ms = get_env_int("POLLING_INTERVAL_MS", cfg.polling_interval_ms);
+    cfg.batch_size = get_env_size(env, "BATCH_SIZE", cfg.batch_size);
+    cfg.batch_size = get_env_size(env, "MAX_BATCH_ROWS", cfg.batch_size);
+    cfg.max_batch_bytes = get_env_size(env, "MAX_BATCH_BYTES", cfg.max_batch_bytes);
+    cfg.max_linger_ms = get_env_int(env, "MAX_LINGER_MS", cfg.max_linger_ms);
+    cfg.adaptive_batching = get_env_int(env, "ADAPTIVE_BATCHING", cfg.adaptive_batching) != 0;
+    cfg.min_batch_rows = get_env_size(env, "MIN_BATCH_ROWS", cfg.min_batch_rows);
+    cfg.min_insert_interval_ms = get_env_int(env, "MIN_INSERT_INTERVAL_MS", cfg.min_insert_interval_ms);
+    cfg.writer_threads = get_env_int(env, "WRITER_THREADS", cfg.writer_threads);
+    cfg.max_writer_threads = get_env_int(env, "MAX_WRITER_THREADS", cfg.max_writer_threads);
+    cfg.insert_pipeline_depth = get_env_size(env, "INSERT_PIPELINE_DEPTH", cfg.insert_pipeline_depth);
+    cfg.reader_threads = get_env_int(env, "READER_THREADS", cfg.reader_threads);
+    cfg.polling_interval_ms = get_env_int(env, "POLLING_INTERVAL_MS", cfg.polling_interval_ms);
+    cfg.read_pipeline_depth = get_env_size(env, "READ_PIPELINE_DEPTH", cfg.read_pipeline_depth);
+    cfg.shared_dispatch = get_env_int(env, "SHARED_DISPATCH", cfg.shared_dispatch) != 0;
+    cfg.event_loop = get_env_int(env, "EVENT_LOOP", cfg.event_loop) != 0;
+    cfg.raw_replies = get_env_int(env, "RAW_REPLIES", cfg.raw_replies) != 0;
+    cfg.claim_min_idle_ms = get_env_int(env, "CLAIM_MIN_IDLE_MS", cfg.claim_min_idle_ms);
+    cfg.max_deliveries = get_env_int(env, "MAX_DELIVERIES", cfg.max_deliveries);
+    cfg.memory_budget_mb = get_env_size(env, "MEMORY_BUDGET_MB", cfg.memory_budget_mb);
+    cfg.app_budget_percent = std::clamp(get_env_int(env, "APP_BUDGET_PERCENT", cfg.app_budget_percent), 1, 100);
+    
+    // Placement
+    cfg.reader_cpus = get_env(env, "READER_CPUS", cfg.reader_cpus);
+    cfg.writer_cpus = get_env(env, "WRITER_CPUS", cfg.writer_cpus);
+    cfg.ack_cpus = get_env(env, "ACK_CPUS", cfg.ack_cpus);
+    
+    // Spill
+    cfg.spill_dir = get_env(env, "SPILL_DIR", cfg.spill_dir);
+    cfg.spill_segment_mb = get_env_size(env, "SPILL_SEGMENT_MB", cfg.spill_segment_mb);
+    cfg.spill_max_mb = get_env_size(env, "SPILL_MAX_MB", cfg.spill_max_mb);
+    
+    // ACK
+    cfg.ack_linger_ms = get_env_int(env, "ACK_LINGER_MS", cfg.ack_linger_ms);
+    cfg.ack_delete = get_env_int(env, "ACK_DELETE", cfg.ack_delete) != 0;
+    cfg.stream_maxlen = get_env_size(env, "STREAM_MAXLEN", cfg.stream_maxlen);
+    cfg.dead_letter_suffix = get_env(env, "DEAD_LETTER_SUFFIX", cfg.dead_letter_suffix);
+    
+    // Dedup
+    cfg.dedup_collapse = get_env_int(env, "DEDUP_COLLAPSE", cfg.dedup_collapse) != 0;
+    cfg.dedup_replays = get_env_int(env, "DEDUP_REPLAYS", cfg.dedup_replays) != 0;
+    cfg.dedup_window_ms = get_env_int(env, "DEDUP_WINDOW_MS", cfg.dedup_window_ms);
+    cfg.deterministic_ids = get_env_int(env, "DETERMINISTIC_IDS", cfg.deterministic_ids) != 0;
+    
+    // Observability
+    cfg.metrics_port = get_env_int(env, "METRICS_PORT", cfg.metrics_port);
+    cfg.log_level = get_env(env, "LOG_LEVEL", cfg.log_level);
+    cfg.log_format = get_env(env, "LOG_FORMAT", cfg.log_format);
     
     return cfg;
 }
 
 void Config::parse_args(int argc, char** argv) {
+    // Numeric options go through the env parsers, so a bad value is
+    // reported by validate() as "--batch=-5 ..." instead of wrapping
+    EnvOverrides args;
+    EnvReader env{args, invalid_settings};
+    auto value_of = [&](int& i) {
+        args[argv[i]] = argv[i + 1];
+        return argv[i++];
+    };
     for (int i = 1; i < argc; ++i) {
         if (std::strcmp(argv[i], "--benchmark") == 0) {
             benchmark_mode = true;
+        } else if (std::strcmp(argv[i], "--compression-bench") == 0) {
+            compression_bench = true;
         } else if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
-            benchmark_count = std::atoi(argv[++i]);
+            benchmark_count = get_env_size(env, value_of(i), benchmark_count);
         } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
-            writer_threads = std::atoi(argv[++i]);
+            writer_threads = get_env_int(env, value_of(i), writer_threads);
+        } else if (std::strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            reader_threads = get_env_int(env, value_of(i), reader_threads);
         } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
-            batch_size = std::atoi(argv[++i]);
+            batch_size = get_env_size(env, value_of(i), batch_size);
         } else if (std::strcmp(argv[i], "--help") == 0) {
             std::cout << "Usage: clickhouse_ingester [OPTIONS]\n"
                       << "Options:\n"
                       << "  --benchmark       Run in benchmark mode (exit after count)\n"
+                      << "  --compression-bench  Compare wire bytes per row of none/lz4/zstd on the stream\n"
                       << "  --count N         Number of logs for benchmark (default: 50000)\n"
                       << "  --threads N       Number of writer threads (default: 4)\n"
-                      << "  --batch N         Batch size before flush (default: 10000)\n"
+                      << "  --readers N       Number of reader threads (default: 1)\n"
+                      << "  --batch N         Max rows per batch (default: 10000)\n"
                       << "  --help            Show this help\n";
             std::exit(0);
         }
     }
 }
 
+bool Config::validate(std::string& error) const {
+    if (!invalid_settings.empty()) {
+        error = invalid_settings.front();
+        return false;
+    }
+    const struct { bool ok; const char* message; } checks[] = {
+        {batch_size > 0, "BATCH_SIZE must be at least 1"},
+        {max_batch_bytes > 0, "MAX_BATCH_BYTES must be at least 1"},
+        {min_batch_rows > 0, "MIN_BATCH_ROWS must be at least 1"},
+        {max_linger_ms >= 0, "MAX_LINGER_MS must not be negative"},
+        {min_insert_interval_ms >= 0, "MIN_INSERT_INTERVAL_MS must not be negative"},
+        {writer_threads >= 0, "WRITER_THREADS must not be negative"},
+        {max_writer_threads >= 0, "MAX_WRITER_THREADS must not be negative"},
+        {reader_threads >= 0, "READER_THREADS must not be negative"},
+        {stream_shards >= 0, "STREAM_SHARDS must not be negative"},
+        {polling_interval_ms >= 0, "POLLING_INTERVAL_MS must not be negative"},
+        {claim_min_idle_ms >= 0, "CLAIM_MIN_IDLE_MS must not be negative"},
+        {max_deliveries >= 0, "MAX_DELIVERIES must not be negative"},
+        {ack_linger_ms >= 0, "ACK_LINGER_MS must not be negative"},
+        {dedup_window_ms >= 0, "DEDUP_WINDOW_MS must not be negative"},
+        {redis_port > 0 && redis_port <= 65535, "REDIS_PORT must be 1..65535"},
+        {clickhouse_native_port > 0 && clickhouse_native_port <= 65535, "CLICKHOUSE_NATIVE_PORT must be 1..65535"},
+        {metrics_port >= 0 && metrics_port <= 65535, "METRICS_PORT must be 0..65535"},
+    };
+    for (const auto& check : checks) {
+        if (!check.ok) {
+            error = check.message;
+            return false;
+        }
+    }
+    return true;
+}
+
+int Config::effective_reader_threads() const {
+    return std::max({1, reader_threads, stream_shards});
+}
+
+std::string Config::reader_consumer_name(int n) const {
+    if (effective_reader_threads() == 1) return consumer_name;
+    
+    char host[256] = {0};
+    if (gethostname(host, sizeof(host) - 1) != 0) {
+        std::strcpy(host, "localhost");
+    }
+    return consumer_name + "-" + host + "-" + std::to_string(n);
+}
+
+std::string Config::reader_stream_key(int n) const {
+    if (stream_shards <= 0) return stream_key;
+    return stream_key + ":" + std::to_string(n % stream_shards);
+}
+
+int Config::writer_pool_size() const {
+    return std::max({1, writer_threads, max_writer_threads});
+}
+
+bool Config::parse_replicas(std::vector<HostPort>& out, std::string& error) const {
+    out.clear();
+    size_t start = 0;
+    while (start <= clickhouse_host.size()) {
+        size_t end = clickhouse_host.find(',', start);
+        if (end == std::string::npos) end = clickhouse_host.size();
+        std::string item = clickhouse_host.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+        
+        // host, host:port, [v6] or [v6]:port; a bare v6 literal has no port
+        HostPort replica{item, clickhouse_native_port};
+        size_t colon = std::string::npos;
+        if (item[0] == '[') {
+            const size_t close = item.find(']');
+            if (close == std::string::npos || (close + 1 < item.size() && item[close + 1] != ':')) {
+                error = "bad address '" + item + "'";
+                return false;
+            }
+            replica.host = item.substr(1, close - 1);
+            if (close + 1 < item.size()) colon = close + 1;
+        } else if (item.find(':') == item.rfind(':')) {
+            colon = item.find(':');
+            if (colon != std::string::npos) replica.host = item.substr(0, colon);
+        }
+        if (colon != std::string::npos) {
+            const std::string port = item.substr(colon + 1);
+            char* rest = nullptr;
+            const long value = std::strtol(port.c_str(), &rest, 10);
+            if (port.empty() || *rest != '\0' || value < 1 || value > 65535) {
+                error = "bad port in '" + item + "'";
+                return false;
+            }
+            replica.port = static_cast<int>(value);
+        }
+        if (replica.host.empty()) {
+            error = "no host in '" + item + "'";
+            return false;
+        }
+        out.push_back(std::move(replica));
+    }
+    if (out.empty()) out.push_back({"localhost", clickhouse_native_port});
+    return true;
+}
+
+std::vector<HostPort> Config::clickhouse_replicas() const {
+    // Checked by parse_routes at startup and on reload
+    std::vector<HostPort> out;
+    std::string error;
+    parse_replicas(out, error);
+    if (out.empty()) out.push_back({"localhost", clickhouse_native_port});
+    return out;
+}
+
 } // namespace ingester
@@ -3,9 +3,16 @@
 #include <string>
 #include <cstdlib>
 #include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 namespace ingester {
 
+struct HostPort {
+    std::string host;
+    int port = 0;
+};
+
 struct Config {
     // Redis settings
     std::string redis_host = "localhost";
@@ -15,27 +22,110 @@ struct Config {
     std::string consumer_name = "cpp-ingester";
     
     // ClickHouse settings
-    std::string clickhouse_host = "localhost";
+    std::string clickhouse_host = "localhost";   // host[:port], comma-separated replicas fail over in order
     int clickhouse_native_port = 9000;
     std::string clickhouse_database = "logs_db";
     std::string clickhouse_table = "logs";
     std::string clickhouse_user = "default";
     std::string clickhouse_password = "";
+    std::string clickhouse_compression = "lz4";  // none | lz4 | zstd | auto
+    std::string routes = "";            // Extra insert routes with their own writer pools (router.h)
+    
+    // Sharded cluster: insert into each shard's local table directly
+    std::string clickhouse_shards = ""; // "a1,a2:9001;b1,b2" = shards by ';', replicas by ','
+    std::string clickhouse_local_table = "";    // Table on the shards ("" = clickhouse_table)
+    std::string shard_key = "app_id";   // app_id | source | environment | trace_id | user_id
     
     // Performance settings
-    size_t batch_size = 10000;          // Logs per batch
+    size_t batch_size = 10000;          // Max rows per batch (max_batch_rows)
+    size_t max_batch_bytes = 64 << 20;  // Flush once a batch holds this many bytes
+    int max_linger_ms = 1000;           // Flush once the oldest row waited this long
+    bool adaptive_batching = true;      // Size batches from incoming rate and insert latency
+    size_t min_batch_rows = 1000;       // Adaptive target floor
+    int min_insert_interval_ms = 1000;  // Adaptive: aim for at most one insert per interval per writer
     size_t read_batch_size = 1000;      // Messages per XREADGROUP
     int writer_threads = 4;             // Parallel writer threads
+    int max_writer_threads = 0;         // Per pool, reachable by reload ("0" = writer_threads); rings are sized for it
+    size_t insert_pipeline_depth = 1;   // Inserts in flight per writer, one connection each (1 = inline)
+    int reader_threads = 1;             // Parallel XREADGROUP consumers
+    int stream_shards = 0;              // 0 = single stream_key, k = stream_key:{0..k-1}
     int block_ms = 100;                 // XREADGROUP block timeout
     int polling_interval_ms = 0;        // 0 = Blocking mode, > 0 = Polling mode (ms)
     size_t ring_buffer_size = 100000;   // Lock-free buffer capacity
+    size_t read_pipeline_depth = 2;     // XREADGROUPs in flight while parsing (0 = serial)
+    bool shared_dispatch = false;       // One MPMC queue of reply chunks instead of per-writer rings
+    bool event_loop = false;            // reader_threads threads multiplex all consumers' connections
+    bool raw_replies = true;            // Scan XREADGROUP replies in place instead of building redisReply trees
+    int claim_min_idle_ms = 300000;     // XAUTOCLAIM entries pending this long at any consumer (0 = own PEL only)
+    int max_deliveries = 10;            // Recovery dead-letters entries delivered more often (0 = no limit)
+    size_t memory_budget_mb = 0;        // Bytes of parsed entries in flight, all readers (0 = unbounded)
+    int app_budget_percent = 50;        // Share of the budget one app_id may hold (needs claim_min_idle_ms > 0)
+    
+    // Placement: "" = unpinned, "0-3,8" = one core per thread, "node:0,1" = one NUMA node per thread
+    std::string reader_cpus = "";
+    std::string writer_cpus = "";       // Ring slots also move to their writer's node
+    std::string ack_cpus = "";
+    
+    // Spill log (ClickHouse outages)
+    std::string spill_dir = "";         // Empty = disabled
+    size_t spill_segment_mb = 64;       // Preallocated segment size
+    size_t spill_max_mb = 4096;         // Cap on spilled data on disk
+    
+    // ACK settings
+    int ack_linger_ms = 5;              // Coalesce IDs from all writers this long
+    bool ack_delete = false;            // XDEL entries once ACKed
+    size_t stream_maxlen = 0;           // > 0: periodic XTRIM MAXLEN ~ N
+    std::string dead_letter_suffix = ":dlq";    // Unparseable / over-delivered entries go to "<stream><suffix>" ("" = ACK and drop)
+    
+    // Dedup stage (before the column builder)
+    bool dedup_collapse = false;        // Identical rows of a batch go out once with a repeat_count
+    bool dedup_replays = false;         // Drop redelivered entries that were already inserted
+    int dedup_window_ms = 60000;        // How long inserted stream IDs are remembered
+    bool deterministic_ids = false;     // Row ids derived from the entry + insert_deduplication_token per block
+    
+    // Observability
+    int metrics_port = 9464;            // Prometheus /metrics (0 = disabled)
+    std::string log_level = "info";     // debug | info | warn | error
+    std::string log_format = "text";    // text | json
     
     // Benchmark mode
     bool benchmark_mode = false;
+    bool compression_bench = false;     // Report wire bytes per row for each method, then exit
     size_t benchmark_count = 50000;
     
-    // Load from environment variables
-    static Config from_env();
+    // Settings from_env could not parse; they kept their defaults
+    std::vector<std::string> invalid_settings;
+    
+    // False with a message if a setting did not parse or is out of range
+    bool validate(std::string& error) const;
+    
+    // Readers needed: at least one per stream shard
+    int effective_reader_threads() const;
+    
+    // Identity of reader n: "<consumer_name>-<host>-<n>" (plain name for a single reader)
+    std::string reader_consumer_name(int n) const;
+    
+    // Stream reader n consumes: stream_key, or shard "<stream_key>:<n % shards>"
+    std::string reader_stream_key(int n) const;
+    
+    // clickhouse_host split into replicas (host, host:port, [v6]:port); a replica
+    // without a port uses clickhouse_native_port
+    std::vector<HostPort> clickhouse_replicas() const;
+    
+    // As clickhouse_replicas, but false with a message on a bad host or port
+    bool parse_replicas(std::vector<HostPort>& out, std::string& error) const;
+    
+    // Writer threads a pool has rings and ACK lanes for: the most a reload can scale it to
+    int writer_pool_size() const;
+    
+    // KEY=VALUE settings of a CONFIG_FILE; they take precedence over the environment
+    using EnvOverrides = std::unordered_map<std::string, std::string>;
+    
+    // Read a CONFIG_FILE: one KEY=VALUE per line, '#' comments; false if unreadable
+    static bool read_env_file(const std::string& path, EnvOverrides& out);
+    
+    // Load from environment variables (and a CONFIG_FILE's overrides)
+    static Config from_env(const EnvOverrides& overrides = {});
     
     // Parse command line args
     void parse_args(int argc, char** argv);
@@ -0,0 +1,221 @@
+#include "dedup_stage.h"
+#include "hash.h"
+#include <algorithm>
+
+namespace ingester {
+
+namespace {
+
+constexpr std::string_view kRepeatKey = "\"repeat_count\":";
+
+// Key 0 marks an empty slot
+uint64_t nonzero(uint64_t h) { return h ? h : 1; }
+
+} // namespace
+
+bool DedupStage::HashSet::contains(uint64_t key) const {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        if (slots_[i] == 0) return false;
+        if (slots_[i] == key) return true;
+    }
+}
+
+void DedupStage::HashSet::insert(uint64_t key) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+        std::vector<uint64_t> old(slots_.size() * 2);
+        old.swap(slots_);
+        size_ = 0;
+        for (uint64_t k : old) {
+            if (k) insert(k);
+        }
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        if (slots_[i] == key) return;
+        if (slots_[i] == 0) {
+            slots_[i] = key;
+            ++size_;
+            return;
+        }
+    }
+}
+
+void DedupStage::HashSet::clear() {
+    std::fill(slots_.begin(), slots_.end(), 0);
+    size_ = 0;
+}
+
+DedupStage::DedupStage(const Config& config)
+    : collapse_(config.dedup_collapse)
+    , replays_(config.dedup_replays)
+    , window_(std::chrono::milliseconds(std::max(1, config.dedup_window_ms)))
+    , indexes_(collapse_ ? 1024 : 0)
+    , window_started_(Clock::now()) {}
+
+uint64_t DedupStage::content_hash(const LogEntry& entry) {
+    uint64_t h = hash_bytes(entry.message, static_cast<uint64_t>(entry.level));
+    h = hash_combine(h, hash_bytes(entry.app_id));
+    h = hash_combine(h, hash_bytes(entry.source));
+    h = hash_combine(h, hash_bytes(entry.environment));
+    h = hash_combine(h, hash_bytes(entry.metadata));
+    h = hash_combine(h, hash_bytes(entry.trace_id));
+    h = hash_combine(h, hash_bytes(entry.user_id));
+    return nonzero(h);
+}
+
+uint64_t DedupStage::replay_hash(const LogEntry& entry) {
+    return nonzero(hash_combine(hash_bytes(entry.redis_id), hash_bytes(entry.trace_id)));
+}
+
+bool DedupStage::same_content(const LogEntry& a, const LogEntry& b) {
+    return a.level == b.level && a.message == b.message && a.app_id == b.app_id &&
+           a.source == b.source && a.environment == b.environment && a.metadata == b.metadata &&
+           a.trace_id == b.trace_id && a.user_id == b.user_id;
+}
+
+long DedupStage::find_held(const LogEntry& entry, uint64_t hash) const {
+    const size_t mask = indexes_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const auto& slot = indexes_[i];
+        if (slot.second == 0) return -1;
+        if (slot.first == hash && same_content(held_[slot.second - 1], entry)) return slot.second - 1;
+    }
+}
+
+void DedupStage::index_held(uint64_t hash, uint32_t index) {
+    const size_t mask = indexes_.size() - 1;
+    size_t i = hash & mask;
+    while (indexes_[i].second != 0) i = (i + 1) & mask;
+    indexes_[i] = {hash, index + 1};
+}
+
+void DedupStage::rehash() {
+    indexes_.assign(indexes_.size() * 2, {0, 0});
+    for (uint32_t i = 0; i < held_.size(); ++i) index_held(hashes_[i], i);
+}
+
+// {...} or empty: "repeat_count" can be added without rewriting the value
+bool DedupStage::carries_count(std::string_view metadata) {
+    while (!metadata.empty() && (metadata.back() == ' ' || metadata.back() == '\n')) metadata.remove_suffix(1);
+    return metadata.empty() || (metadata.size() >= 2 && metadata.front() == '{' && metadata.back() == '}');
+}
+
+// Into `batch` (held rows go through place()), or just dropped when null
+void DedupStage::release_group(std::vector<LogEntry>& group, ColumnarBatch* batch) {
+    if (batch) {
+        for (const LogEntry& row : group) place(row, *batch);
+    }
+    for (const LogEntry& row : group) group_bytes_ -= row.estimated_size();
+    group_rows_ -= group.size();
+    release_arenas(group);
+    group.clear();
+}
+
+DedupStage::Result DedupStage::add(const LogEntry& entry, ColumnarBatch& batch) {
+    if (replays_) {
+        if (entry.reader_id >= groups_.size()) groups_.resize(entry.reader_id + 1);
+        std::vector<LogEntry>& group = groups_[entry.reader_id];
+        
+        // A pb entry's leading rows wait for its last one, which has the stream ID
+        if (entry.redis_id.empty()) {
+            if (entry.arena) entry.arena->retain(1);
+            group.push_back(entry);
+            ++group_rows_;
+            group_bytes_ += entry.estimated_size();
+            return Result::kHeld;
+        }
+        const uint64_t key = replay_hash(entry);
+        if (seen(key)) {
+            absorbed_ += group.size() + 1;
+            release_group(group, nullptr);
+            batch.add_redis_id(entry.reader_id, entry.redis_id);
+            return Result::kDropped;
+        }
+        pending_keys_.push_back(key);
+        release_group(group, &batch);
+    }
+    return place(entry, batch);
+}
+
+DedupStage::Result DedupStage::place(const LogEntry& entry, ColumnarBatch& batch) {
+    if (!collapse_ || !carries_count(entry.metadata)) {
+        batch.append(entry);
+        return Result::kAppended;
+    }
+
+    const uint64_t hash = content_hash(entry);
+    const long index = find_held(entry, hash);
+    if (index >= 0) {
+        ++counts_[index];
+        if (!entry.redis_id.empty()) batch.add_redis_id(entry.reader_id, entry.redis_id);
+        ++absorbed_;
+        return Result::kCollapsed;
+    }
+    if (entry.arena) entry.arena->retain(1);
+    if ((held_.size() + 1) * 2 > indexes_.size()) rehash();
+    index_held(hash, static_cast<uint32_t>(held_.size()));
+    held_.push_back(entry);
+    hashes_.push_back(hash);
+    counts_.push_back(1);
+    held_bytes_ += entry.estimated_size();
+    return Result::kHeld;
+}
+
+void DedupStage::finish(ColumnarBatch& batch, Clock::time_point now) {
+    // Entries cut by the flush go out now; their last row decides nothing
+    for (auto& group : groups_) release_group(group, &batch);
+    
+    for (size_t i = 0; i < held_.size(); ++i) {
+        if (counts_[i] == 1) {
+            batch.append(held_[i]);
+            continue;
+        }
+        // {...} -> {...,"repeat_count":N}, empty -> {"repeat_count":N} (place() holds nothing else)
+        std::string_view meta = held_[i].metadata;
+        while (!meta.empty() && (meta.back() == ' ' || meta.back() == '\n')) meta.remove_suffix(1);
+        metadata_.clear();
+        if (!meta.empty()) {
+            metadata_.append(meta.data(), meta.size() - 1);
+            if (meta.find_first_not_of(" \n\t", 1) != meta.size() - 1) metadata_ += ',';
+        } else {
+            metadata_ += '{';
+        }
+        metadata_.append(kRepeatKey.data(), kRepeatKey.size());
+        metadata_ += std::to_string(counts_[i]);
+        metadata_ += '}';
+
+        LogEntry row = held_[i];
+        row.metadata = metadata_;
+        batch.append(row);
+    }
+    release_arenas(held_);
+    held_.clear();
+    hashes_.clear();
+    counts_.clear();
+    std::fill(indexes_.begin(), indexes_.end(), std::pair<uint64_t, uint32_t>{0, 0});
+    held_bytes_ = 0;
+    absorbed_ = 0;
+
+    if (!replays_) return;
+    inflight_.emplace_back(&batch, std::move(pending_keys_));
+    pending_keys_.clear();
+    if (now - window_started_ >= window_) {
+        std::swap(current_, previous_);
+        current_.clear();
+        window_started_ = now;
+    }
+}
+
+void DedupStage::on_complete(const ColumnarBatch& batch, bool written) {
+    for (auto it = inflight_.begin(); it != inflight_.end(); ++it) {
+        if (it->first != &batch) continue;
+        if (written) {
+            for (uint64_t key : it->second) current_.insert(key);
+        }
+        inflight_.erase(it);
+        return;
+    }
+}
+
+} // namespace ingester
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "column_batch.h"
+#include "config.h"
+#include "log_entry.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Optional per-writer stage between the rings and the column builder
+ *
+ * - Collapse (DEDUP_COLLAPSE): rows identical in every field but id and
+ *   timestamp are held until the batch flushes and go out once, with
+ *   "repeat_count":N added to their metadata. The first occurrence keeps
+ *   its id and timestamp. Only rows whose metadata is empty or a JSON
+ *   object can carry the count; others are never collapsed.
+ * - Replays (DEDUP_REPLAYS): a stream entry redelivered (PEL recovery,
+ *   XAUTOCLAIM) with the same redis_id and trace_id as one this writer
+ *   inserted within the last DEDUP_WINDOW_MS is dropped. Keys count only
+ *   once their batch is written, so a failed insert is never "seen".
+ *   Only the last log of a pb entry carries the stream ID, so the others
+ *   are held until it arrives and the entry is dropped or kept as a whole.
+ *   An entry whose rows span two batches is emitted with the first one
+ *   and only deduplicated from there on.
+ *
+ * Dropped and collapsed entries still have their IDs ACKed with the batch.
+ * Each writer deduplicates only what it drains itself; rows are hashed
+ * once (hash.h) and compared in full before being collapsed.
+ */
+class DedupStage {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Result {
+        kAppended,      // Went straight into the batch
+        kHeld,          // First of its kind, emitted by finish()
+        kCollapsed,     // Counted on a held row
+        kDropped,       // Replay
+    };
+
+    explicit DedupStage(const Config& config);
+
+    bool enabled() const { return collapse_ || replays_; }
+
+    /**
+     * Route one entry. Held rows take their own arena ref, so the caller
+     * releases every entry it passed in as before.
+     */
+    Result add(const LogEntry& entry, ColumnarBatch& batch);
+
+    /**
+     * Emit the held rows into `batch`, before it is flushed
+     */
+    void finish(ColumnarBatch& batch, Clock::time_point now);
+
+    /**
+     * The insert of a finished batch returned (written or spilled = true)
+     */
+    void on_complete(const ColumnarBatch& batch, bool written);
+
+    // Entries taken since the last finish() that are not batch rows yet
+    size_t pending() const { return held_.size() + absorbed_ + group_rows_; }
+    size_t pending_bytes() const { return held_bytes_ + group_bytes_; }
+
+private:
+    // Open addressing over 64-bit hashes; 0 marks an empty slot
+    class HashSet {
+    public:
+        HashSet() : slots_(1024) {}
+
+        bool contains(uint64_t key) const;
+        void insert(uint64_t key);
+        void clear();
+        size_t size() const { return size_; }
+
+    private:
+        std::vector<uint64_t> slots_;
+        size_t size_ = 0;
+    };
+
+    static uint64_t content_hash(const LogEntry& entry);
+    static uint64_t replay_hash(const LogEntry& entry);
+    static bool same_content(const LogEntry& a, const LogEntry& b);
+    static bool carries_count(std::string_view metadata);
+    
+    // Collapse or append one row (after the replay check)
+    Result place(const LogEntry& entry, ColumnarBatch& batch);
+    void release_group(std::vector<LogEntry>& group, ColumnarBatch* batch);
+
+    bool seen(uint64_t key) const { return current_.contains(key) || previous_.contains(key); }
+
+    // Index of the held row matching `entry`, or -1
+    long find_held(const LogEntry& entry, uint64_t hash) const;
+    void index_held(uint64_t hash, uint32_t index);
+    void rehash();
+
+    const bool collapse_;
+    const bool replays_;
+    const Clock::duration window_;
+
+    // Held rows in arrival order, with their hash and occurrence count
+    std::vector<LogEntry> held_;
+    std::vector<uint64_t> hashes_;
+    std::vector<uint32_t> counts_;
+    std::vector<std::pair<uint64_t, uint32_t>> indexes_;    // hash, held index + 1 (0 = empty)
+    size_t held_bytes_ = 0;
+    size_t absorbed_ = 0;
+    std::string metadata_;          // Scratch for a collapsed row's metadata
+
+    // Replays: leading rows of the pb entry each reader is in the middle of
+    std::vector<std::vector<LogEntry>> groups_;
+    size_t group_rows_ = 0;
+    size_t group_bytes_ = 0;
+
+    // Replay keys of the current and the previous window
+    HashSet current_;
+    HashSet previous_;
+    Clock::time_point window_started_;
+    std::vector<uint64_t> pending_keys_;
+    std::vector<std::pair<const ColumnarBatch*, std::vector<uint64_t>>> inflight_;
+};
+
+} // namespace ingester
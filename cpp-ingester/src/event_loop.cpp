@@ -0,0 +1,138 @@
+#include "event_loop.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+namespace ingester {
+
+namespace {
+
+void drain(int fd) {
+    uint64_t buf[8];
+    while (::read(fd, buf, sizeof(buf)) > 0) {}
+}
+
+} // namespace
+
+#if defined(__linux__)
+
+EventLoop::EventLoop() {
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_read_ = wake_write_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_ < 0 || wake_read_ < 0) {
+        LOG_ERROR("loop") << "epoll setup failed: " << std::strerror(errno);
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // nullptr tag = wake-up
+    ok_ = epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_read_, &ev) == 0;
+}
+
+EventLoop::~EventLoop() {
+    if (wake_read_ >= 0) ::close(wake_read_);
+    if (epoll_ >= 0) ::close(epoll_);
+}
+
+bool EventLoop::add(int fd, void* tag) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    return epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+size_t EventLoop::wait(std::vector<void*>& ready, std::chrono::milliseconds timeout) {
+    epoll_event events[64];
+    const int n = epoll_wait(epoll_, events, 64, static_cast<int>(timeout.count()));
+    size_t added = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!events[i].data.ptr) {
+            drain(wake_read_);
+            continue;
+        }
+        ready.push_back(events[i].data.ptr);
+        ++added;
+    }
+    return added;
+}
+
+void EventLoop::wake() {
+    const uint64_t one = 1;
+    (void)!::write(wake_write_, &one, sizeof(one));
+}
+
+#else
+
+EventLoop::EventLoop() {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        LOG_ERROR("loop") << "pipe failed: " << std::strerror(errno);
+        return;
+    }
+    wake_read_ = fds[0];
+    wake_write_ = fds[1];
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    ok_ = true;
+}
+
+EventLoop::~EventLoop() {
+    if (wake_read_ >= 0) ::close(wake_read_);
+    if (wake_write_ >= 0) ::close(wake_write_);
+}
+
+bool EventLoop::add(int fd, void* tag) {
+    fds_.push_back(fd);
+    tags_.push_back(tag);
+    return true;
+}
+
+void EventLoop::remove(int fd) {
+    auto it = std::find(fds_.begin(), fds_.end(), fd);
+    if (it == fds_.end()) return;
+    tags_.erase(tags_.begin() + (it - fds_.begin()));
+    fds_.erase(it);
+}
+
+size_t EventLoop::wait(std::vector<void*>& ready, std::chrono::milliseconds timeout) {
+    std::vector<pollfd> polled(fds_.size() + 1);
+    polled[0] = {wake_read_, POLLIN, 0};
+    for (size_t i = 0; i < fds_.size(); ++i) polled[i + 1] = {fds_[i], POLLIN, 0};
+
+    const int n = ::poll(polled.data(), polled.size(), static_cast<int>(timeout.count()));
+    if (n <= 0) return 0;
+    if (polled[0].revents) drain(wake_read_);
+    size_t added = 0;
+    for (size_t i = 0; i < fds_.size(); ++i) {
+        if (!polled[i + 1].revents) continue;
+        ready.push_back(tags_[i]);
+        ++added;
+    }
+    return added;
+}
+
+void EventLoop::wake() {
+    const char one = 1;
+    (void)!::write(wake_write_, &one, sizeof(one));
+}
+
+#endif
+
+} // namespace ingester
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Readiness loop over many sockets for one thread
+ *
+ * epoll on Linux, poll() elsewhere. Only read interest: the connections
+ * it serves write small commands that never fill the socket buffer.
+ * Level-triggered, so a connection whose reply was only partly consumed
+ * comes back on the next wait.
+ *
+ * Not thread-safe except wake(); add() and remove() belong to the thread
+ * that calls wait().
+ */
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool ok() const { return ok_; }
+
+    bool add(int fd, void* tag);
+    void remove(int fd);
+
+    /**
+     * Wait until a socket is readable, wake() is called or `timeout` passes
+     * Tags of the readable sockets are appended to `ready`.
+     */
+    size_t wait(std::vector<void*>& ready, std::chrono::milliseconds timeout);
+
+    // Interrupt a wait() in progress (any thread)
+    void wake();
+
+private:
+    bool ok_ = false;
+    int wake_read_ = -1;
+    int wake_write_ = -1;       // Same as wake_read_ for an eventfd
+#if defined(__linux__)
+    int epoll_ = -1;
+#else
+    std::vector<int> fds_;
+    std::vector<void*> tags_;
+#endif
+};
+
+} // namespace ingester
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace ingester {
+
+/**
+ * Per-writer flush policy: size caps, linger deadline and adaptive row target
+ *
+ * A batch is flushed when any of these holds:
+ * - rows reach the current row target (<= max_batch_rows)
+ * - bytes reach max_batch_bytes
+ * - the oldest row has waited max_linger_ms
+ *
+ * With adaptive batching the row target follows the observed incoming rate
+ * and insert latency: rows that arrive within one insert interval, where the
+ * interval is at least min_insert_interval_ms and at least twice the insert
+ * latency. Bursty traffic then produces few large parts instead of many
+ * small ones, while a quiet stream is still flushed within the linger.
+ */
+class FlushPolicy {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FlushPolicy(const Config& config)
+        : max_rows_(std::max<size_t>(1, config.batch_size))
+        , min_rows_(std::min(std::max<size_t>(1, config.min_batch_rows), max_rows_))
+        , max_bytes_(config.max_batch_bytes)
+        , linger_(std::chrono::milliseconds(config.max_linger_ms))
+        , min_interval_(std::chrono::milliseconds(config.min_insert_interval_ms))
+        , adaptive_(config.adaptive_batching)
+        , target_rows_(adaptive_ ? min_rows_ : max_rows_)
+        , last_flush_(Clock::now()) {}
+
+    /**
+     * New limits from a config reload, between two batches
+     * The observed rate and latency are kept, so an adaptive target moves
+     * on from where it was instead of starting at the floor again.
+     */
+    void reconfigure(const Config& config) {
+        max_rows_ = std::max<size_t>(1, config.batch_size);
+        min_rows_ = std::min(std::max<size_t>(1, config.min_batch_rows), max_rows_);
+        max_bytes_ = config.max_batch_bytes;
+        linger_ = std::chrono::milliseconds(config.max_linger_ms);
+        min_interval_ = std::chrono::milliseconds(config.min_insert_interval_ms);
+        adaptive_ = config.adaptive_batching;
+        target_rows_ = adaptive_ ? std::clamp(target_rows_, min_rows_, max_rows_) : max_rows_;
+    }
+
+    size_t target_rows() const { return target_rows_; }
+
+    /**
+     * Rows that can still be added before the row target, or the byte cap
+     * at the average row size so far, is reached
+     * Without a size seen yet only a few rows are let in, which give one.
+     * Rows vary in size, so a batch can still end slightly past the cap.
+     */
+    size_t room(size_t rows, size_t bytes) const {
+        const size_t left = rows >= target_rows_ ? 0 : target_rows_ - rows;
+        if (max_bytes_ == 0 || left == 0) return left;
+        if (bytes >= max_bytes_) return 0;
+        const size_t row_bytes = rows > 0 && bytes > 0 ? bytes / rows : row_bytes_;
+        if (row_bytes == 0) return std::min(left, kProbeRows);
+        return std::min(left, std::max<size_t>(1, (max_bytes_ - bytes) / row_bytes));
+    }
+
+    /**
+     * Record the batch's current row count; starts the linger clock on the first row
+     */
+    void note_rows(size_t rows, Clock::time_point now) {
+        if (rows > 0 && !has_rows_) {
+            has_rows_ = true;
+            batch_started_ = now;
+        }
+    }
+
+    bool should_flush(size_t rows, size_t bytes, Clock::time_point now) const {
+        if (rows == 0) return false;
+        if (rows >= target_rows_) return true;
+        if (max_bytes_ > 0 && bytes >= max_bytes_) return true;
+        return now - batch_started_ >= linger_;
+    }
+
+    // Time until the linger deadline of the current batch (zero if none/elapsed)
+    Clock::duration time_to_deadline(Clock::time_point now) const {
+        if (!has_rows_) return linger_;
+        auto deadline = batch_started_ + linger_;
+        return deadline > now ? deadline - now : Clock::duration::zero();
+    }
+
+    /**
+     * The current batch was handed off; the next row restarts the linger clock
+     * Its average row size seeds room() for the next batch.
+     */
+    void on_submit(size_t rows, size_t bytes) {
+        has_rows_ = false;
+        if (rows > 0 && bytes > 0) row_bytes_ = bytes / rows;
+    }
+
+    /**
+     * Feed back a finished insert and recompute the row target
+     * With pipelined inserts this arrives after later batches have started.
+     */
+    void on_flush(size_t rows, Clock::duration insert_latency, Clock::time_point now) {
+        double window = std::chrono::duration<double>(now - last_flush_).count();
+        last_flush_ = now;
+        if (!adaptive_ || window <= 0.0) return;
+
+        double latency = std::chrono::duration<double>(insert_latency).count();
+        rate_ = ewma(rate_, rows / window);
+        latency_ = ewma(latency_, latency);
+
+        double interval = std::max(std::chrono::duration<double>(min_interval_).count(),
+                                   2.0 * latency_);
+        double target = rate_ * interval;
+        target_rows_ = std::clamp(static_cast<size_t>(target), min_rows_, max_rows_);
+    }
+
+    double rate() const { return rate_; }
+    double insert_latency() const { return latency_; }
+
+private:
+    static constexpr size_t kProbeRows = 64;
+
+    static double ewma(double current, double sample) {
+        constexpr double kAlpha = 0.3;
+        return current == 0.0 ? sample : current + kAlpha * (sample - current);
+    }
+
+    size_t max_rows_;
+    size_t min_rows_;
+    size_t max_bytes_;
+    Clock::duration linger_;
+    Clock::duration min_interval_;
+    bool adaptive_;
+
+    size_t target_rows_;
+    bool has_rows_ = false;
+    Clock::time_point batch_started_;
+    Clock::time_point last_flush_;
+    size_t row_bytes_ = 0;          // Average row size of the last batch
+
+    // Observed, smoothed: incoming rows/sec and insert latency in seconds
+    double rate_ = 0.0;
+    double latency_ = 0.0;
+};
+
+} // namespace ingester
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace ingester {
+
+namespace hash_detail {
+
+inline constexpr uint64_t kSecret0 = 0xa0761d6478bd642fULL;
+inline constexpr uint64_t kSecret1 = 0xe7037ed1a0b428dbULL;
+inline constexpr uint64_t kSecret2 = 0x8ebc6af09c88c6e3ULL;
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    const __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read_tail(const unsigned char* p, size_t len) {
+    // 1..7 bytes, little-endian into the low bytes
+    uint64_t v = 0;
+    std::memcpy(&v, p, len);
+    return v;
+}
+
+} // namespace hash_detail
+
+/**
+ * Fast non-cryptographic 64-bit hash for in-process tables
+ *
+ * Same construction as xxh3/wyhash for short keys: 8-byte words are folded
+ * with 64x64->128 multiplies, so a 100-byte message costs ~13 multiplies
+ * instead of 100 dependent FNV steps. Not stable across versions - never
+ * persist these values.
+ */
+inline uint64_t hash_bytes(const void* data, size_t len, uint64_t seed = 0) {
+    using namespace hash_detail;
+    const auto* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ mix(seed ^ kSecret0, len ^ kSecret1);
+    while (len >= 16) {
+        h = mix(read64(p) ^ kSecret1, read64(p + 8) ^ h);
+        p += 16;
+        len -= 16;
+    }
+    if (len >= 8) {
+        h = mix(read64(p) ^ kSecret2, h ^ kSecret0);
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) h = mix(read_tail(p, len) ^ kSecret1, h ^ kSecret2);
+    return mix(h ^ kSecret0, h ^ kSecret2);
+}
+
+inline uint64_t hash_bytes(std::string_view value, uint64_t seed = 0) {
+    return hash_bytes(value.data(), value.size(), seed);
+}
+
+// Order-dependent combination of field hashes
+inline uint64_t hash_combine(uint64_t h, uint64_t value) {
+    return hash_detail::mix(h ^ hash_detail::kSecret2, value ^ hash_detail::kSecret1);
+}
+
+} // namespace ingester
@@ -0,0 +1,118 @@
+#include "insert_pipeline.h"
+#include <algorithm>
+
+namespace ingester {
+
+InsertPipeline::InsertPipeline(size_t depth, InsertFn insert, Parker* wake)
+    : insert_(std::move(insert))
+    , wake_(wake)
+{
+    depth = std::max<size_t>(1, depth);
+    for (size_t i = 0; i < depth + 1; ++i) {
+        slots_.push_back(std::make_unique<ColumnarBatch>());
+        free_.push_back(slots_.back().get());
+    }
+    for (size_t lane = 0; lane < depth; ++lane) {
+        lanes_.emplace_back(&InsertPipeline::lane_thread, this, lane);
+    }
+}
+
+InsertPipeline::~InsertPipeline() {
+    // Lanes finish what was submitted before exiting
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : lanes_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+ColumnarBatch* InsertPipeline::try_acquire() {
+    if (free_.empty()) return nullptr;
+    ColumnarBatch* batch = free_.back();
+    free_.pop_back();
+    return batch;
+}
+
+void InsertPipeline::submit(ColumnarBatch* batch) {
+    in_flight_.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        work_.push_back(batch);
+        submitted_.push_back(batch);
+    }
+    work_cv_.notify_one();
+}
+
+size_t InsertPipeline::releasable() const {
+    size_t n = 0;
+    for (ColumnarBatch* batch : submitted_) {
+        auto done = std::find_if(completed_.begin(), completed_.end(),
+                                 [batch](const Completion& c) { return c.batch == batch; });
+        if (done == completed_.end()) break;
+        ++n;
+    }
+    return n;
+}
+
+bool InsertPipeline::take_locked(Completion& out) {
+    if (submitted_.empty()) return false;
+    auto done = std::find_if(completed_.begin(), completed_.end(),
+                             [this](const Completion& c) { return c.batch == submitted_.front(); });
+    if (done == completed_.end()) return false;
+    out = *done;
+    completed_.erase(done);
+    submitted_.pop_front();
+    completed_count_.store(releasable(), std::memory_order_release);
+    return true;
+}
+
+bool InsertPipeline::poll(Completion& out) {
+    if (!has_completions()) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return take_locked(out);
+}
+
+bool InsertPipeline::wait(Completion& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return completed_count_.load() > 0 || in_flight_.load() == 0; });
+    return take_locked(out);
+}
+
+void InsertPipeline::recycle(ColumnarBatch* batch) {
+    batch->clear();
+    free_.push_back(batch);
+}
+
+void InsertPipeline::lane_thread(size_t lane) {
+    while (true) {
+        ColumnarBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this] { return !work_.empty() || stopping_; });
+            if (work_.empty()) return;  // Stopping and drained
+            batch = work_.front();
+            work_.pop_front();
+        }
+
+        Completion done;
+        done.batch = batch;
+        auto started = Clock::now();
+        done.written = insert_(*batch, lane);
+        done.finished = Clock::now();
+        done.latency = done.finished - started;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            completed_.push_back(done);
+            completed_count_.store(releasable(), std::memory_order_release);
+            in_flight_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        done_cv_.notify_all();
+        if (wake_) wake_->notify();
+    }
+}
+
+} // namespace ingester
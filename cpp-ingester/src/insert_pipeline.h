@@ -0,0 +1,100 @@
+#pragma once
+
+#include "column_batch.h"
+#include "wait_strategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Overlapped inserts for one writer thread
+ *
+ * The writer keeps filling the next ColumnarBatch while up to `depth`
+ * finished ones are compressed and sent by insert lanes, each with its own
+ * ClickHouse connection. Batch objects rotate through a fixed pool of
+ * depth + 1, so a writer that outruns the lanes blocks instead of growing.
+ *
+ * Results come back to the writer thread (poll/wait), which keeps the flush
+ * policy and the ACK hand-off single-threaded. They come back in submit
+ * order even when lanes finish out of order: a stream entry whose rows
+ * span two batches is only ACKed after the earlier one, and a failed batch
+ * is seen before anything submitted after it.
+ */
+class InsertPipeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Insert `batch` on connection `lane`; true once written
+    using InsertFn = std::function<bool(const ColumnarBatch& batch, size_t lane)>;
+
+    struct Completion {
+        ColumnarBatch* batch = nullptr;
+        bool written = false;
+        Clock::duration latency{};
+        Clock::time_point finished;
+    };
+
+    /**
+     * `wake` is notified whenever a completion is ready (the writer's parker)
+     */
+    InsertPipeline(size_t depth, InsertFn insert, Parker* wake);
+    ~InsertPipeline();
+
+    InsertPipeline(const InsertPipeline&) = delete;
+    InsertPipeline& operator=(const InsertPipeline&) = delete;
+
+    /**
+     * A cleared batch to fill, or nullptr until a completion is recycled
+     */
+    ColumnarBatch* try_acquire();
+
+    /**
+     * Queue a filled batch for the next free lane
+     */
+    void submit(ColumnarBatch* batch);
+
+    /**
+     * Take the oldest submitted insert once it finished; wait() blocks
+     * while any is in flight. Hand the batch back with recycle() once its
+     * results are consumed.
+     */
+    bool poll(Completion& out);
+    bool wait(Completion& out);
+    void recycle(ColumnarBatch* batch);
+
+    bool has_completions() const { return completed_count_.load(std::memory_order_acquire) > 0; }
+    size_t in_flight() const { return in_flight_.load(std::memory_order_acquire); }
+    size_t depth() const { return lanes_.size(); }
+
+private:
+    void lane_thread(size_t lane);
+    size_t releasable() const;  // Finished inserts at the head of submitted_; mutex_ held
+    bool take_locked(Completion& out);
+
+    InsertFn insert_;
+    Parker* wake_;
+    std::vector<std::unique_ptr<ColumnarBatch>> slots_;
+    std::vector<ColumnarBatch*> free_;      // Writer thread only
+    std::vector<std::thread> lanes_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<ColumnarBatch*> work_;
+    std::deque<ColumnarBatch*> submitted_;  // In submit order, until taken
+    std::vector<Completion> completed_;     // In finish order
+    std::atomic<size_t> completed_count_{0};    // releasable()
+    std::atomic<size_t> in_flight_{0};
+    bool stopping_ = false;
+};
+
+} // namespace ingester
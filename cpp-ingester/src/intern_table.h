@@ -0,0 +1,102 @@
+#pragma once
+
+#include "hash.h"
+#include "log_entry.h"
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Per-reader intern table for low-cardinality fields (app_id, source, environment)
+ *
+ * Optimizations:
+ * - Flat open addressing over 64-bit hashes, one probe for a hit in practice
+ * - Each distinct value is copied once into append-only chunks, so entries
+ *   reference it instead of taking an arena copy per row
+ * - Symbols are dense and stable for the reader's lifetime; the writer
+ *   maps (reader, symbol) straight to its LowCardinality dictionary index
+ *   without hashing the string again
+ *
+ * Only the reader thread interns. Writers read the interned bytes through
+ * the entries' views: chunks never move or get freed while the reader
+ * exists, and the ring publish orders the copy before the read.
+ */
+class InternTable {
+public:
+    static constexpr size_t kMaxSymbols = kNoSymbol; // Beyond this, values are not interned
+    static constexpr size_t kMaxLength = 256;         // Longer values are not low-cardinality
+    static constexpr size_t kChunkBytes = 64 << 10;
+
+    struct Interned {
+        std::string_view value;     // Empty with kNoSymbol: keep your own copy
+        Symbol symbol = kNoSymbol;
+    };
+
+    InternTable() : slots_(1024) {}
+
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+
+    Interned intern(std::string_view value) {
+        if (value.size() > kMaxLength) return {};
+        const uint64_t hash = hash_bytes(value);
+        const size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        for (; slots_[i].symbol_plus_one != 0; i = (i + 1) & mask) {
+            const Slot& slot = slots_[i];
+            if (slot.hash == hash && values_[slot.symbol_plus_one - 1] == value) {
+                return {values_[slot.symbol_plus_one - 1], static_cast<Symbol>(slot.symbol_plus_one - 1)};
+            }
+        }
+        if (values_.size() >= kMaxSymbols) return {};
+
+        const Symbol symbol = static_cast<Symbol>(values_.size());
+        values_.push_back(store(value));
+        slots_[i] = Slot{hash, static_cast<Symbol>(symbol + 1)};
+        if (values_.size() * 2 > slots_.size()) grow();
+        return {values_.back(), symbol};
+    }
+
+    size_t size() const { return values_.size(); }
+
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        Symbol symbol_plus_one = 0;     // 0 = empty
+    };
+
+    std::string_view store(std::string_view value) {
+        if (value.empty()) return {};
+        if (chunks_.empty() || chunk_used_ + value.size() > kChunkBytes) {
+            chunks_.push_back(std::make_unique<char[]>(kChunkBytes));
+            chunk_used_ = 0;
+        }
+        char* dst = chunks_.back().get() + chunk_used_;
+        std::memcpy(dst, value.data(), value.size());
+        chunk_used_ += value.size();
+        return {dst, value.size()};
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        old.swap(slots_);
+        const size_t mask = slots_.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.symbol_plus_one == 0) continue;
+            size_t i = slot.hash & mask;
+            while (slots_[i].symbol_plus_one != 0) i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    std::vector<std::string_view> values_;          // By symbol
+    std::vector<std::unique_ptr<char[]>> chunks_;   // Moving the pointers keeps the bytes in place
+    size_t chunk_used_ = 0;
+};
+
+} // namespace ingester
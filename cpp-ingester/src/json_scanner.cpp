@@ -0,0 +1,334 @@
+#include "json_scanner.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace ingester {
+
+namespace {
+
+inline bool is_ws(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char* skip_ws(const char* p, const char* end) {
+    while (p < end && is_ws(*p)) ++p;
+    return p;
+}
+
+/**
+ * Find the first '"' or '\\' in [p, end). Returns end if none.
+ * This is the only per-byte loop on the hot path, so it is vectorized.
+ */
+inline const char* find_quote_or_backslash(const char* p, const char* end) {
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t slash = vdupq_n_u8('\\');
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t hit = vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, slash));
+        // Narrow to 4 bits per byte to get a scalar mask
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+        if (mask) return p + (__builtin_ctzll(mask) >> 2);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') ++p;
+    return p;
+}
+
+/**
+ * Scan a string body; `p` points just past the opening quote.
+ * Returns a pointer past the closing quote, or nullptr if unterminated.
+ */
+inline const char* scan_string(const char* p, const char* end, JsonSlice& slice) {
+    slice.data = p;
+    slice.escaped = false;
+    while (true) {
+        p = find_quote_or_backslash(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') {
+            slice.len = static_cast<size_t>(p - slice.data);
+            return p + 1;
+        }
+        // Backslash: the next byte is escaped, whatever it is; a trailing
+        // backslash is malformed
+        slice.escaped = true;
+        if (end - p < 2) return nullptr;
+        p += 2;
+    }
+}
+
+/**
+ * Skip any JSON value; `p` points at its first byte.
+ * Returns a pointer past the value, or nullptr on malformed input.
+ */
+const char* skip_value(const char* p, const char* end) {
+    JsonSlice ignored;
+    if (*p == '"') return scan_string(p + 1, end, ignored);
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                p = scan_string(p + 1, end, ignored);
+                if (!p) return nullptr;
+                continue;
+            }
+            if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            ++p;
+        }
+        return nullptr;
+    }
+
+    // Scalar literal: number, true, false, null
+    const char* start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_ws(*p)) ++p;
+    return p == start ? nullptr : p;
+}
+
+inline JsonSlice* field_for_key(const char* k, size_t n, LogFieldSlices& out) {
+    switch (n) {
+        case 5:
+            if (std::memcmp(k, "appId", 5) == 0) return &out.app_id;
+            if (std::memcmp(k, "level", 5) == 0) return &out.level;
+            break;
+        case 6:
+            if (std::memcmp(k, "source", 6) == 0) return &out.source;
+            if (std::memcmp(k, "userId", 6) == 0) return &out.user_id;
+            break;
+        case 7:
+            if (std::memcmp(k, "message", 7) == 0) return &out.message;
+            if (std::memcmp(k, "traceId", 7) == 0) return &out.trace_id;
+            break;
+        case 11:
+            if (std::memcmp(k, "environment", 11) == 0) return &out.environment;
+            break;
+        case 14:
+            if (std::memcmp(k, "metadataString", 14) == 0) return &out.metadata;
+            break;
+    }
+    return nullptr;
+}
+
+constexpr int kFieldCount = 8;
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+inline bool parse_hex4(const char* p, const char* end, uint32_t& out) {
+    if (end - p < 4) return false;
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+        int v = hex_value(p[i]);
+        if (v < 0) return false;
+        out = (out << 4) | static_cast<uint32_t>(v);
+    }
+    return true;
+}
+
+inline char* write_utf8(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        *out++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (cp >> 6));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (cp >> 12));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (cp >> 18));
+        *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return out;
+}
+
+} // namespace
+
+bool scan_log_fields(const char* json, size_t len, LogFieldSlices& out) {
+    const char* p = json;
+    const char* end = json + len;
+
+    p = skip_ws(p, end);
+    if (p == end || *p != '{') return false;
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}') return true;
+
+    int found = 0;
+    while (p < end) {
+        // Key
+        if (*p != '"') return false;
+        JsonSlice key;
+        p = scan_string(p + 1, end, key);
+        if (!p) return false;
+
+        p = skip_ws(p, end);
+        if (p == end || *p != ':') return false;
+        p = skip_ws(p + 1, end);
+        if (p == end) return false;
+
+        // Value
+        JsonSlice* target = key.escaped ? nullptr : field_for_key(key.data, key.len, out);
+        if (target && *p == '"') {
+            if (!target->present) ++found;
+            p = scan_string(p + 1, end, *target);
+            if (!p) return false;
+            target->present = true;
+            // Every wanted key seen: the rest of the object is irrelevant
+            if (found == kFieldCount) return true;
+        } else {
+            p = skip_value(p, end);
+            if (!p) return false;
+        }
+
+        p = skip_ws(p, end);
+        if (p == end) return false;
+        if (*p == '}') return true;
+        if (*p != ',') return false;
+        p = skip_ws(p + 1, end);
+    }
+    return false;
+}
+
+bool unescape_json(const JsonSlice& slice, char* out, size_t& out_len) {
+    if (!slice.escaped) {
+        std::memcpy(out, slice.data, slice.len);
+        out_len = slice.len;
+        return true;
+    }
+
+    const char* p = slice.data;
+    const char* end = slice.data + slice.len;
+    char* w = out;
+
+    while (p < end) {
+        const char* bs = static_cast<const char*>(std::memchr(p, '\\', end - p));
+        if (!bs) {
+            std::memcpy(w, p, end - p);
+            w += end - p;
+            break;
+        }
+        std::memcpy(w, p, bs - p);
+        w += bs - p;
+        p = bs + 1;
+        if (p == end) return false;
+
+        switch (*p++) {
+            case '"':  *w++ = '"';  break;
+            case '\\': *w++ = '\\'; break;
+            case '/':  *w++ = '/';  break;
+            case 'b':  *w++ = '\b'; break;
+            case 'f':  *w++ = '\f'; break;
+            case 'n':  *w++ = '\n'; break;
+            case 'r':  *w++ = '\r'; break;
+            case 't':  *w++ = '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!parse_hex4(p, end, cp)) return false;
+                p += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    // High surrogate: combine with a following low surrogate
+                    uint32_t lo;
+                    if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                        parse_hex4(p + 2, end, lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        p += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;  // Lone low surrogate
+                }
+                w = write_utf8(cp, w);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    out_len = static_cast<size_t>(w - out);
+    return true;
+}
+
+// Control characters, quote and backslash need escaping; everything else
+// (including UTF-8 sequences) is copied as is
+static size_t escape_width(unsigned char c) {
+    if (c == '"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') return 2;
+    return c < 0x20 ? 6 : 1;
+}
+
+size_t escaped_json_length(const char* text, size_t len) {
+    size_t out = 0;
+    for (size_t i = 0; i < len; ++i) {
+        out += escape_width(static_cast<unsigned char>(text[i]));
+    }
+    return out;
+}
+
+char* escape_json(const char* text, size_t len, char* out) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        switch (c) {
+            case '"': *out++ = '\\'; *out++ = '"'; break;
+            case '\\': *out++ = '\\'; *out++ = '\\'; break;
+            case '\b': *out++ = '\\'; *out++ = 'b'; break;
+            case '\f': *out++ = '\\'; *out++ = 'f'; break;
+            case '\n': *out++ = '\\'; *out++ = 'n'; break;
+            case '\r': *out++ = '\\'; *out++ = 'r'; break;
+            case '\t': *out++ = '\\'; *out++ = 't'; break;
+            default:
+                if (c < 0x20) {
+                    *out++ = '\\'; *out++ = 'u'; *out++ = '0'; *out++ = '0';
+                    *out++ = kHex[c >> 4];
+                    *out++ = kHex[c & 0xf];
+                } else {
+                    *out++ = static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+} // namespace ingester
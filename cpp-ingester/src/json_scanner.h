@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ingester {
+
+/**
+ * Raw slice of a JSON string value inside the scanned payload
+ *
+ * `data`/`len` point between the quotes. `escaped` is set when the
+ * slice contains backslash escapes and must be run through
+ * `unescape_json` before use.
+ */
+struct JsonSlice {
+    const char* data = nullptr;
+    size_t len = 0;
+    bool escaped = false;
+    bool present = false;
+};
+
+/**
+ * The eight top-level keys the ingester reads from the `data` field
+ */
+struct LogFieldSlices {
+    JsonSlice app_id;          // "appId"
+    JsonSlice message;         // "message"
+    JsonSlice source;          // "source"
+    JsonSlice level;           // "level"
+    JsonSlice environment;     // "environment"
+    JsonSlice metadata;        // "metadataString"
+    JsonSlice trace_id;        // "traceId"
+    JsonSlice user_id;         // "userId"
+};
+
+/**
+ * Single-pass JSON field scanner for log payloads
+ *
+ * Optimizations:
+ * - One walk over the object, all keys extracted on the way
+ * - AVX2 / SSE2 / NEON search for string terminators (scalar fallback)
+ * - No allocation: results are slices into the input
+ * - Nested objects/arrays (e.g. `metadata`) are skipped, not parsed
+ *
+ * Returns false on malformed input. Keys not present keep
+ * `present == false`; JSON `null` values are reported as absent.
+ */
+bool scan_log_fields(const char* json, size_t len, LogFieldSlices& out);
+
+/**
+ * Write the decoded form of `slice` to `out` and return its length
+ * `out` must hold at least `slice.len` bytes; decoding never grows the text.
+ * Handles the standard escapes plus \uXXXX (including surrogate pairs).
+ * Returns false on an invalid escape sequence.
+ */
+bool unescape_json(const JsonSlice& slice, char* out, size_t& out_len);
+
+/**
+ * Length of `text` once escaped for a JSON string (without quotes)
+ */
+size_t escaped_json_length(const char* text, size_t len);
+
+/**
+ * Write `text` escaped for a JSON string (without quotes) and return the
+ * end of the output. `out` must hold `escaped_json_length(text, len)` bytes.
+ */
+char* escape_json(const char* text, size_t len, char* out);
+
+} // namespace ingester
@@ -1,30 +1,91 @@
 #pragma once
 
-#include <string>
+#include "batch_arena.h"
+#include "uuid.h"
+
+#include <string_view>
+#include <vector>
 #include <cstdint>
 
 namespace ingester {
 
+// Names of the ClickHouse level Enum8, indexed by enum value - 1
+inline constexpr std::string_view kLogLevels[] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+constexpr int8_t kLevelInfo = 2;
+
+// Per-reader ID of an interned low-cardinality value (intern_table.h)
+using Symbol = uint16_t;
+constexpr Symbol kNoSymbol = ~Symbol{0};
+
 /**
  * Log entry structure matching the logs table schema
+ *
+ * Fields are views into the owning BatchArena (or into static defaults),
+ * so entries are trivially movable and carry no heap allocations of their own.
  */
 struct LogEntry {
-    std::string app_id;
-    std::string message;
-    std::string source;
-    std::string level;
-    std::string environment;
-    std::string metadata;      // JSON string
-    std::string trace_id;
-    std::string user_id;
-    std::string redis_id;      // For ACK tracking
-    
+    Uuid id;                        // UUIDv7 unless the producer sent one
+    int64_t timestamp_ms = 0;       // Event time (Unix ms)
+    std::string_view app_id;
+    std::string_view message;
+    std::string_view source;
+    std::string_view environment;
+    std::string_view metadata;      // JSON string
+    std::string_view trace_id;      // Empty = NULL
+    std::string_view user_id;
+    std::string_view redis_id;      // For ACK tracking; only on the last entry of a pb batch
+
+    BatchArena* arena = nullptr;    // Owns the bytes above; nullptr = static
+    uint16_t reader_id = 0;         // RedisConsumer that read it (routes the ACK)
+    int8_t level = kLevelInfo;      // Enum8 value ('DEBUG' = 1 ... 'FATAL' = 5)
+
+    // Symbols of the interned fields in the reader's table; their views
+    // then point into that table, not the arena. With level and reader_id
+    // they fit in what would otherwise be tail padding.
+    Symbol app_id_symbol = kNoSymbol;
+    Symbol source_symbol = kNoSymbol;
+    Symbol environment_symbol = kNoSymbol;
+
     // Pre-calculated for RowBinary serialization
     size_t estimated_size() const {
-        return app_id.size() + message.size() + source.size() + 
-               level.size() + environment.size() + metadata.size() +
+        return app_id.size() + message.size() + source.size() +
+               environment.size() + metadata.size() +
                trace_id.size() + user_id.size() + 64; // overhead
     }
 };
 
+// Ring slots are LogEntry-sized: keep the small fields packed at the end
+static_assert(sizeof(void*) != 8 || sizeof(LogEntry) <= 176, "LogEntry grew past its ring slot size");
+
+// Stream IDs are "<unix ms>-<seq>": the time Redis accepted the entry
+inline int64_t stream_id_millis(const char* id, size_t len) {
+    int64_t ms = 0;
+    for (size_t i = 0; i < len && id[i] >= '0' && id[i] <= '9'; ++i) {
+        ms = ms * 10 + (id[i] - '0');
+    }
+    return ms;
+}
+
+/**
+ * Drop the arena refs held by a run of entries
+ * Consecutive entries usually share an arena, so refs are released per run.
+ */
+inline void release_arenas(const LogEntry* entries, size_t count) {
+    BatchArena* run = nullptr;
+    size_t run_len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (entries[i].arena != run) {
+            if (run) run->release(run_len);
+            run = entries[i].arena;
+            run_len = 0;
+        }
+        ++run_len;
+    }
+    if (run) run->release(run_len);
+}
+
+inline void release_arenas(const std::vector<LogEntry>& batch) {
+    release_arenas(batch.data(), batch.size());
+}
+
 } // namespace ingester
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+
+namespace ingester {
+
+/**
+ * Native wire encodings the writer produces
+ */
+enum class ColumnType {
+    kString,                // String
+    kLowCardinalityString,  // LowCardinality(String)
+    kNullableString,        // Nullable(String)
+    kLevelEnum8,            // Enum8('DEBUG' = 1, ... 'FATAL' = 5)
+    kDateTime64Ms,          // DateTime64(3)
+    kUuid,                  // UUID
+};
+
+struct ColumnSpec {
+    const char* name;
+    ColumnType type;
+};
+
+/**
+ * Compile-time description of the logs table (init-clickhouse.sql)
+ *
+ * ColumnarBatch derives its column buffers from this list, so a column
+ * whose type changes here no longer compiles with a mismatched value.
+ */
+enum LogColumn {
+    kId,
+    kAppId,
+    kTimestamp,
+    kLevel,
+    kMessage,
+    kSource,
+    kEnvironment,
+    kMetadata,
+    kTraceId,
+    kUserId,
+    kLogColumnCount
+};
+
+inline constexpr ColumnSpec kLogSchema[] = {
+    {"id",          ColumnType::kUuid},
+    {"app_id",      ColumnType::kLowCardinalityString},
+    {"timestamp",   ColumnType::kDateTime64Ms},
+    {"level",       ColumnType::kLevelEnum8},
+    {"message",     ColumnType::kString},
+    {"source",      ColumnType::kLowCardinalityString},
+    {"environment", ColumnType::kLowCardinalityString},
+    {"metadata",    ColumnType::kString},
+    {"trace_id",    ColumnType::kNullableString},
+    {"user_id",     ColumnType::kString},
+};
+
+static_assert(std::size(kLogSchema) == kLogColumnCount, "kLogSchema and LogColumn out of sync");
+
+} // namespace ingester
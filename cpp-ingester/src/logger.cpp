@@ -0,0 +1,227 @@
+#include "logger.h"
+#include "batch_queue.h"
+#include "json_scanner.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+
+namespace ingester {
+
+namespace {
+
+constexpr size_t kQueueCapacity = 8192;     // Records (~2 MB)
+constexpr size_t kDrainRun = 256;           // Records per write(2)
+// Widest line: escaped text (6x for \u00XX) plus timestamp, level, component, JSON keys
+constexpr size_t kMaxLine = LogRecord::kMaxText * 6 + 192;
+
+constexpr const char* kLevelNames[] = {"debug", "info", "warn", "error"};
+constexpr const char* kLevelTags[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+int64_t now_unix_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void write_fd(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+// 2026-01-01T00:00:00.000000Z
+char* format_time(int64_t unix_us, char* out) {
+    time_t secs = static_cast<time_t>(unix_us / 1000000);
+    tm utc;
+    gmtime_r(&secs, &utc);
+    size_t n = std::strftime(out, 32, "%Y-%m-%dT%H:%M:%S", &utc);
+    n += static_cast<size_t>(std::snprintf(out + n, 16, ".%06lldZ", static_cast<long long>(unix_us % 1000000)));
+    return out + n;
+}
+
+char* put(char* out, std::string_view text) {
+    std::memcpy(out, text.data(), text.size());
+    return out + text.size();
+}
+
+} // namespace
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+Logger::Logger() : queue_(std::make_unique<MpmcQueue<LogRecord>>(kQueueCapacity)) {}
+
+Logger::~Logger() {
+    stop();
+}
+
+bool Logger::parse_level(std::string_view name, LogLevel& out) {
+    for (size_t i = 0; i < std::size(kLevelNames); ++i) {
+        if (name == kLevelNames[i]) {
+            out = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::start(LogLevel level, Format format) {
+    level_.store(level);
+    format_ = format;
+    if (running_.exchange(true)) return;
+    thread_ = std::thread(&Logger::sink_thread, this);
+}
+
+void Logger::stop() {
+    if (!running_.exchange(false)) return;
+    parker_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void Logger::submit(const LogRecord& record) {
+    if (!running_.load(std::memory_order_acquire)) {
+        // No sink (startup, shutdown): write inline
+        write_out(&record, 1);
+        return;
+    }
+    if (!queue_->try_push(record)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    parker_.notify();
+}
+
+void Logger::format(const LogRecord& record, char*& out, char* end) const {
+    char* w = out;
+    const size_t level = static_cast<size_t>(record.level);
+    if (format_ == Format::kJson) {
+        w = put(w, "{\"ts\":\"");
+        w = format_time(record.unix_us, w);
+        w = put(w, "\",\"level\":\"");
+        w = put(w, kLevelNames[level]);
+        w = put(w, "\",\"component\":\"");
+        w = escape_json(record.component, std::strlen(record.component), w);
+        w = put(w, "\",\"msg\":\"");
+        w = escape_json(record.text, record.len, w);
+        w = put(w, "\"");
+        if (record.suppressed > 0) {
+            w = put(w, ",\"suppressed\":");
+            w = std::to_chars(w, end, record.suppressed).ptr;
+        }
+        w = put(w, "}\n");
+    } else {
+        w = format_time(record.unix_us, w);
+        *w++ = ' ';
+        w = put(w, kLevelTags[level]);
+        *w++ = ' ';
+        w = put(w, record.component);
+        w = put(w, ": ");
+        w = put(w, std::string_view(record.text, record.len));
+        if (record.suppressed > 0) {
+            w = put(w, " (");
+            w = std::to_chars(w, end, record.suppressed).ptr;
+            w = put(w, " similar suppressed)");
+        }
+        *w++ = '\n';
+    }
+    out = w;
+}
+
+void Logger::write_out(const LogRecord* records, size_t count) {
+    // Warnings and errors go to stderr, the rest to stdout, as before.
+    // Buffers grow to the largest run this thread wrote and are reused.
+    thread_local std::vector<char> out_buf;
+    thread_local std::vector<char> err_buf;
+    if (out_buf.size() < kMaxLine * count) {
+        out_buf.resize(kMaxLine * count);
+        err_buf.resize(kMaxLine * count);
+    }
+    char* out = out_buf.data();
+    char* err = err_buf.data();
+    for (size_t i = 0; i < count; ++i) {
+        if (records[i].level >= LogLevel::kWarn) {
+            format(records[i], err, err_buf.data() + err_buf.size());
+        } else {
+            format(records[i], out, out_buf.data() + out_buf.size());
+        }
+    }
+    if (out != out_buf.data()) write_fd(STDOUT_FILENO, out_buf.data(), static_cast<size_t>(out - out_buf.data()));
+    if (err != err_buf.data()) write_fd(STDERR_FILENO, err_buf.data(), static_cast<size_t>(err - err_buf.data()));
+}
+
+void Logger::sink_thread() {
+    std::unique_ptr<LogRecord[]> run(new LogRecord[kDrainRun]);
+    uint64_t reported_drops = 0;
+    while (true) {
+        size_t n = 0;
+        while (n < kDrainRun && queue_->try_pop(run[n])) ++n;
+        if (n > 0) {
+            write_out(run.get(), n);
+            continue;
+        }
+
+        const uint64_t drops = dropped();
+        if (drops != reported_drops) {
+            LogLine(LogLevel::kWarn, "logger") << "queue full, dropped " << (drops - reported_drops) << " lines";
+            reported_drops = drops;
+            continue;
+        }
+        if (!running_.load()) break;
+        parker_.park_unless([this] { return !queue_->empty() || !running_.load(); },
+                            std::chrono::milliseconds(100));
+    }
+}
+
+bool RateLimit::allow() {
+    const int64_t second = now_unix_us() / 1000000;
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        used_.store(0, std::memory_order_relaxed);
+    }
+    if (used_.fetch_add(1, std::memory_order_relaxed) < per_second_) return true;
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LogLine::LogLine(LogLevel level, const char* component, uint32_t suppressed) {
+    record_.unix_us = now_unix_us();
+    record_.level = level;
+    record_.component = component;
+    record_.suppressed = suppressed;
+}
+
+LogLine& LogLine::operator<<(std::string_view text) {
+    const size_t n = std::min(text.size(), LogRecord::kMaxText - record_.len);
+    std::memcpy(record_.text + record_.len, text.data(), n);
+    record_.len = static_cast<uint16_t>(record_.len + n);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(double value) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.6g", value);
+    return *this << std::string_view(buf, static_cast<size_t>(n));
+}
+
+void LogLine::append_signed(int64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    *this << std::string_view(buf, static_cast<size_t>(result.ptr - buf));
+}
+
+void LogLine::append_unsigned(uint64_t value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    *this << std::string_view(buf, static_cast<size_t>(result.ptr - buf));
+}
+
+} // namespace ingester
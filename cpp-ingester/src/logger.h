@@ -0,0 +1,158 @@
+#pragma once
+
+#include "wait_strategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+namespace ingester {
+
+template<typename T> class MpmcQueue;
+
+enum class LogLevel : uint8_t { kDebug, kInfo, kWarn, kError };
+
+/**
+ * One formatted line on its way to the sink; fixed size, no heap
+ */
+struct LogRecord {
+    static constexpr size_t kMaxText = 240;
+
+    int64_t unix_us = 0;
+    LogLevel level = LogLevel::kInfo;
+    const char* component = "";         // String literal
+    uint32_t suppressed = 0;            // Lines dropped by the call site's rate limit
+    uint16_t len = 0;
+    char text[kMaxText];
+};
+
+/**
+ * Asynchronous structured logger
+ *
+ * Optimizations:
+ * - Call sites format into a fixed LogRecord on their own stack and push
+ *   it onto a lock-free MPMC queue: no iostream lock, no allocation
+ * - A full queue drops the line (counted) instead of blocking the caller
+ * - One sink thread writes text or JSON lines with a single write(2) per
+ *   drained run
+ * - Level check before any formatting; per-call-site rate limits
+ */
+class Logger {
+public:
+    enum class Format { kText, kJson };
+
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * Start the sink thread; lines logged before that are written inline
+     */
+    void start(LogLevel level, Format format);
+
+    /**
+     * Write everything queued and stop the sink thread
+     */
+    void stop();
+
+    bool enabled(LogLevel level) const { return level >= level_.load(std::memory_order_relaxed); }
+    void submit(const LogRecord& record);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static bool parse_level(std::string_view name, LogLevel& out);
+
+private:
+    void sink_thread();
+    void format(const LogRecord& record, char*& out, char* end) const;
+    void write_out(const LogRecord* records, size_t count);
+
+    std::unique_ptr<MpmcQueue<LogRecord>> queue_;
+    std::thread thread_;
+    Parker parker_;
+    std::atomic<bool> running_{false};
+    std::atomic<LogLevel> level_{LogLevel::kInfo};
+    Format format_ = Format::kText;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+Logger& logger();
+
+/**
+ * Token bucket for one call site: `per_second` lines, bursts of as many
+ */
+class RateLimit {
+public:
+    explicit RateLimit(uint32_t per_second) : per_second_(per_second) {}
+
+    bool allow();
+
+    // Lines refused since the last allowed one
+    uint32_t take_suppressed() { return suppressed_.exchange(0, std::memory_order_relaxed); }
+
+private:
+    const uint32_t per_second_;
+    std::atomic<int64_t> window_{0};        // Current second
+    std::atomic<uint32_t> used_{0};
+    std::atomic<uint32_t> suppressed_{0};
+};
+
+/**
+ * Builds one record with stream syntax and submits it when destroyed
+ * Output past LogRecord::kMaxText is truncated.
+ */
+class LogLine {
+public:
+    LogLine(LogLevel level, const char* component, uint32_t suppressed = 0);
+    ~LogLine() { logger().submit(record_); }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view text);
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text ? text : "(null)"); }
+    LogLine& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    LogLine& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+    LogLine& operator<<(double value);
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    LogLine& operator<<(T value) {
+        if constexpr (std::is_signed_v<T>) {
+            append_signed(static_cast<int64_t>(value));
+        } else {
+            append_unsigned(static_cast<uint64_t>(value));
+        }
+        return *this;
+    }
+
+private:
+    void append_signed(int64_t value);
+    void append_unsigned(uint64_t value);
+
+    LogRecord record_;
+};
+
+} // namespace ingester
+
+// Usage: LOG_INFO("writer") << "connected " << n;  Nothing is formatted below the level.
+#define INGESTER_LOG(level, component) \
+    if (!::ingester::logger().enabled(level)) {} else ::ingester::LogLine(level, component)
+
+// At most `per_second` lines per second from this call site; the next one
+// that gets through reports how many were suppressed
+#define INGESTER_LOG_EVERY(level, component, per_second) \
+    if (static ::ingester::RateLimit ingester_rate_limit_(per_second); \
+        !::ingester::logger().enabled(level) || !ingester_rate_limit_.allow()) {} \
+    else ::ingester::LogLine(level, component, ingester_rate_limit_.take_suppressed())
+
+#define LOG_DEBUG(component) INGESTER_LOG(::ingester::LogLevel::kDebug, component)
+#define LOG_INFO(component) INGESTER_LOG(::ingester::LogLevel::kInfo, component)
+#define LOG_WARN(component) INGESTER_LOG(::ingester::LogLevel::kWarn, component)
+#define LOG_ERROR(component) INGESTER_LOG(::ingester::LogLevel::kError, component)
@@ -1,28 +1,134 @@
 #include "config.h"
+#include "affinity.h"
 #include "redis_consumer.h"
 #include "clickhouse_writer.h"
+#include "ack_pipeline.h"
 #include "ring_buffer.h"
+#include "batch_queue.h"
+#include "memory_budget.h"
+#include "router.h"
+#include "split_acks.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "logger.h"
 
 #include <iostream>
+#include <cstdio>
 #include <chrono>
 #include <thread>
 #include <signal.h>
 #include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 using namespace ingester;
 
 // Global flag for signal handling
 std::atomic<bool> g_running{true};
+std::atomic<bool> g_reload{false};
 
 void signal_handler(int sig) {
     std::cout << "\nReceived signal " << sig << ", shutting down...\n";
     g_running.store(false);
 }
 
+// SIGHUP: the main loop re-reads CONFIG_FILE and the environment
+void reload_handler(int) {
+    g_reload.store(true);
+}
+
+/**
+ * --compression-bench: read --count entries of the stream (without the
+ * group, nothing is ACKed), build batches of BATCH_SIZE and report what
+ * each compression method puts on the wire per row
+ */
+int run_compression_bench(const Config& config) {
+    RedisConsumer consumer(config);
+    if (!consumer.connect()) {
+        LOG_ERROR("main") << "failed to connect to Redis";
+        return 1;
+    }
+    std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>> rings;
+    rings.push_back(std::make_unique<LockFreeRingBuffer<LogEntry>>(1 << 20));
+    
+    CompressionSample total;
+    ColumnarBatch batch;
+    auto add_batch = [&] {
+        CompressionSample sample = ClickHouseWriter::measure_compression(batch);
+        total.rows += sample.rows;
+        total.raw_bytes += sample.raw_bytes;
+        for (size_t m = 0; m < kCompressionCount; ++m) {
+            total.wire_bytes[m] += sample.wire_bytes[m];
+            total.cpu[m] += sample.cpu[m];
+        }
+        batch.clear();
+    };
+    
+    std::string cursor;
+    size_t read = 0;
+    while (read < config.benchmark_count) {
+        const std::string before = cursor;
+        read += consumer.read_range(cursor, std::min<size_t>(100, config.benchmark_count - read), rings);
+        while (auto entry = rings.front()->try_pop()) {
+            batch.append(*entry);
+            release_arenas(&*entry, 1);
+            if (batch.rows() >= config.batch_size) add_batch();
+        }
+        if (cursor == before) break;  // End of the stream
+    }
+    if (!batch.empty()) add_batch();
+    logger().stop();
+    
+    if (total.rows == 0) {
+        std::cerr << "No entries in " << config.stream_key << "\n";
+        return 1;
+    }
+    std::cout << "Compression on " << total.rows << " rows of " << config.stream_key
+              << " in batches of " << config.batch_size << "\n";
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-6s %12s %8s %16s", "method", "bytes/row", "ratio", "compress ns/row");
+    std::cout << line << "\n";
+    for (size_t m = 0; m < kCompressionCount; ++m) {
+        const double rows = static_cast<double>(total.rows);
+        std::snprintf(line, sizeof(line), "%-6s %12.1f %8.2f %16.1f", kCompressionNames[m],
+                      total.wire_bytes[m] / rows,
+                      static_cast<double>(total.raw_bytes) / std::max<size_t>(1, total.wire_bytes[m]),
+                      static_cast<double>(total.cpu[m].count()) / rows);
+        std::cout << line << "\n";
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    // Parse configuration
-    Config config = Config::from_env();
+    // Parse configuration; a CONFIG_FILE overrides the environment and is
+    // read again on SIGHUP
+    const char* config_file = std::getenv("CONFIG_FILE");
+    Config::EnvOverrides file_settings;
+    if (config_file && !Config::read_env_file(config_file, file_settings)) {
+        std::cerr << "Cannot read CONFIG_FILE " << config_file << "\n";
+        return 1;
+    }
+    Config config = Config::from_env(file_settings);
     config.parse_args(argc, argv);
+    std::string config_error;
+    if (!config.validate(config_error)) {
+        std::cerr << "Invalid configuration: " << config_error << "\n";
+        return 1;
+    }
+    
+    // Insert routes; route 0 takes whatever no other route matches
+    std::vector<RouteSpec> routes;
+    std::string route_error;
+    if (!parse_routes(config, routes, route_error)) {
+        std::cerr << "Invalid ROUTES or ClickHouse hosts: " << route_error << "\n";
+        return 1;
+    }
+    LogColumn shard_key = kAppId;
+    if (!parse_shard_key(config.shard_key, shard_key)) {
+        std::cerr << "Unknown SHARD_KEY '" << config.shard_key << "'\n";
+        return 1;
+    }
     
     std::cout << "===========================================\n";
     std::cout << " C++ ClickHouse Native Ingester\n";
@@ -30,90 +136,453 @@ int main(int argc, char** argv) {
     std::cout << "Redis: " << config.redis_host << ":" << config.redis_port << "\n";
     std::cout << "Stream: " << config.stream_key << " (group: " << config.group_name << ")\n";
     std::cout << "ClickHouse: " << config.clickhouse_host << ":" << config.clickhouse_native_port << "\n";
-    std::cout << "Writer threads: " << config.writer_threads << "\n";
+    if (!config.clickhouse_shards.empty()) {
+        std::cout << "Shards: " << config.clickhouse_shards << " (by " << config.shard_key << ")\n";
+    }
+    std::cout << "Reader threads: " << config.effective_reader_threads();
+    if (config.stream_shards > 0) std::cout << " (" << config.stream_shards << " stream shards)";
+    if (config.event_loop) std::cout << " on " << std::max(1, config.reader_threads) << " event loop thread(s)";
+    std::cout << "\n";
+    std::cout << "Writer threads: " << config.writer_threads;
+    if (config.writer_pool_size() > config.writer_threads) std::cout << " (up to " << config.writer_pool_size() << ")";
+    std::cout << "\n";
     std::cout << "Batch size: " << config.batch_size << "\n";
+    std::cout << "Dispatch: " << (config.shared_dispatch ? "shared queue" : "per-writer rings") << "\n";
+    for (size_t k = routes.size() > 1 ? 0 : 1; k < routes.size(); ++k) {
+        const Config& rc = routes[k].config;
+        std::cout << "Route " << routes[k].name << ": " << rc.clickhouse_table << " on " << rc.clickhouse_host
+                  << " (" << rc.writer_threads << " writers, batch " << rc.batch_size << ")\n";
+    }
     if (config.benchmark_mode) {
         std::cout << "Mode: BENCHMARK (" << config.benchmark_count << " logs)\n";
+    } else if (config.compression_bench) {
+        std::cout << "Mode: COMPRESSION BENCH (" << config.benchmark_count << " logs)\n";
+    }
+    std::cout << "===========================================\n\n" << std::flush;
+    
+    // From here on runtime messages go through the async logger
+    Logger::Format log_format = config.log_format == "json" ? Logger::Format::kJson : Logger::Format::kText;
+    LogLevel log_level = LogLevel::kInfo;
+    if (!Logger::parse_level(config.log_level, log_level)) {
+        std::cerr << "Unknown LOG_LEVEL '" << config.log_level << "', using info\n";
+    }
+    logger().start(log_level, log_format);
+    
+    if (config.compression_bench) return run_compression_bench(config);
+    
+    // Byte bound on parsed entries; deferring an app needs XAUTOCLAIM to
+    // hand its entries back later
+    if (config.memory_budget_mb > 0) {
+        const unsigned share = config.claim_min_idle_ms > 0 ? static_cast<unsigned>(config.app_budget_percent) : 100;
+        memory_budget().configure(config.memory_budget_mb << 20, share);
     }
-    std::cout << "===========================================\n\n";
     
     // Set up signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGHUP, reload_handler);
+    
+    const int reader_count = config.effective_reader_threads();
     
-    // Create components
-    std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>> buffers;
-    buffers.reserve(config.writer_threads);
-    for (int i = 0; i < config.writer_threads; ++i) {
-        buffers.push_back(std::make_unique<LockFreeRingBuffer<LogEntry>>(config.ring_buffer_size));
+    // Event loop: a few threads serve all consumers (a BLOCKing read is
+    // what makes the socket readable, so polling mode keeps a thread each)
+    const bool event_loop = config.event_loop && config.polling_interval_ms <= 0;
+    if (config.event_loop && !event_loop) {
+        LOG_WARN("main") << "EVENT_LOOP needs blocking reads, ignored with POLLING_INTERVAL_MS";
     }
+    const int reader_thread_count = event_loop ? std::min(std::max(1, config.reader_threads), reader_count) : reader_count;
     
-    RedisConsumer consumer(config);
-    ClickHouseWriter writer(config);
+    // Writer ids are global: route k owns writers [route_first[k], route_first[k + 1]),
+    // its whole pool, so that a reload can scale it up to that
+    Router router(routes, shard_key);
+    std::vector<size_t> route_first{0};
+    for (const auto& route : routes) route_first.push_back(route_first.back() + route.config.writer_pool_size());
+    const int writer_count = static_cast<int>(route_first.back());
+    
+    // One SPSC ring per (reader, writer) pair: each reader spreads over all
+    // writers of a route, each writer drains one ring per reader (M:N without locks)
+    const size_t ring_size = std::max<size_t>(1024, config.ring_buffer_size / reader_count);
+    // Each writer parks on one parker shared by its rings, each reader likewise
+    std::vector<std::unique_ptr<Parker>> writer_parkers;
+    std::vector<std::unique_ptr<Parker>> reader_parkers;
+    for (int w = 0; w < writer_count; ++w) writer_parkers.push_back(std::make_unique<Parker>());
+    for (int r = 0; r < reader_count; ++r) reader_parkers.push_back(std::make_unique<Parker>());
+    
+    std::vector<std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>> reader_buffers(reader_count);
+    std::vector<ClickHouseWriter::BufferSet> writer_buffers(writer_count);
+    
+    // Shared dispatch: one MPMC queue of reply chunks per route that its idle
+    // writers pull from; it holds about as many entries as the rings would
+    std::vector<std::unique_ptr<BatchQueue>> dispatch_queues;
+    std::vector<BatchQueue*> route_queues;
+    if (config.shared_dispatch) {
+        for (const auto& route : routes) {
+            size_t chunks = config.ring_buffer_size * route.config.writer_threads / std::max<size_t>(1, config.read_batch_size);
+            dispatch_queues.push_back(std::make_unique<BatchQueue>(std::max<size_t>(16, chunks)));
+            route_queues.push_back(dispatch_queues.back().get());
+        }
+    } else {
+        for (int r = 0; r < reader_count; ++r) {
+            reader_buffers[r].reserve(writer_count);
+            for (int w = 0; w < writer_count; ++w) {
+                reader_buffers[r].push_back(std::make_unique<LockFreeRingBuffer<LogEntry>>(
+                    ring_size, writer_parkers[w].get(), reader_parkers[r].get()));
+                writer_buffers[w].push_back(reader_buffers[r].back().get());
+                // Slots live with the writer that reads them back
+                const auto& ring = *reader_buffers[r].back();
+                place_on_node(ring.slots(), ring.slots_bytes(), spec_node(config.writer_cpus, w));
+            }
+        }
+    }
+    
+    // IDs of pb entries routed to several pools wait here for all their parts
+    SplitAcks split_acks;
+    
+    std::vector<std::unique_ptr<RedisConsumer>> consumers;
+    consumers.reserve(reader_count);
+    for (int r = 0; r < reader_count; ++r) {
+        consumers.push_back(std::make_unique<RedisConsumer>(
+            config, config.reader_consumer_name(r), config.reader_stream_key(r),
+            static_cast<uint16_t>(r)));
+        if (routes.size() > 1) {
+            consumers.back()->set_routes(&router, route_first, route_queues, &split_acks);
+        } else {
+            consumers.back()->set_shared_queue(route_queues.empty() ? nullptr : route_queues.front());
+        }
+    }
+    
+    // One writer pool per route, each with its own table, batching and connections
+    std::vector<std::unique_ptr<ClickHouseWriter>> writers;
+    std::vector<const std::atomic<int>*> active_writers;
+    for (size_t k = 0; k < routes.size(); ++k) {
+        writers.push_back(std::make_unique<ClickHouseWriter>(routes[k].config, static_cast<int>(route_first[k])));
+        active_writers.push_back(&writers.back()->active_threads());
+    }
+    for (auto& consumer : consumers) consumer->set_writer_limits(active_writers);
+    auto writers_sum = [&writers](size_t (ClickHouseWriter::*stat)() const) {
+        size_t total = 0;
+        for (const auto& writer : writers) total += ((*writer).*stat)();
+        return total;
+    };
+    auto writers_active = [&writers] {
+        size_t total = 0;
+        for (const auto& writer : writers) total += static_cast<size_t>(writer->active_threads().load());
+        return total;
+    };
+    auto writers_in_outage = [&writers] {
+        for (const auto& writer : writers) {
+            if (writer->in_outage()) return true;
+        }
+        return false;
+    };
     
     // Connect to Redis
-    if (!consumer.connect()) {
-        std::cerr << "Failed to connect to Redis\n";
+    for (auto& consumer : consumers) {
+        if (!consumer->connect()) {
+            LOG_ERROR("main") << "failed to connect to Redis";
+            return 1;
+        }
+    }
+    
+    // Dedicated ack thread: writers hand IDs off without touching Redis
+    std::vector<std::string> stream_keys;
+    for (const auto& consumer : consumers) stream_keys.push_back(consumer->stream_key());
+    AckPipeline acker(config, std::move(stream_keys));
+    if (!acker.start(writer_count)) {
+        LOG_ERROR("main") << "failed to start ack thread";
         return 1;
     }
     
     // ACK callback - called when batch is successfully written to ClickHouse
-    auto on_flush = [&consumer](const std::vector<std::string>& ids) {
-        consumer.ack_batch(ids);
+    // Each ID goes back to the stream of the reader that delivered it
+    auto on_flush = [&acker, &split_acks](int thread_id, uint16_t reader_id, std::vector<std::string>&& ids) {
+        split_acks.filter(reader_id, ids);
+        if (!ids.empty()) acker.enqueue(thread_id, reader_id, std::move(ids));
     };
     
     // Start writer threads
-    if (!writer.start(buffers, on_flush)) {
-        std::cerr << "Failed to start writer threads\n";
-        return 1;
+    for (size_t k = 0; k < routes.size(); ++k) {
+        std::vector<ClickHouseWriter::BufferSet> pool(writer_buffers.begin() + route_first[k],
+                                                      writer_buffers.begin() + route_first[k + 1]);
+        bool started = route_queues.empty() ? writers[k]->start(pool, on_flush)
+                                            : writers[k]->start(*route_queues[k], on_flush);
+        if (!started) {
+            LOG_ERROR("main") << "failed to start writer threads for route " << routes[k].name;
+            return 1;
+        }
     }
     
-    // Recover any pending messages from previous runs
-    size_t recovered = consumer.recover_pending(buffers);
-    if (recovered > 0) {
-        std::cout << "Recovered " << recovered << " pending messages\n";
+    // SIGHUP: batching, compression and writer counts of every pool come
+    // from the reloaded config; anything else needs a restart. Routes are
+    // matched by name, so ROUTES and CLICKHOUSE_SHARDS must keep their shape.
+    std::atomic<size_t> config_reloads{0};
+    auto reload = [&] {
+        Config::EnvOverrides reloaded_file;
+        if (config_file && !Config::read_env_file(config_file, reloaded_file)) {
+            LOG_ERROR("main") << "reload: cannot read CONFIG_FILE " << config_file << ", keeping the current config";
+            return;
+        }
+        Config next = Config::from_env(reloaded_file);
+        next.parse_args(argc, argv);
+        std::string error;
+        if (!next.validate(error)) {
+            LOG_ERROR("main") << "reload: " << error << ", keeping the current config";
+            return;
+        }
+        Compression method;
+        bool automatic = false;
+        if (!parse_compression(next.clickhouse_compression, method, automatic)) {
+            LOG_ERROR("main") << "reload: unknown CLICKHOUSE_COMPRESSION '" << next.clickhouse_compression
+                              << "', keeping the current config";
+            return;
+        }
+        std::vector<RouteSpec> next_routes;
+        if (!parse_routes(next, next_routes, error)) {
+            LOG_ERROR("main") << "reload: invalid ROUTES or ClickHouse hosts: " << error << ", keeping the current config";
+            return;
+        }
+        bool same_shape = next_routes.size() == routes.size();
+        for (size_t k = 0; same_shape && k < routes.size(); ++k) same_shape = next_routes[k].name == routes[k].name;
+        if (!same_shape) {
+            LOG_ERROR("main") << "reload: routes or shards changed, restart to apply; keeping the current config";
+            return;
+        }
+        for (size_t k = 0; k < routes.size(); ++k) writers[k]->reconfigure(next_routes[k].config);
+        ++config_reloads;
+        LOG_INFO("main") << "reloaded config: " << writers_active() << " writer threads, batch " << next.batch_size
+                         << ", linger " << next.max_linger_ms << " ms, " << next.clickhouse_compression << " compression";
+    };
+    
+    // Prometheus endpoint: counters and gauges are read from their owners
+    // at scrape time, latencies come from the shared histograms
+    auto render_metrics = [&](std::string& out) {
+        size_t read = 0, parse_errors = 0, dead_lettered = 0, waits = 0, recovered = 0, claimed = 0, deferred = 0, split = 0;
+        for (const auto& consumer : consumers) {
+            read += consumer->messages_read();
+            parse_errors += consumer->parse_errors();
+            dead_lettered += consumer->dead_lettered();
+            waits += consumer->backpressure_waits();
+            recovered += consumer->messages_recovered();
+            claimed += consumer->messages_claimed();
+            deferred += consumer->budget_deferred();
+            split += consumer->split_entries();
+        }
+        write_counter(out, "ingester_messages_read_total", "Log entries read from Redis", read);
+        write_counter(out, "ingester_parse_errors_total", "Stream entries that failed to parse", parse_errors);
+        write_counter(out, "ingester_dead_lettered_total", "Stream entries moved to the dead-letter stream and ACKed", dead_lettered);
+        write_counter(out, "ingester_backpressure_waits_total", "Times a reader waited for ring or queue space", waits);
+        write_counter(out, "ingester_recovered_total", "Log entries recovered from the PEL", recovered);
+        write_counter(out, "ingester_claimed_total", "Stream entries claimed from idle consumers", claimed);
+        write_counter(out, "ingester_budget_deferred_total", "Stream entries left pending because their app was over its memory share", deferred);
+        write_counter(out, "ingester_split_entries_total", "pb stream entries whose rows went to more than one route", split);
+        write_gauge(out, "ingester_split_entries_pending", "Split pb entries whose ID waits for parts not written yet",
+                    static_cast<double>(split_acks.outstanding()));
+        write_counter(out, "ingester_rows_written_total", "Rows inserted into ClickHouse", writers_sum(&ClickHouseWriter::logs_written));
+        write_counter(out, "ingester_batches_written_total", "Batches inserted into ClickHouse", writers_sum(&ClickHouseWriter::batches_written));
+        write_counter(out, "ingester_insert_errors_total", "Failed ClickHouse inserts", writers_sum(&ClickHouseWriter::errors));
+        write_counter(out, "ingester_spilled_batches_total", "Batches written to the spill log", writers_sum(&ClickHouseWriter::spilled_batches));
+        write_counter(out, "ingester_replayed_batches_total", "Spilled batches replayed", writers_sum(&ClickHouseWriter::replayed_batches));
+        write_counter(out, "ingester_quarantined_batches_total", "Spilled batches ClickHouse rejected, moved to quarantine", writers_sum(&ClickHouseWriter::quarantined_batches));
+        write_counter(out, "ingester_dedup_collapsed_total", "Rows folded into an identical row's repeat_count", writers_sum(&ClickHouseWriter::rows_collapsed));
+        write_counter(out, "ingester_dedup_replays_dropped_total", "Redelivered entries dropped as already inserted", writers_sum(&ClickHouseWriter::replays_dropped));
+        write_counter(out, "ingester_acks_withheld_total", "pb entries left pending because a batch with some of their rows was dropped",
+                      writers_sum(&ClickHouseWriter::acks_withheld));
+        write_counter(out, "ingester_replica_failovers_total", "Inserts retried on the next ClickHouse replica", writers_sum(&ClickHouseWriter::failovers));
+        write_counter(out, "ingester_acked_total", "Stream entries ACKed", acker.acked());
+        write_counter(out, "ingester_ack_errors_total", "Failed XACK rounds or commands", acker.errors());
+        write_gauge(out, "ingester_ack_pending", "IDs waiting for XACK", static_cast<double>(acker.pending()));
+        if (memory_budget().enabled()) {
+            write_gauge(out, "ingester_memory_budget_used_bytes", "Parsed entries charged to MEMORY_BUDGET_MB",
+                        static_cast<double>(memory_budget().used()));
+        }
+        write_gauge(out, "ingester_spill_pending_batches", "Spilled batches not replayed yet",
+                    static_cast<double>(writers_sum(&ClickHouseWriter::spill_pending)));
+        write_gauge(out, "ingester_clickhouse_outage", "1 while writers spill without trying ClickHouse",
+                    writers_in_outage() ? 1 : 0);
+        write_gauge(out, "ingester_writer_threads", "Writer threads readers publish to", static_cast<double>(writers_active()));
+        write_counter(out, "ingester_config_reloads_total", "Configuration reloads applied (SIGHUP)", config_reloads.load());
+        
+        if (routes.size() > 1) {
+            write_family(out, "ingester_route_rows_written_total", "counter", "Rows inserted per route");
+            for (size_t k = 0; k < routes.size(); ++k) {
+                write_sample(out, "ingester_route_rows_written_total", "route=\"" + escape_label(routes[k].name) + "\"",
+                             static_cast<double>(writers[k]->logs_written()));
+            }
+        }
+        
+        write_family(out, "ingester_ring_occupancy", "gauge", "Entries waiting in the rings of each writer");
+        for (int w = 0; w < writer_count; ++w) {
+            size_t rows = 0;
+            for (const auto* ring : writer_buffers[w]) rows += ring->size();
+            write_sample(out, "ingester_ring_occupancy", "writer=\"" + std::to_string(w) + "\"",
+                         static_cast<double>(rows));
+        }
+        if (!dispatch_queues.empty()) {
+            size_t rows = 0;
+            for (const auto& queue : dispatch_queues) rows += queue->rows();
+            write_gauge(out, "ingester_dispatch_queue_rows", "Entries waiting in the shared dispatch queues",
+                        static_cast<double>(rows));
+        }
+        
+        const Metrics& m = metrics();
+        m.read_rtt.write(out, "ingester_read_rtt_seconds", "XREADGROUP round trip, including BLOCK time");
+        m.parse.write(out, "ingester_parse_seconds", "Time to parse one XREADGROUP reply");
+        m.insert.write(out, "ingester_insert_seconds", "ClickHouse Insert latency per batch");
+        m.ack.write(out, "ingester_ack_seconds", "Batch written to XACK done");
+        m.e2e_lag.write(out, "ingester_e2e_lag_seconds", "Redis ID timestamp to XACK done");
+    };
+    std::unique_ptr<MetricsServer> metrics_server;
+    if (config.metrics_port > 0) {
+        metrics_server = std::make_unique<MetricsServer>(config.metrics_port, render_metrics);
+        if (!metrics_server->start()) metrics_server.reset();
     }
     
     // Benchmark timing
     auto start_time = std::chrono::high_resolution_clock::now();
-    size_t total_read = recovered;
+    std::atomic<size_t> total_read{0};
     
     // Main read loop
-    std::cout << "Starting ingestion...\n";
+    LOG_INFO("main") << "starting ingestion with " << reader_thread_count << " reader thread(s)";
     if (config.polling_interval_ms > 0) {
-        std::cout << "Polling Mode Enabled: " << config.polling_interval_ms << "ms interval\n";
+        LOG_INFO("main") << "polling mode: " << config.polling_interval_ms << " ms interval";
     }
 
-    while (g_running.load() && consumer.is_running()) {
-        size_t read = consumer.read_batch(buffers);
-        total_read += read;
+    auto reader_loop = [&](int r) {
+        RedisConsumer& consumer = *consumers[r];
+        auto& buffers = reader_buffers[r];
+        
+        // Before recovery starts, so its thread inherits the mask
+        pin_thread(config.reader_cpus, static_cast<size_t>(r), "reader");
         
-        // Polling delay
-        if (config.polling_interval_ms > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(config.polling_interval_ms));
+        // Pending messages from previous runs and dead consumers are
+        // fetched in the background and published by read_batch
+        consumer.start_recovery();
+        
+        while (g_running.load() && consumer.is_running()) {
+            total_read += consumer.read_batch(buffers);
+            
+            // Polling delay
+            if (config.polling_interval_ms > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(config.polling_interval_ms));
+            }
+        }
+        
+        // Parse replies of reads still in flight so they are written and ACKed
+        total_read += consumer.drain_reads(buffers);
+    };
+    
+    // Event loop thread t serves consumers t, t + threads, ... over one
+    // EventLoop. It is their only producer, so the rings stay SPSC; a
+    // consumer waiting on full rings holds up the others of its thread.
+    auto event_reader_loop = [&](int t) {
+        pin_thread(config.reader_cpus, static_cast<size_t>(t), "reader");
+        
+        struct Served {
+            RedisConsumer* consumer;
+            std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>* buffers;
+            bool readable;
+            bool watched;
+        };
+        std::vector<Served> served;
+        for (int r = t; r < reader_count; r += reader_thread_count) {
+            served.push_back({consumers[r].get(), &reader_buffers[r], false, false});
+        }
+        
+        EventLoop loop;
+        if (!loop.ok()) {
+            g_running.store(false);
+            return;
+        }
+        for (Served& s : served) {
+            s.consumer->start_recovery();
+            s.watched = s.consumer->start_reads() && loop.add(s.consumer->read_fd(), &s);
+            if (!s.watched) {
+                LOG_ERROR("main") << "cannot watch the read connection of " << s.consumer->consumer_name();
+            }
+        }
+        
+        std::vector<void*> ready;
+        while (g_running.load()) {
+            // Recovered pages are picked up on the timeout too
+            ready.clear();
+            loop.wait(ready, std::chrono::milliseconds(100));
+            for (void* tag : ready) static_cast<Served*>(tag)->readable = true;
+            
+            for (Served& s : served) {
+                if (!s.consumer->is_running()) continue;
+                total_read += s.consumer->poll_reads(*s.buffers, s.readable);
+                s.readable = false;
+                // A broken connection stays readable; stop watching it
+                if (s.watched && s.consumer->read_failed()) {
+                    loop.remove(s.consumer->read_fd());
+                    s.watched = false;
+                }
+            }
         }
         
+        for (Served& s : served) total_read += s.consumer->drain_reads(*s.buffers);
+    };
+    
+    std::vector<std::thread> readers;
+    readers.reserve(reader_thread_count);
+    for (int t = 0; t < reader_thread_count; ++t) {
+        if (event_loop) readers.emplace_back(event_reader_loop, t);
+        else readers.emplace_back(reader_loop, t);
+    }
+    
+    size_t last_report = 0;
+    auto last_report_time = std::chrono::steady_clock::now();
+    while (g_running.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (g_reload.exchange(false)) reload();
+        
         // Benchmark mode: exit after target count
-        if (config.benchmark_mode && writer.logs_written() >= config.benchmark_count) {
+        if (config.benchmark_mode && writers_sum(&ClickHouseWriter::logs_written) >= config.benchmark_count) {
+            g_running.store(false);
             break;
         }
         
-        // Progress reporting every 10k logs
-        if (total_read % 10000 < config.read_batch_size) {
+        // Progress reporting every 10k logs, at most once a second
+        size_t read = total_read.load();
+        auto now = std::chrono::steady_clock::now();
+        if (read / 10000 != last_report && now - last_report_time >= std::chrono::seconds(1) &&
+            logger().enabled(LogLevel::kInfo)) {
+            last_report = read / 10000;
+            last_report_time = now;
             size_t total_buffer = 0;
-            for (const auto& buf : buffers) total_buffer += buf->size();
+            for (const auto& row : reader_buffers) {
+                for (const auto& buf : row) total_buffer += buf->size();
+            }
+            for (const auto& queue : dispatch_queues) total_buffer += queue->rows();
             
-            std::cout << "Read: " << total_read 
-                      << " | Written: " << writer.logs_written()
-                      << " | Buffer: " << total_buffer << "\n";
+            LogLine line(LogLevel::kInfo, "main");
+            line << "read: " << read
+                 << " | written: " << writers_sum(&ClickHouseWriter::logs_written)
+                 << " | buffer: " << total_buffer
+                 << " | ACK lag: " << acker.last_ack_lag_us() / 1000 << " ms";
+            if (writers_sum(&ClickHouseWriter::spill_pending) > 0) {
+                line << " | spilled: " << writers_sum(&ClickHouseWriter::spill_pending)
+                     << (writers_in_outage() ? " (ClickHouse down)" : "");
+            }
         }
     }
     
-    consumer.stop();
+    for (auto& t : readers) {
+        if (t.joinable()) t.join();
+    }
+    for (auto& consumer : consumers) {
+        consumer->stop();
+    }
     
     // Wait for writer to drain
-    std::cout << "Waiting for writers to drain...\n";
-    writer.stop();
+    LOG_INFO("main") << "waiting for writers to drain";
+    acker.release_writers();
+    for (auto& writer : writers) writer->stop();
+    acker.stop();
+    if (metrics_server) metrics_server->stop();
+    
+    // Drain the log queue before the summary goes to stdout directly
+    logger().stop();
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
@@ -122,14 +591,31 @@ int main(int argc, char** argv) {
     std::cout << "\n===========================================\n";
     std::cout << " Results\n";
     std::cout << "===========================================\n";
-    std::cout << "Total read: " << total_read << " logs\n";
-    std::cout << "Total written: " << writer.logs_written() << " logs\n";
-    std::cout << "Batches: " << writer.batches_written() << "\n";
-    std::cout << "Errors: " << writer.errors() << "\n";
+    std::cout << "Total read: " << total_read.load() << " logs\n";
+    std::cout << "Total written: " << writers_sum(&ClickHouseWriter::logs_written) << " logs\n";
+    std::cout << "Batches: " << writers_sum(&ClickHouseWriter::batches_written) << "\n";
+    std::cout << "Errors: " << writers_sum(&ClickHouseWriter::errors) << "\n";
+    if (writers_sum(&ClickHouseWriter::spilled_batches) > 0 || writers_sum(&ClickHouseWriter::spill_pending) > 0) {
+        std::cout << "Spilled: " << writers_sum(&ClickHouseWriter::spilled_batches) << " batches, replayed "
+                  << writers_sum(&ClickHouseWriter::replayed_batches) << " (left on disk: " << writers_sum(&ClickHouseWriter::spill_pending) << ")\n";
+    }
+    size_t waits = 0, dropped = 0, recovered = 0, claimed = 0;
+    for (const auto& consumer : consumers) {
+        waits += consumer->backpressure_waits();
+        dropped += consumer->dropped();
+        recovered += consumer->messages_recovered();
+        claimed += consumer->messages_claimed();
+    }
+    if (recovered > 0) {
+        std::cout << "Recovered: " << recovered << " pending logs (" << claimed << " claimed from idle consumers)\n";
+    }
+    std::cout << "Backpressure waits: " << waits << " (left pending at shutdown: " << dropped << ")\n";
+    std::cout << "ACKed: " << acker.acked() << " in " << acker.ack_rounds() << " rounds"
+              << " (max lag " << acker.max_ack_lag_us() / 1000 << " ms, errors " << acker.errors() << ")\n";
     std::cout << "Duration: " << duration.count() << " ms\n";
     
     if (duration.count() > 0) {
-        double throughput = (writer.logs_written() * 1000.0) / duration.count();
+        double throughput = (writers_sum(&ClickHouseWriter::logs_written) * 1000.0) / duration.count();
         std::cout << "Throughput: " << static_cast<size_t>(throughput) << " logs/sec\n";
     }
     std::cout << "===========================================\n";
@@ -0,0 +1,23 @@
+#include "memory_budget.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace ingester {
+
+void MemoryBudget::configure(size_t limit_bytes, unsigned app_share_percent) {
+    limit_ = limit_bytes;
+    // 100% = no per-app limit (nothing is ever deferred)
+    app_limit_ = app_share_percent >= 100 ? SIZE_MAX : limit_bytes / 100 * std::max(1u, app_share_percent);
+}
+
+uint16_t MemoryBudget::bucket_of(std::string_view app_id) {
+    return static_cast<uint16_t>(hash_bytes(app_id) % kAppBuckets);
+}
+
+MemoryBudget& memory_budget() {
+    static MemoryBudget instance;
+    return instance;
+}
+
+} // namespace ingester
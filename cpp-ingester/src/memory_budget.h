@@ -0,0 +1,95 @@
+#pragma once
+
+#include "wait_strategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ingester {
+
+/**
+ * Process-wide byte budget for entries between parse and column append
+ *
+ * Readers charge LogEntry::estimated_size() for every entry they publish;
+ * the charges ride on the entry's BatchArena and are returned when its last
+ * ref is released. Two limits:
+ * - MEMORY_BUDGET_MB: a reader waits before publishing while the budget is
+ *   used up, so it stops reading instead of allocating (soft by one reply
+ *   per reader)
+ * - APP_BUDGET_PERCENT: one app_id may hold at most this share. Entries
+ *   over it are not published and stay pending; XAUTOCLAIM hands them
+ *   back after CLAIM_MIN_IDLE_MS, so a noisy tenant is delayed, not the rest.
+ *   The reader remembers them, so those redeliveries do not count toward
+ *   MAX_DELIVERIES (within one process; a restart forgets them)
+ *
+ * app_ids are tracked in kAppBuckets hash buckets; colliding apps share one.
+ */
+class MemoryBudget {
+public:
+    static constexpr size_t kAppBuckets = 256;
+
+    struct Charge {
+        uint16_t bucket;
+        size_t bytes;
+    };
+
+    void configure(size_t limit_bytes, unsigned app_share_percent);
+
+    bool enabled() const { return limit_ > 0; }
+    size_t limit() const { return limit_; }
+    size_t used() const { return used_.load(std::memory_order_relaxed); }
+    size_t used(uint16_t bucket) const { return apps_[bucket].load(std::memory_order_relaxed); }
+
+    static uint16_t bucket_of(std::string_view app_id);
+
+    // Whether `bytes` more of an app (with `pending` of it not charged yet) fit its share
+    bool app_admits(uint16_t bucket, size_t pending, size_t bytes) const {
+        const size_t held = used(bucket) + pending;
+        return held == 0 || held + bytes <= app_limit_;
+    }
+
+    /**
+     * Wait while the budget is used up; false if `running` turned false
+     */
+    template<typename Running>
+    bool wait_for_room(Running running) {
+        while (used() >= limit_) {
+            if (!running()) return false;
+            hybrid_wait(parker_, [&] { return used() < limit_ || !running(); }, std::chrono::milliseconds(100));
+        }
+        return true;
+    }
+
+    void charge(const Charge* charges, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            apps_[charges[i].bucket].fetch_add(charges[i].bytes, std::memory_order_relaxed);
+            total += charges[i].bytes;
+        }
+        used_.fetch_add(total, std::memory_order_relaxed);
+    }
+
+    void release(const Charge* charges, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            apps_[charges[i].bucket].fetch_sub(charges[i].bytes, std::memory_order_relaxed);
+            total += charges[i].bytes;
+        }
+        used_.fetch_sub(total, std::memory_order_relaxed);
+        parker_.notify();
+    }
+
+private:
+    size_t limit_ = 0;
+    size_t app_limit_ = 0;
+    std::atomic<size_t> used_{0};
+    std::atomic<size_t> apps_[kAppBuckets] = {};
+    Parker parker_;
+};
+
+MemoryBudget& memory_budget();
+
+} // namespace ingester
@@ -0,0 +1,218 @@
+#include "metrics.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ingester {
+
+namespace {
+
+constexpr int kFirstBoundBits = 10;     // le = 2^10 ns (~1 us) ...
+constexpr int kLastBoundBits = 36;      // ... 2^36 ns (~69 s), then +Inf
+constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+void append_double(std::string& out, double value) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.9g", value);
+    out.append(buf, static_cast<size_t>(n));
+}
+
+bool send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+Metrics& metrics() {
+    static Metrics instance;
+    return instance;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_ns_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::quantile_ns(double q) const {
+    const uint64_t total = count();
+    if (total == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return i + 1 < kBuckets ? bucket_floor(i + 1) - 1 : bucket_floor(i);
+        }
+    }
+    return bucket_floor(kBuckets - 1);
+}
+
+void LatencyHistogram::write(std::string& out, std::string_view name, std::string_view help) const {
+    // Snapshot once so buckets, sum and count agree as far as possible
+    uint64_t snapshot[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        snapshot[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+    }
+
+    const std::string family(name);
+    write_family(out, family, "histogram", help);
+    uint64_t cumulative = 0;
+    size_t next = 0;
+    for (int bits = kFirstBoundBits; bits <= kLastBoundBits; ++bits) {
+        // All values below 2^bits sit in buckets below the first one of that octave
+        const size_t end = static_cast<size_t>(bits - kSubBits + 1) << kSubBits;
+        for (; next < end; ++next) cumulative += snapshot[next];
+        std::string labels = "le=\"";
+        append_double(labels, static_cast<double>(uint64_t{1} << bits) / 1e9);
+        labels += "\"";
+        write_sample(out, family + "_bucket", labels, static_cast<double>(cumulative));
+    }
+    write_sample(out, family + "_bucket", "le=\"+Inf\"", static_cast<double>(total));
+    write_sample(out, family + "_sum", {}, static_cast<double>(sum_ns_.load(std::memory_order_relaxed)) / 1e9);
+    write_sample(out, family + "_count", {}, static_cast<double>(total));
+
+    write_family(out, family + "_quantile", "gauge", help);
+    for (double q : kQuantiles) {
+        std::string labels = "quantile=\"";
+        append_double(labels, q);
+        labels += "\"";
+        write_sample(out, family + "_quantile", labels, static_cast<double>(quantile_ns(q)) / 1e9);
+    }
+}
+
+void write_family(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void write_sample(std::string& out, std::string_view name, std::string_view labels, double value) {
+    out.append(name);
+    if (!labels.empty()) out.append("{").append(labels).append("}");
+    out.append(" ");
+    append_double(out, value);
+    out.append("\n");
+}
+
+std::string escape_label(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+void write_counter(std::string& out, std::string_view name, std::string_view help, uint64_t value) {
+    write_family(out, name, "counter", help);
+    write_sample(out, name, {}, static_cast<double>(value));
+}
+
+void write_gauge(std::string& out, std::string_view name, std::string_view help, double value) {
+    write_family(out, name, "gauge", help);
+    write_sample(out, name, {}, value);
+}
+
+MetricsServer::MetricsServer(int port, RenderFn render)
+    : port_(port), render_(std::move(render)) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start() {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        LOG_ERROR("metrics") << "socket failed: " << std::strerror(errno);
+        return false;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port_));
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd_, 16) != 0) {
+        LOG_ERROR("metrics") << "cannot listen on port " << port_ << ": " << std::strerror(errno);
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    running_.store(true);
+    thread_ = std::thread(&MetricsServer::serve, this);
+    LOG_INFO("metrics") << "serving http://0.0.0.0:" << port_ << "/metrics";
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running_.exchange(false)) return;
+    if (thread_.joinable()) thread_.join();
+    if (listen_fd_ >= 0) ::close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void MetricsServer::serve() {
+    while (running_.load()) {
+        // Short poll so stop() is noticed without closing the socket under accept
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        handle(fd);
+        ::close(fd);
+    }
+}
+
+void MetricsServer::handle(int fd) {
+    timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters; read until the end of the headers
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    std::string body;
+    const char* status = "200 OK";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics?") == 0) {
+        render_(body);
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    std::string response = "HTTP/1.1 ";
+    response.append(status).append("\r\n");
+    response.append("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n");
+    response.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+    response.append("Connection: close\r\n\r\n");
+    response.append(body);
+    send_all(fd, response.data(), response.size());
+}
+
+} // namespace ingester
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace ingester {
+
+/**
+ * Counter split over cache-line sized shards
+ *
+ * Each thread adds to its own shard (picked once per thread), so writer
+ * threads bumping the same stat never bounce a cache line. Reads sum the
+ * shards and are only meant for stats and scrapes.
+ */
+class ShardedCounter {
+public:
+    static constexpr size_t kShards = 16;
+
+    void add(uint64_t n) { shards_[shard_index()].value.fetch_add(n, std::memory_order_relaxed); }
+    ShardedCounter& operator+=(uint64_t n) { add(n); return *this; }
+    ShardedCounter& operator++() { add(1); return *this; }
+
+    uint64_t load() const {
+        uint64_t total = 0;
+        for (const auto& shard : shards_) total += shard.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    static size_t shard_index() {
+        static std::atomic<size_t> next{0};
+        thread_local const size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return index;
+    }
+
+    Shard shards_[kShards];
+};
+
+/**
+ * Lock-free latency histogram with HdrHistogram-style log-linear buckets
+ *
+ * Values are nanoseconds. Every power-of-two range is split into
+ * 2^kSubBits linear sub-buckets, so any recorded value is known to within
+ * 1/2^kSubBits (12.5%) of itself from 1 ns to ~18 minutes. Recording is
+ * three relaxed atomic adds; there is nothing to allocate or lock.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kMaxBits = 40;     // ~1100 s; larger values land in the last bucket
+    static constexpr size_t kBuckets = static_cast<size_t>(kMaxBits - kSubBits + 1) << kSubBits;
+
+    void record(std::chrono::nanoseconds value) {
+        const uint64_t ns = value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0;
+        buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> value) {
+        record(std::chrono::duration_cast<std::chrono::nanoseconds>(value));
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    // Zero everything; only consistent while nothing records
+    void reset();
+
+    /**
+     * Upper bound of the bucket holding quantile `q` (0..1), in nanoseconds
+     */
+    uint64_t quantile_ns(double q) const;
+
+    /**
+     * Append as a Prometheus histogram in seconds (power-of-two `le`
+     * bounds from ~1 us), plus a `<name>_quantile` gauge family
+     */
+    void write(std::string& out, std::string_view name, std::string_view help) const;
+
+    static size_t bucket_index(uint64_t ns) {
+        if (ns < (1u << kSubBits)) return static_cast<size_t>(ns);
+        const int msb = 63 - __builtin_clzll(ns);
+        if (msb >= kMaxBits) return kBuckets - 1;
+        const uint64_t sub = (ns >> (msb - kSubBits)) & ((1u << kSubBits) - 1);
+        return (static_cast<size_t>(msb - kSubBits + 1) << kSubBits) + sub;
+    }
+
+    // Smallest value of bucket `index`
+    static uint64_t bucket_floor(size_t index) {
+        if (index < (1u << kSubBits)) return index;
+        const int msb = static_cast<int>(index >> kSubBits) + kSubBits - 1;
+        const uint64_t sub = index & ((1u << kSubBits) - 1);
+        return (uint64_t{1} << msb) | (sub << (msb - kSubBits));
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+};
+
+/**
+ * Hot-path latencies, shared by all components
+ * Counters and gauges stay with the objects that own them and are
+ * collected at scrape time.
+ */
+struct Metrics {
+    LatencyHistogram read_rtt;      // XREADGROUP sent -> reply received (includes BLOCK time)
+    LatencyHistogram parse;         // Parsing one XREADGROUP reply
+    LatencyHistogram insert;        // One successful ClickHouse Insert
+    LatencyHistogram ack;           // Batch written -> its XACK round done
+    LatencyHistogram e2e_lag;       // Redis ID timestamp -> XACK done
+};
+
+Metrics& metrics();
+
+// Prometheus text exposition helpers
+void write_counter(std::string& out, std::string_view name, std::string_view help, uint64_t value);
+void write_gauge(std::string& out, std::string_view name, std::string_view help, double value);
+
+// One sample of an already-declared family: name{labels} value
+void write_sample(std::string& out, std::string_view name, std::string_view labels, double value);
+void write_family(std::string& out, std::string_view name, std::string_view type, std::string_view help);
+
+// Label value with backslash, double quote and newline escaped
+std::string escape_label(std::string_view value);
+
+/**
+ * Minimal HTTP server answering GET /metrics
+ *
+ * One thread, one connection at a time: scrapes are rare and small. The
+ * body is built by `render` on each request.
+ */
+class MetricsServer {
+public:
+    using RenderFn = std::function<void(std::string& out)>;
+
+    MetricsServer(int port, RenderFn render);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    bool start();
+    void stop();
+
+private:
+    void serve();
+    void handle(int fd);
+
+    const int port_;
+    RenderFn render_;
+    int listen_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
+
+} // namespace ingester
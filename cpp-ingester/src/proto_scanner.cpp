@@ -0,0 +1,149 @@
+#include "proto_scanner.h"
+
+namespace ingester {
+
+namespace {
+
+enum WireType : uint32_t {
+    kVarint = 0,
+    kFixed64 = 1,
+    kLengthDelimited = 2,
+    kFixed32 = 5,
+};
+
+struct Reader {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    bool done() const { return p == end; }
+
+    bool varint(uint64_t& out) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) return false;
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                out = value;
+                return true;
+            }
+        }
+        return false; // More than 10 bytes
+    }
+
+    bool bytes(std::string_view& out) {
+        uint64_t n;
+        if (!varint(n) || n > static_cast<uint64_t>(end - p)) return false;
+        out = std::string_view(reinterpret_cast<const char*>(p), static_cast<size_t>(n));
+        p += n;
+        return true;
+    }
+
+    bool skip(uint32_t wire_type) {
+        uint64_t ignored;
+        std::string_view ignored_bytes;
+        switch (wire_type) {
+            case kVarint: return varint(ignored);
+            case kLengthDelimited: return bytes(ignored_bytes);
+            case kFixed64: return advance(8);
+            case kFixed32: return advance(4);
+            default: return false; // Groups are not used by this schema
+        }
+    }
+
+    bool advance(size_t n) {
+        if (static_cast<size_t>(end - p) < n) return false;
+        p += n;
+        return true;
+    }
+};
+
+Reader make_reader(const char* data, size_t len) {
+    auto* begin = reinterpret_cast<const uint8_t*>(data);
+    return Reader{begin, begin + len};
+}
+
+// map<string, string> entry: key = 1, value = 2
+bool scan_map_entry(std::string_view entry, std::pair<std::string_view, std::string_view>& out) {
+    Reader in = make_reader(entry.data(), entry.size());
+    while (!in.done()) {
+        uint64_t tag;
+        if (!in.varint(tag)) return false;
+        uint32_t field = static_cast<uint32_t>(tag >> 3);
+        uint32_t wire_type = static_cast<uint32_t>(tag & 7);
+        bool ok;
+        if (field == 1 && wire_type == kLengthDelimited) ok = in.bytes(out.first);
+        else if (field == 2 && wire_type == kLengthDelimited) ok = in.bytes(out.second);
+        else ok = in.skip(wire_type);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool scan_proto_log(const char* data, size_t len, ProtoLogFields& out) {
+    out.clear();
+    Reader in = make_reader(data, len);
+
+    while (!in.done()) {
+        uint64_t tag;
+        if (!in.varint(tag)) return false;
+        uint32_t field = static_cast<uint32_t>(tag >> 3);
+        uint32_t wire_type = static_cast<uint32_t>(tag & 7);
+
+        // Fields with an unexpected wire type are skipped like unknown ones
+        bool ok;
+        if (wire_type == kLengthDelimited) {
+            std::string_view value;
+            ok = in.bytes(value);
+            switch (field) {
+                case 1: out.id = value; break;
+                case 2: out.app_id = value; break;
+                case 5: out.message = value; break;
+                case 6: out.source = value; break;
+                case 7: out.environment = value; break;
+                case 8: {
+                    std::pair<std::string_view, std::string_view> entry;
+                    ok = ok && scan_map_entry(value, entry);
+                    if (ok) out.metadata.push_back(entry);
+                    break;
+                }
+                case 9: out.trace_id = value; break;
+                case 10: out.user_id = value; break;
+                default: break;
+            }
+        } else if (wire_type == kVarint && (field == 3 || field == 4)) {
+            uint64_t value;
+            ok = in.varint(value);
+            if (field == 3) out.timestamp_ms = static_cast<int64_t>(value);
+            else out.level = static_cast<uint32_t>(value);
+        } else {
+            ok = in.skip(wire_type);
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool scan_proto_batch(const char* data, size_t len, std::vector<std::string_view>& entries) {
+    Reader in = make_reader(data, len);
+
+    while (!in.done()) {
+        uint64_t tag;
+        if (!in.varint(tag)) return false;
+        uint32_t field = static_cast<uint32_t>(tag >> 3);
+        uint32_t wire_type = static_cast<uint32_t>(tag & 7);
+
+        if (field == 1 && wire_type == kLengthDelimited) {
+            std::string_view entry;
+            if (!in.bytes(entry)) return false;
+            entries.push_back(entry);
+        } else if (!in.skip(wire_type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace ingester
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * Fields of one serialized `logs.LogEntry` (proto/logs/log-entry.proto)
+ *
+ * String fields are views into the scanned bytes; absent fields are empty
+ * and scalars keep their proto3 defaults. Reuse one instance across calls:
+ * `clear()` keeps the metadata vector's capacity.
+ */
+struct ProtoLogFields {
+    std::string_view id;            // 1
+    std::string_view app_id;        // 2
+    int64_t timestamp_ms = 0;       // 3
+    uint32_t level = 0;             // 4, logs.LogLevel (DEBUG = 0 ... FATAL = 4)
+    std::string_view message;       // 5
+    std::string_view source;        // 6
+    std::string_view environment;   // 7
+    std::vector<std::pair<std::string_view, std::string_view>> metadata;  // 8, in wire order
+    std::string_view trace_id;      // 9
+    std::string_view user_id;       // 10
+
+    void clear() {
+        metadata.clear();
+        id = app_id = message = source = environment = trace_id = user_id = {};
+        timestamp_ms = 0;
+        level = 0;
+    }
+};
+
+/**
+ * Zero-copy protobuf wire-format scanner for the ingest schema
+ *
+ * Optimizations:
+ * - No libprotobuf message objects: fields are sliced straight out of the
+ *   Redis reply and copied once, into the reply's BatchArena
+ * - One walk per message, unknown fields skipped by wire type
+ *
+ * Returns false on truncated or malformed input.
+ */
+bool scan_proto_log(const char* data, size_t len, ProtoLogFields& out);
+
+/**
+ * Split a serialized `logs.LogEntryBatch` into its serialized entries
+ * Appends one view per entry to `entries` (not cleared first).
+ */
+bool scan_proto_batch(const char* data, size_t len, std::vector<std::string_view>& entries);
+
+/**
+ * logs.LogLevel -> ClickHouse Enum8 value ('DEBUG' = 1 ... 'FATAL' = 5)
+ * Unknown values fall back to INFO, like unknown JSON levels do.
+ */
+constexpr int8_t log_level_enum8(uint32_t level) {
+    return level <= 4 ? static_cast<int8_t>(level + 1) : 2;
+}
+
+} // namespace ingester
@@ -1,59 +1,75 @@
 #include "redis_consumer.h"
-#include <iostream>
+#include "json_scanner.h"
+#include "proto_scanner.h"
+#include "metrics.h"
+#include "logger.h"
+#include "memory_budget.h"
+#include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
+#include <iterator>
+#include <random>
+#include <cerrno>
+#include <unistd.h>
 
 namespace ingester {
 
-RedisConsumer::RedisConsumer(const Config& config) : config_(config) {}
+RedisConsumer::RedisConsumer(const Config& config)
+    : RedisConsumer(config, config.consumer_name, config.stream_key, 0) {}
+
+RedisConsumer::RedisConsumer(const Config& config, std::string consumer_name,
+                             std::string stream_key, uint16_t reader_id)
+    : config_(config)
+    , consumer_name_(std::move(consumer_name))
+    , stream_key_(std::move(stream_key))
+    , reader_id_(reader_id)
+    , uuid_state_(std::random_device{}() ^ (static_cast<uint64_t>(reader_id) << 32))
+    , stream_seed_(stable_hash(stream_key_)) {
+    build_read_command();
+}
 
 RedisConsumer::~RedisConsumer() {
     stop();
+    stop_recovery();
+    while (auto page = recovered_.try_pop()) freeReplyObject(page->reply);
     if (redis_read_) redisFree(redis_read_);
     if (redis_write_) redisFree(redis_write_);
 }
 
-bool RedisConsumer::connect() {
+static redisContext* connect_redis(const Config& config, const char* role) {
     struct timeval timeout = {5, 0};
-    
-    // Connection 1: Reader (Blocking)
-    redis_read_ = redisConnectWithTimeout(
-        config_.redis_host.c_str(), 
-        config_.redis_port, 
-        timeout
-    );
-    
-    if (redis_read_ == nullptr || redis_read_->err) {
-        std::cerr << "Redis Read connection error: " << (redis_read_ ? redis_read_->errstr : "alloc fail") << std::endl;
-        return false;
+    redisContext* ctx = redisConnectWithTimeout(config.redis_host.c_str(), config.redis_port, timeout);
+    if (ctx == nullptr || ctx->err) {
+        LOG_ERROR("redis") << role << " connection error: " << (ctx ? ctx->errstr : "alloc fail");
+        if (ctx) redisFree(ctx);
+        return nullptr;
     }
+    return ctx;
+}
+
+bool RedisConsumer::connect() {
+    // Connection 1: Reader (Blocking)
+    redis_read_ = connect_redis(config_, "Read");
+    if (!redis_read_) return false;
 
     // Connection 2: Writer (ACKs)
-    redis_write_ = redisConnectWithTimeout(
-        config_.redis_host.c_str(), 
-        config_.redis_port, 
-        timeout
-    );
-
-    if (redis_write_ == nullptr || redis_write_->err) {
-        std::cerr << "Redis Write connection error: " << (redis_write_ ? redis_write_->errstr : "alloc fail") << std::endl;
-        return false;
-    }
+    redis_write_ = connect_redis(config_, "Write");
+    if (!redis_write_) return false;
     
-    std::cout << "Connected to Redis at " << config_.redis_host << ":" << config_.redis_port << " (Read & Write connections)\n";
+    LOG_INFO("redis") << "connected to " << config_.redis_host << ":" << config_.redis_port
+                      << " as " << consumer_name_ << " on " << stream_key_ << " (read & write connections)";
     
     return ensure_consumer_group();
 }
 
 bool RedisConsumer::ensure_consumer_group() {
     // Use write connection for setup commands
-    std::lock_guard<std::mutex> lock(write_mutex_);
-    
     redisReply* reply = static_cast<redisReply*>(redisCommand(
         redis_write_,
         "XGROUP CREATE %s %s $ MKSTREAM",
-        config_.stream_key.c_str(),
+        stream_key_.c_str(),
         config_.group_name.c_str()
     ));
     
@@ -67,324 +83,1067 @@ bool RedisConsumer::ensure_consumer_group() {
     return false;
 }
 
-size_t RedisConsumer::read_batch(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
-    if (buffers.empty()) return 0;
+void RedisConsumer::build_read_command() {
+    // Built once; argv points into config_ and the members below
+    count_str_ = std::to_string(config_.read_batch_size);
     
-    // No lock needed here! Only one reader thread uses redis_read_
+    read_argv_.clear();
+    read_argvlen_.clear();
     
-    std::string count_str = std::to_string(config_.read_batch_size);
+    auto add = [this](const char* arg, size_t len) {
+        read_argv_.push_back(arg);
+        read_argvlen_.push_back(len);
+    };
     
-    std::vector<const char*> argv;
-    std::vector<size_t> argvlen;
+    add("XREADGROUP", 10);
+    add("GROUP", 5);
+    add(config_.group_name.c_str(), config_.group_name.size());
+    add(consumer_name_.c_str(), consumer_name_.size());
     
-    argv.push_back("XREADGROUP");
-    argvlen.push_back(10);
+    // Only use BLOCK if polling is disabled (interval <= 0)
+    // If polling is enabled, we want a non-blocking check
+    if (config_.polling_interval_ms <= 0 && config_.block_ms > 0) {
+        block_str_ = std::to_string(config_.block_ms);
+        add("BLOCK", 5);
+        add(block_str_.c_str(), block_str_.size());
+    }
     
-    argv.push_back("GROUP");
-    argvlen.push_back(5);
+    add("COUNT", 5);
+    add(count_str_.c_str(), count_str_.size());
+    add("STREAMS", 7);
+    add(stream_key_.c_str(), stream_key_.size());
+    add(">", 1);
+}
+
+bool RedisConsumer::send_read() {
+    if (redisAppendCommandArgv(redis_read_, static_cast<int>(read_argv_.size()),
+                               read_argv_.data(), read_argvlen_.data()) != REDIS_OK) {
+        return false;
+    }
+    ++inflight_reads_;
+    read_sent_.push_back(std::chrono::steady_clock::now());
+    return true;
+}
+
+bool RedisConsumer::flush_reads() {
+    int done = 0;
+    while (!done) {
+        if (redisBufferWrite(redis_read_, &done) != REDIS_OK) return false;
+    }
+    return true;
+}
+
+redisReply* RedisConsumer::next_read_reply() {
+    // Serial mode (depth 0) or first call: make sure one read is outstanding
+    if (inflight_reads_ == 0 && !send_read()) return nullptr;
     
-    argv.push_back(config_.group_name.c_str());
-    argvlen.push_back(config_.group_name.size());
+    redisReply* reply = nullptr;
+    if (redisGetReply(redis_read_, reinterpret_cast<void**>(&reply)) != REDIS_OK) {
+        // Context is unusable after an I/O or protocol error
+        inflight_reads_ = 0;
+        read_sent_.clear();
+        return nullptr;
+    }
+    reply_received();
     
-    argv.push_back(config_.consumer_name.c_str());
-    argvlen.push_back(config_.consumer_name.size());
+    // Keep `depth` reads on the wire while this reply is parsed
+    top_up_reads(config_.read_pipeline_depth);
+    return reply;
+}
+
+void RedisConsumer::reply_received() {
+    --inflight_reads_;
+    metrics().read_rtt.record(std::chrono::steady_clock::now() - read_sent_.front());
+    read_sent_.pop_front();
+}
+
+void RedisConsumer::fail_reads(int err, const char* what) {
+    // Mark the context like hiredis would: it is out of sync for good
+    if (redis_read_->err == 0) {
+        redis_read_->err = err;
+        std::snprintf(redis_read_->errstr, sizeof(redis_read_->errstr), "%s", what);
+    }
+    inflight_reads_ = 0;
+    read_sent_.clear();
+    INGESTER_LOG_EVERY(LogLevel::kError, "redis", 1) << "XREADGROUP failed: " << redis_read_->errstr;
+}
+
+bool RedisConsumer::fill_resp() {
+    constexpr size_t kReadChunk = 64 << 10;
     
-    // Only use BLOCK if polling is disabled (interval <= 0)
-    // If polling is enabled, we want a non-blocking check
-    std::string block_str;
-    if (config_.polling_interval_ms <= 0 && config_.block_ms > 0) {
-        block_str = std::to_string(config_.block_ms);
-        argv.push_back("BLOCK");
-        argvlen.push_back(5);
-        
-        argv.push_back(block_str.c_str());
-        argvlen.push_back(block_str.size());
+    // The unconsumed tail (a partial reply) moves to the front; a reply
+    // that does not fit grows the buffer
+    if (resp_begin_ > 0) {
+        std::memmove(resp_buf_.data(), resp_buf_.data() + resp_begin_, resp_end_ - resp_begin_);
+        resp_end_ -= resp_begin_;
+        resp_begin_ = 0;
+    }
+    if (resp_buf_.size() - resp_end_ < kReadChunk) {
+        resp_buf_.resize(std::max(resp_buf_.size() * 2, resp_end_ + kReadChunk));
     }
     
-    argv.push_back("COUNT");
-    argvlen.push_back(5);
+    ssize_t n;
+    do {
+        n = ::read(redis_read_->fd, resp_buf_.data() + resp_end_, resp_buf_.size() - resp_end_);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        resp_end_ += static_cast<size_t>(n);
+        return true;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;   // Non-blocking socket with nothing yet
     
-    argv.push_back(count_str.c_str());
-    argvlen.push_back(count_str.size());
+    fail_reads(n == 0 ? REDIS_ERR_EOF : REDIS_ERR_IO, n == 0 ? "Server closed the connection" : std::strerror(errno));
+    return false;
+}
+
+RespStatus RedisConsumer::next_raw_reply(bool block) {
+    for (;;) {
+        RespStatus status = scan_stream_reply(resp_buf_.data() + resp_begin_, resp_end_ - resp_begin_,
+                                              entries_, resp_reply_bytes_);
+        if (status == RespStatus::kError) fail_reads(REDIS_ERR_PROTOCOL, "Protocol error in XREADGROUP reply");
+        if (status != RespStatus::kIncomplete || !block) return status;
+        if (!fill_resp()) return RespStatus::kError;
+    }
+}
+
+size_t RedisConsumer::take_raw_reply(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    // entries_ points into resp_buf_: dispatch before the next fill
+    size_t count = dispatch_entries(entries_, buffers);
+    resp_begin_ += resp_reply_bytes_;
+    if (resp_begin_ == resp_end_) resp_begin_ = resp_end_ = 0;
+    return count;
+}
+
+size_t RedisConsumer::read_raw(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    if (read_failed()) return 0;
+    // Serial mode (depth 0) or first call: make sure one read is outstanding
+    if (inflight_reads_ == 0 && !(send_read() && flush_reads())) return 0;
+    if (next_raw_reply(true) != RespStatus::kOk) return 0;
+    reply_received();
     
-    argv.push_back("STREAMS");
-    argvlen.push_back(7);
+    // Keep `depth` reads on the wire while this reply is parsed
+    top_up_reads(config_.read_pipeline_depth);
+    return take_raw_reply(buffers);
+}
+
+void RedisConsumer::top_up_reads(size_t depth) {
+    bool sent = false;
+    while (inflight_reads_ < depth && send_read()) sent = true;
+    if (sent && !flush_reads()) {
+        INGESTER_LOG_EVERY(LogLevel::kError, "redis", 1) << "XREADGROUP pipeline flush failed: " << redis_read_->errstr;
+    }
+}
+
+bool RedisConsumer::start_reads() {
+    if (!redis_read_) return false;
+    top_up_reads(std::max<size_t>(1, config_.read_pipeline_depth));
+    return inflight_reads_ > 0;
+}
+
+size_t RedisConsumer::poll_reads(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers, bool readable) {
+    size_t recovered = recovered_.empty() ? 0 : dispatch_recovered(buffers);
+    if (!readable || read_failed()) return recovered;
     
-    argv.push_back(config_.stream_key.c_str());
-    argvlen.push_back(config_.stream_key.size());
+    size_t count = 0;
+    if (config_.raw_replies) {
+        // One read of what the socket holds; readiness means it does not block
+        if (!fill_resp()) return recovered;
+        while (inflight_reads_ > 0 && next_raw_reply(false) == RespStatus::kOk) {
+            reply_received();
+            count += take_raw_reply(buffers);
+        }
+        if (!read_failed()) top_up_reads(std::max<size_t>(1, config_.read_pipeline_depth));
+        messages_read_ += count;
+        return recovered + count;
+    }
     
-    argv.push_back(">");
-    argvlen.push_back(1);
+    // One read of what the socket holds; readiness means it does not block
+    if (redisBufferRead(redis_read_) != REDIS_OK) {
+        INGESTER_LOG_EVERY(LogLevel::kError, "redis", 1) << "XREADGROUP failed: " << redis_read_->errstr;
+        inflight_reads_ = 0;
+        read_sent_.clear();
+        return recovered;
+    }
     
-    redisReply* reply = static_cast<redisReply*>(redisCommandArgv(
-        redis_read_, 
-        static_cast<int>(argv.size()), 
-        argv.data(), 
-        argvlen.data()
-    ));
+    void* next = nullptr;
+    while (inflight_reads_ > 0 && redisGetReplyFromReader(redis_read_, &next) == REDIS_OK && next) {
+        redisReply* reply = static_cast<redisReply*>(next);
+        next = nullptr;
+        reply_received();
+        if (reply->type == REDIS_REPLY_ARRAY) count += dispatch_reply(reply, buffers);
+        freeReplyObject(reply);
+    }
+    top_up_reads(std::max<size_t>(1, config_.read_pipeline_depth));
+    
+    messages_read_ += count;
+    return recovered + count;
+}
+
+size_t RedisConsumer::read_batch(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    if (buffers.empty() && !shared_queue_ && route_queues_.empty()) return 0;
+    
+    // Pages the recovery thread fetched meanwhile go out first
+    size_t recovered = recovered_.empty() ? 0 : dispatch_recovered(buffers);
+    
+    if (config_.raw_replies) {
+        size_t count = read_raw(buffers);
+        messages_read_ += count;
+        return recovered + count;
+    }
+    
+    // No lock needed here! Only one reader thread uses redis_read_
+    redisReply* reply = next_read_reply();
     
     if (!reply) {
-        if (redis_read_) std::cerr << "XREADGROUP failed: " << redis_read_->errstr << std::endl;
-        return 0;
+        if (redis_read_) {
+            INGESTER_LOG_EVERY(LogLevel::kError, "redis", 1) << "XREADGROUP failed: " << redis_read_->errstr;
+        }
+        return recovered;
     }
     
     if (reply->type == REDIS_REPLY_NIL || reply->type != REDIS_REPLY_ARRAY) {
         freeReplyObject(reply);
-        return 0;
+        return recovered;
     }
     
-    size_t count = 0;
+    size_t count = dispatch_reply(reply, buffers);
     
-    if (reply->elements > 0) {
-        redisReply* stream = reply->element[0];
-        if (stream && stream->type == REDIS_REPLY_ARRAY && stream->elements >= 2) {
-            redisReply* messages = stream->element[1];
-            
-            if (messages && messages->type == REDIS_REPLY_ARRAY) {
-                for (size_t i = 0; i < messages->elements; ++i) {
-                    redisReply* msg = messages->element[i];
-                    if (!msg || msg->type != REDIS_REPLY_ARRAY || msg->elements < 2) continue;
-                    
-                    redisReply* idReply = msg->element[0];
-                    if (!idReply || !idReply->str) continue;
-                    
-                    const char* msg_id = idReply->str;
-                    redisReply* fields = msg->element[1];
-                    
-                    if (fields && fields->type == REDIS_REPLY_ARRAY && fields->elements >= 2) {
-                        for (size_t j = 0; j < fields->elements - 1; j += 2) {
-                            redisReply* keyReply = fields->element[j];
-                            redisReply* valReply = fields->element[j + 1];
-                            
-                            if (!keyReply || !keyReply->str || !valReply || !valReply->str) continue;
-                            
-                            if (strcmp(keyReply->str, "data") == 0) {
-                                try {
-                                    LogEntry entry = parse_message(valReply->str, valReply->len, msg_id);
-                                    
-                                    // Round-robin distribution
-                                    // Try current buffer, if full, try next one
-                                    bool pushed = false;
-                                    size_t start_idx = current_buffer_idx_;
-                                    
-                                    do {
-                                        if (buffers[current_buffer_idx_]->try_push(std::move(entry))) {
-                                            pushed = true;
-                                            current_buffer_idx_ = (current_buffer_idx_ + 1) % buffers.size();
-                                            ++count;
-                                            break;
-                                        }
-                                        current_buffer_idx_ = (current_buffer_idx_ + 1) % buffers.size();
-                                    } while (current_buffer_idx_ != start_idx);
-                                    
-                                    if (!pushed) {
-                                        // All buffers full, drop message or block?
-                                        // For high throughput, we drop but log error (or backpressure logic)
-                                        // Simple version: just stop reading this batch
-                                        break; 
-                                    }
-
-                                } catch (const std::exception& e) {
-                                    ++parse_errors_;
-                                }
-                            }
-                        }
-                    }
-                }
+    freeReplyObject(reply);
+    messages_read_ += count;
+    return recovered + count;
+}
+
+// Entries of one pb batch share a stream ID that only the last one carries.
+// Keep such a group on one ring: split across writers, the one holding the
+// ID could ACK it before the others have written their part.
+static size_t push_groups(LockFreeRingBuffer<LogEntry>& buffer, std::vector<LogEntry>& entries,
+                          size_t from, size_t want) {
+    const size_t total = entries.size();
+    while (from + want < total && entries[from + want - 1].redis_id.empty()) ++want;
+    
+    auto span = buffer.reserve_write(want);
+    size_t n = span.size();
+    if (n < want) {
+        // Trim to the last whole group; a group larger than the ring alone
+        // may still be split, once the ring has drained completely
+        while (n > 0 && entries[from + n - 1].redis_id.empty()) --n;
+        if (n == 0 && span.size() == buffer.capacity()) n = span.size();
+    }
+    for (size_t i = 0; i < n; ++i) {
+        span[i] = std::move(entries[from + i]);
+    }
+    buffer.commit_write(n);
+    return n;
+}
+
+size_t RedisConsumer::publish(std::vector<LogEntry>& entries, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    if (router_) return publish_routed(entries, buffers);
+    if (shared_queue_) return publish_shared(entries, *shared_queue_);
+    return publish_rings(entries, buffers.data(), live_rings(0, buffers.size()), current_buffer_idx_);
+}
+
+size_t RedisConsumer::live_rings(size_t route, size_t rings) const {
+    if (route >= active_writers_.size()) return rings;
+    const int active = active_writers_[route]->load(std::memory_order_acquire);
+    return std::clamp<size_t>(static_cast<size_t>(std::max(active, 1)), 1, rings);
+}
+
+void RedisConsumer::set_routes(const Router* router, std::vector<size_t> ring_offsets, std::vector<BatchQueue*> queues,
+                               SplitAcks* split_acks) {
+    router_ = router;
+    split_acks_ = split_acks;
+    route_rings_ = std::move(ring_offsets);
+    route_queues_ = std::move(queues);
+    route_entries_.assign(router ? router->size() : 0, {});
+    entry_routes_.assign(route_entries_.size(), 0);
+    route_cursors_.assign(route_entries_.size(), 0);
+}
+
+size_t RedisConsumer::publish_routed(std::vector<LogEntry>& entries, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    // Every row goes to its own route. Rows up to the one carrying the
+    // stream ID are one stream entry (pb batch); when they span routes,
+    // each route's part ends with the ID too, so every pool keeps its part
+    // together, and split_acks_ ACKs the ID once all parts are written.
+    row_routes_.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) row_routes_[i] = router_->route(entries[i]);
+    
+    size_t start = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].redis_id.empty() && i + 1 < entries.size()) continue;
+        bool split = false;
+        for (size_t j = start; j < i && !split; ++j) split = row_routes_[j] != row_routes_[i];
+        if (split && !entries[i].redis_id.empty()) {
+            // Last row of each route's part, walking back from the ID row
+            size_t parts = 0;
+            for (size_t j = i + 1; j-- > start;) {
+                uint8_t& seen = entry_routes_[row_routes_[j]];
+                if (seen) continue;
+                seen = 1;
+                entries[j].redis_id = entries[i].redis_id;
+                ++parts;
             }
+            for (size_t j = start; j <= i; ++j) entry_routes_[row_routes_[j]] = 0;
+            split_acks_->expect(reader_id_, entries[i].redis_id, parts);
+            ++split_entries_;
         }
+        for (size_t j = start; j <= i; ++j) route_entries_[row_routes_[j]].push_back(std::move(entries[j]));
+        start = i + 1;
     }
+    entries.clear();
     
-    freeReplyObject(reply);
-    messages_read_ += count;
-    return count;
+    size_t done = 0;
+    for (size_t k = 0; k < route_entries_.size(); ++k) {
+        auto& routed = route_entries_[k];
+        if (routed.empty()) continue;
+        if (!route_queues_.empty()) {
+            done += publish_shared(routed, *route_queues_[k]);
+        } else {
+            done += publish_rings(routed, buffers.data() + route_rings_[k],
+                                  live_rings(k, route_rings_[k + 1] - route_rings_[k]), route_cursors_[k]);
+        }
+    }
+    return done;
 }
 
-// Simple JSON string value extractor
-static std::string extract_json_value(const std::string& json, const std::string& key) {
-    std::string search = "\"" + key + "\":\"";
-    size_t pos = json.find(search);
-    if (pos == std::string::npos) return "";
+size_t RedisConsumer::publish_rings(std::vector<LogEntry>& entries, std::unique_ptr<LockFreeRingBuffer<LogEntry>>* rings,
+                                    size_t ring_count, size_t& cursor) {
+    auto any_space = [rings, ring_count] {
+        for (size_t i = 0; i < ring_count; ++i) {
+            if (!rings[i]->full()) return true;
+        }
+        return false;
+    };
     
-    pos += search.length();
-    size_t end = json.find("\"", pos);
-    if (end == std::string::npos) return "";
+    const size_t total = entries.size();
+    const size_t share = (total + ring_count - 1) / ring_count;
+    if (cursor >= ring_count) cursor = 0;  // The pool was scaled down
+    size_t done = 0;
     
-    while (end > 0 && json[end - 1] == '\\') {
-        end = json.find("\"", end + 1);
-        if (end == std::string::npos) return "";
+    while (done < total) {
+        // Round-robin distribution, one bulk push per ring
+        // A full ring takes less; the rest spills to the next ones
+        size_t progressed = 0;
+        for (size_t n = 0; n < ring_count && done < total; ++n) {
+            auto& buffer = rings[cursor];
+            cursor = (cursor + 1) % ring_count;
+            size_t pushed = push_groups(*buffer, entries, done, std::min(share, total - done));
+            done += pushed;
+            progressed += pushed;
+        }
+        if (done == total || progressed > 0) continue;
+        
+        // All buffers full: backpressure instead of dropping. Only give up when
+        // stopping; the messages then stay pending and are recovered on restart.
+        if (!running_.load()) {
+            dropped_ += total - done;
+            break;
+        }
+        ++backpressure_waits_;
+        hybrid_wait(rings[0]->space_parker(), any_space, std::chrono::milliseconds(100));
     }
     
-    return json.substr(pos, end - pos);
+    entries.clear();
+    return done;
 }
 
-LogEntry RedisConsumer::parse_message(const char* json_data, size_t len, const char* msg_id) {
-    std::string json(json_data, len);
+void RedisConsumer::admit(BatchArena& arena) {
+    MemoryBudget& budget = memory_budget();
+    charges_.clear();
+    size_t kept = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < parsed_.size(); ++i) {
+        // A stream entry's rows end at the one carrying its ID (pb batches)
+        if (parsed_[i].redis_id.empty() && i + 1 < parsed_.size()) continue;
+        
+        const uint16_t bucket = MemoryBudget::bucket_of(parsed_[start].app_id);
+        size_t bytes = 0;
+        for (size_t j = start; j <= i; ++j) bytes += parsed_[j].estimated_size();
+        
+        if (budget.app_admits(bucket, app_pending_[bucket], bytes)) {
+            if (app_pending_[bucket] == 0) charges_.push_back({bucket, 0});
+            app_pending_[bucket] += bytes;
+            if (deferral_count_.load(std::memory_order_relaxed) > 0) note_admitted(parsed_[i].redis_id);
+            for (size_t j = start; j <= i; ++j) parsed_[kept++] = parsed_[j];
+        } else {
+            // Left pending: XAUTOCLAIM brings it back once the app has room,
+            // without these deliveries counting toward max_deliveries
+            ++budget_deferred_;
+            if (config_.max_deliveries > 0) note_deferred(parsed_[i].redis_id);
+        }
+        start = i + 1;
+    }
+    parsed_.resize(kept);
     
-    LogEntry entry;
-    entry.redis_id = msg_id;
+    for (auto& charge : charges_) {
+        charge.bytes = app_pending_[charge.bucket];
+        app_pending_[charge.bucket] = 0;
+    }
+    if (charges_.empty()) return;
+    
+    // Wait for writers to release instead of taking more memory
+    if (budget.used() >= budget.limit()) {
+        ++backpressure_waits_;
+        budget.wait_for_room([this] { return running_.load(); });
+    }
+    arena.set_charges(charges_.data(), charges_.size());
+    budget.charge(charges_.data(), charges_.size());
+}
+
+size_t RedisConsumer::publish_shared(std::vector<LogEntry>& entries, BatchQueue& queue) {
+    // The reply travels as one chunk; the chunk's recycled vector becomes
+    // the next scratch, so entries are moved by swapping two vectors
+    EntryChunk* chunk = queue.acquire_chunk();
+    chunk->entries.swap(entries);
+    const size_t total = chunk->entries.size();
+    
+    while (!queue.try_publish(chunk)) {
+        // Queue full: every writer is behind, so wait rather than drop
+        if (!running_.load()) {
+            dropped_ += total;
+            queue.recycle(chunk);
+            entries.clear();
+            return 0;
+        }
+        ++backpressure_waits_;
+        hybrid_wait(queue.space_parker(),
+                    [&queue] { return !queue.full(); }, std::chrono::milliseconds(100));
+    }
+    
+    entries.clear();
+    return total;
+}
+
+size_t RedisConsumer::drain_reads(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    // Pages already fetched are dispatched too; the rest stays pending
+    stop_recovery();
+    size_t count = dispatch_recovered(buffers);
+    while (config_.raw_replies && inflight_reads_ > 0 && redis_read_) {
+        if (next_raw_reply(true) != RespStatus::kOk) break;
+        --inflight_reads_;
+        read_sent_.pop_front();
+        count += take_raw_reply(buffers);
+    }
+    while (inflight_reads_ > 0) {
+        redisReply* reply = nullptr;
+        if (redisGetReply(redis_read_, reinterpret_cast<void**>(&reply)) != REDIS_OK) {
+            inflight_reads_ = 0;
+            read_sent_.clear();
+            break;
+        }
+        --inflight_reads_;
+        read_sent_.pop_front();
+        if (reply->type == REDIS_REPLY_ARRAY) {
+            count += dispatch_reply(reply, buffers);
+        }
+        freeReplyObject(reply);
+    }
+    messages_read_ += count;
+    return count;
+}
+
+// Message array of an XREADGROUP reply (single stream), or nullptr if empty
+static redisReply* stream_messages(redisReply* reply) {
+    if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) return nullptr;
+    
+    redisReply* stream = reply->element[0];
+    if (!stream || stream->type != REDIS_REPLY_ARRAY || stream->elements < 2) return nullptr;
+    
+    redisReply* messages = stream->element[1];
+    if (!messages || messages->type != REDIS_REPLY_ARRAY || messages->elements == 0) return nullptr;
+    return messages;
+}
+
+size_t RedisConsumer::dispatch_reply(redisReply* reply, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    redisReply* messages = stream_messages(reply);
+    return messages ? dispatch_messages(messages, buffers) : 0;
+}
+
+size_t RedisConsumer::dispatch_raw(const char* data, size_t len, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    size_t consumed = 0;
+    if (scan_stream_reply(data, len, entries_, consumed) != RespStatus::kOk) return 0;
+    return dispatch_entries(entries_, buffers);
+}
+
+size_t RedisConsumer::dispatch_messages(redisReply* messages, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    if (messages->type != REDIS_REPLY_ARRAY || messages->elements == 0) return 0;
     
-    entry.app_id = extract_json_value(json, "appId");
-    if (entry.app_id.empty()) entry.app_id = "unknown";
+    // Slices of the tree, as scan_stream_reply produces them from raw bytes
+    entries_.clear();
+    for (size_t i = 0; i < messages->elements; ++i) {
+        redisReply* msg = messages->element[i];
+        if (!msg || msg->type != REDIS_REPLY_ARRAY || msg->elements < 2) continue;
+        
+        redisReply* idReply = msg->element[0];
+        if (!idReply || !idReply->str) continue;
+        
+        redisReply* fields = msg->element[1];
+        if (!fields || fields->type != REDIS_REPLY_ARRAY || fields->elements < 2) continue;
+        
+        for (size_t j = 0; j < fields->elements - 1; j += 2) {
+            redisReply* keyReply = fields->element[j];
+            redisReply* valReply = fields->element[j + 1];
+            
+            if (!keyReply || !keyReply->str || !valReply || !valReply->str) continue;
+            
+            const std::string_view key(keyReply->str, keyReply->len);
+            if (key != "data" && key != "pb") continue;
+            entries_.push_back({std::string_view(idReply->str, idReply->len),
+                                std::string_view(valReply->str, valReply->len), key == "pb"});
+            break;  // One payload per stream entry
+        }
+    }
+    return dispatch_entries(entries_, buffers);
+}
+
+size_t RedisConsumer::dispatch_entries(const std::vector<StreamEntrySlice>& entries,
+                                       std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    if (entries.empty()) return 0;
+    const auto parse_started = std::chrono::steady_clock::now();
     
-    entry.message = extract_json_value(json, "message");
-    if (entry.message.empty()) entry.message = "empty";
+    // Size one arena for the whole reply: ids + payloads
+    // (decoded JSON text is never longer than its escaped form)
+    size_t arena_bytes = 0;
+    for (const StreamEntrySlice& entry : entries) arena_bytes += entry.id.size() + entry.value.size();
     
-    entry.source = extract_json_value(json, "source");
-    if (entry.source.empty()) entry.source = "unknown";
+    // Held while dispatching; entries take theirs once parsed
+    BatchArena* arena = BatchArena::create(arena_bytes, 1);
     
-    // Level must match ClickHouse Enum - default to INFO
-    entry.level = extract_json_value(json, "level");
-    if (entry.level.empty() || 
-        (entry.level != "DEBUG" && entry.level != "INFO" && 
-         entry.level != "WARN" && entry.level != "ERROR" && entry.level != "FATAL")) {
-        entry.level = "INFO";
+    parsed_.reserve(entries.size());
+    for (const StreamEntrySlice& entry : entries) {
+        try {
+            if (entry.proto) {
+                parse_proto_batch(entry.value.data(), entry.value.size(),
+                                  entry.id.data(), entry.id.size(), *arena);
+            } else {
+                parsed_.push_back(parse_message(entry.value.data(), entry.value.size(),
+                                                entry.id.data(), entry.id.size(), *arena));
+            }
+        } catch (const std::exception& e) {
+            // Fails the same way on every redelivery, so it leaves the PEL
+            ++parse_errors_;
+            dead_letter(write_connection(), entry.id, entry.proto ? "pb" : "data", entry.value, e.what());
+        }
     }
     
-    entry.environment = extract_json_value(json, "environment");
-    if (entry.environment.empty()) entry.environment = "development";
+    metrics().parse.record(std::chrono::steady_clock::now() - parse_started);
+    if (memory_budget().enabled()) admit(*arena);
+    const size_t parsed = parsed_.size();
+    arena->retain(parsed);
+    size_t count = parsed == 0 ? 0 : publish(parsed_, buffers);
     
-    entry.trace_id = extract_json_value(json, "traceId");
-    entry.user_id = extract_json_value(json, "userId");
+    // Return the refs of entries that were not published, and our own
+    arena->release(parsed - count + 1);
+    return count;
+}
+
+redisContext* RedisConsumer::write_connection() {
+    // Reconnect once a failed command left the context unusable
+    if (redis_write_ && redis_write_->err) {
+        redisFree(redis_write_);
+        redis_write_ = connect_redis(config_, "Write");
+    }
+    return redis_write_;
+}
+
+bool RedisConsumer::dead_letter(redisContext* ctx, std::string_view id, std::string_view field,
+                                std::string_view value, std::string_view reason) {
+    if (!ctx) return false;  // Recorded replies (benchmarks) have no connection
     
-    std::string metadata = extract_json_value(json, "metadataString");
-    entry.metadata = metadata.empty() ? "{}" : metadata;
+    auto command = [&](int argc, const char** argv, const size_t* argvlen) {
+        redisReply* reply = static_cast<redisReply*>(redisCommandArgv(ctx, argc, argv, argvlen));
+        const bool ok = reply && reply->type != REDIS_REPLY_ERROR;
+        if (!ok) {
+            INGESTER_LOG_EVERY(LogLevel::kError, "redis", 1) << argv[0] << " of dead-lettered entry " << id << " failed: "
+                                                             << (reply ? reply->str : ctx->errstr);
+        }
+        if (reply) freeReplyObject(reply);
+        return ok;
+    };
     
-    return entry;
+    // XACK only once the copy is stored, so a failure loses nothing
+    if (!config_.dead_letter_suffix.empty()) {
+        const std::string dlq = stream_key_ + config_.dead_letter_suffix;
+        const char* argv[] = {"XADD", dlq.c_str(), "*", "id", id.data(), "error", reason.data(),
+                              field.data(), value.data()};
+        const size_t argvlen[] = {4, dlq.size(), 1, 2, id.size(), 5, reason.size(), field.size(), value.size()};
+        if (!command(9, argv, argvlen)) return false;
+    }
+    const char* argv[] = {"XACK", stream_key_.c_str(), config_.group_name.c_str(), id.data()};
+    const size_t argvlen[] = {4, stream_key_.size(), config_.group_name.size(), id.size()};
+    if (!command(4, argv, argvlen)) return false;
+    
+    ++dead_lettered_;
+    INGESTER_LOG_EVERY(LogLevel::kWarn, "redis", 10) << "dead-lettered " << id << " on " << stream_key_ << ": " << reason;
+    return true;
 }
 
-void RedisConsumer::ack_batch(const std::vector<std::string>& ids) {
-    if (ids.empty()) return;
+// Copy (and unescape) a scanned slice into the arena, or fall back when missing or empty
+static std::string_view decode_field(const JsonSlice& slice, BatchArena& arena, std::string_view fallback) {
+    if (!slice.present || slice.len == 0) return fallback;
+    if (!slice.escaped) return arena.copy(slice.data, slice.len);
     
-    // Use write connection with lock
-    std::lock_guard<std::mutex> lock(write_mutex_);
+    char* dst = arena.allocate(slice.len);
+    size_t len = 0;
+    if (!unescape_json(slice, dst, len)) {
+        throw std::runtime_error("invalid JSON escape sequence");
+    }
+    return len > 0 ? std::string_view(dst, len) : fallback;
+}
+
+// Low-cardinality field: a view into the reader's intern table when it has
+// room, else an arena copy like decode_field
+static std::string_view intern_field(const JsonSlice& slice, BatchArena& arena, std::string_view fallback,
+                                     InternTable& table, Symbol& symbol) {
+    const bool raw = slice.present && slice.len > 0 && !slice.escaped;
+    std::string_view value = raw ? std::string_view(slice.data, slice.len) : decode_field(slice, arena, fallback);
+    InternTable::Interned interned = table.intern(value);
+    symbol = interned.symbol;
+    if (symbol != kNoSymbol) return interned.value;
+    return raw ? arena.copy(value.data(), value.size()) : value;
+}
+
+// Level must match ClickHouse Enum - default to INFO
+static int8_t normalize_level(const JsonSlice& slice) {
+    if (slice.present && !slice.escaped) {
+        std::string_view level(slice.data, slice.len);
+        for (size_t i = 0; i < std::size(kLogLevels); ++i) {
+            if (level == kLogLevels[i]) return static_cast<int8_t>(i + 1);
+        }
+    }
+    return kLevelInfo;
+}
+
+Uuid RedisConsumer::next_uuid(int64_t unix_ms, std::string_view stream_id, uint32_t row) {
+    if (config_.deterministic_ids) return stream_uuid_v7(unix_ms, stream_seed_, stream_id, row);
+    uint64_t a = splitmix64(uuid_state_);
+    uint64_t b = splitmix64(uuid_state_);
+    return make_uuid_v7(unix_ms, a, b);
+}
+
+LogEntry RedisConsumer::parse_message(const char* json_data, size_t len,
+                                      const char* msg_id, size_t id_len, BatchArena& arena) {
+    // Single pass over the payload, no intermediate copy
+    LogFieldSlices fields;
+    if (!scan_log_fields(json_data, len, fields)) {
+        throw std::runtime_error("malformed JSON payload");
+    }
     
-    std::vector<const char*> argv;
-    std::vector<size_t> argvlen;
+    LogEntry entry;
+    entry.arena = &arena;
+    entry.reader_id = reader_id_;
+    entry.redis_id = arena.copy(msg_id, id_len);
+    // JSON payloads carry no event time; the stream ID is the closest to it
+    entry.timestamp_ms = stream_id_millis(msg_id, id_len);
+    entry.id = next_uuid(entry.timestamp_ms, entry.redis_id, 0);
     
-    argv.push_back("XACK");
-    argvlen.push_back(4);
+    entry.app_id = intern_field(fields.app_id, arena, "unknown", symbols_, entry.app_id_symbol);
+    entry.message = decode_field(fields.message, arena, "empty");
+    entry.source = intern_field(fields.source, arena, "unknown", symbols_, entry.source_symbol);
+    entry.level = normalize_level(fields.level);
+    entry.environment = intern_field(fields.environment, arena, "development", symbols_, entry.environment_symbol);
+    entry.trace_id = decode_field(fields.trace_id, arena, {});
+    entry.user_id = decode_field(fields.user_id, arena, {});
+    entry.metadata = decode_field(fields.metadata, arena, "{}");
     
-    argv.push_back(config_.stream_key.c_str());
-    argvlen.push_back(config_.stream_key.size());
+    return entry;
+}
+
+// Metadata map -> JSON object text for the metadata column, in wire order
+static std::string_view encode_metadata(const ProtoLogFields& fields, BatchArena& arena) {
+    if (fields.metadata.empty()) return "{}";
     
-    argv.push_back(config_.group_name.c_str());
-    argvlen.push_back(config_.group_name.size());
+    size_t size = 2;
+    for (const auto& [key, value] : fields.metadata) {
+        size += escaped_json_length(key.data(), key.size()) +
+                escaped_json_length(value.data(), value.size()) + 6;  // "":"",
+    }
     
-    for (const auto& id : ids) {
-        argv.push_back(id.c_str());
-        argvlen.push_back(id.size());
+    char* out = arena.allocate(size);
+    char* w = out;
+    *w++ = '{';
+    for (size_t i = 0; i < fields.metadata.size(); ++i) {
+        const auto& [key, value] = fields.metadata[i];
+        if (i > 0) *w++ = ',';
+        *w++ = '"';
+        w = escape_json(key.data(), key.size(), w);
+        *w++ = '"';
+        *w++ = ':';
+        *w++ = '"';
+        w = escape_json(value.data(), value.size(), w);
+        *w++ = '"';
+    }
+    *w++ = '}';
+    return {out, static_cast<size_t>(w - out)};
+}
+
+static std::string_view copy_or(std::string_view value, BatchArena& arena, std::string_view fallback) {
+    return value.empty() ? fallback : arena.copy(value.data(), value.size());
+}
+
+static std::string_view intern_or(std::string_view value, BatchArena& arena, std::string_view fallback,
+                                  InternTable& table, Symbol& symbol) {
+    if (value.empty()) value = fallback;
+    InternTable::Interned interned = table.intern(value);
+    symbol = interned.symbol;
+    if (symbol != kNoSymbol) return interned.value;
+    return value.data() == fallback.data() ? fallback : arena.copy(value.data(), value.size());
+}
+
+size_t RedisConsumer::parse_proto_batch(const char* data, size_t len,
+                                        const char* msg_id, size_t id_len, BatchArena& arena) {
+    proto_entries_.clear();
+    if (!scan_proto_batch(data, len, proto_entries_)) {
+        throw std::runtime_error("malformed LogEntryBatch payload");
+    }
+    if (proto_entries_.empty()) {
+        throw std::runtime_error("empty LogEntryBatch");
+    }
+    // Scan all entries before emitting any, so a bad batch adds nothing
+    const size_t first = parsed_.size();
+    const int64_t received_ms = stream_id_millis(msg_id, id_len);
+    const std::string_view stream_id(msg_id, id_len);
+    uint32_t row = 0;
+    for (std::string_view bytes : proto_entries_) {
+        if (!scan_proto_log(bytes.data(), bytes.size(), proto_fields_)) {
+            parsed_.resize(first);
+            throw std::runtime_error("malformed LogEntry in batch");
+        }
+        
+        LogEntry entry;
+        entry.arena = &arena;
+        entry.reader_id = reader_id_;
+        entry.timestamp_ms = proto_fields_.timestamp_ms > 0 ? proto_fields_.timestamp_ms : received_ms;
+        if (!parse_uuid(proto_fields_.id, entry.id)) {
+            entry.id = next_uuid(entry.timestamp_ms, stream_id, row);
+        }
+        ++row;
+        
+        // Defaults follow the proto contract (proto/logs/log-entry.proto)
+        entry.app_id = intern_or(proto_fields_.app_id, arena, "unknown", symbols_, entry.app_id_symbol);
+        entry.message = copy_or(proto_fields_.message, arena, "empty");
+        entry.source = intern_or(proto_fields_.source, arena, "unknown", symbols_, entry.source_symbol);
+        entry.level = log_level_enum8(proto_fields_.level);
+        entry.environment = intern_or(proto_fields_.environment, arena, "prod", symbols_, entry.environment_symbol);
+        entry.trace_id = copy_or(proto_fields_.trace_id, arena, {});
+        entry.user_id = copy_or(proto_fields_.user_id, arena, {});
+        entry.metadata = encode_metadata(proto_fields_, arena);
+        parsed_.push_back(entry);
     }
     
-    redisReply* reply = static_cast<redisReply*>(redisCommandArgv(
-        redis_write_,
-        static_cast<int>(argv.size()),
-        argv.data(),
-        argvlen.data()
-    ));
+    const size_t count = parsed_.size() - first;
+    if (count > 0) parsed_.back().redis_id = arena.copy(msg_id, id_len);
+    return count;
+}
+
+// Stream IDs "<ms>-<seq>" in numeric order
+static std::pair<uint64_t, uint64_t> stream_id_order(const char* id, size_t len) {
+    uint64_t ms = 0, seq = 0;
+    size_t i = 0;
+    for (; i < len && id[i] >= '0' && id[i] <= '9'; ++i) ms = ms * 10 + (id[i] - '0');
+    for (++i; i < len && id[i] >= '0' && id[i] <= '9'; ++i) seq = seq * 10 + (id[i] - '0');
+    return {ms, seq};
+}
+
+bool RedisConsumer::start_recovery() {
+    if (recovery_thread_.joinable()) return true;
     
-    if (reply) {
-        freeReplyObject(reply);
+    // Newest pending ID of the group: anything live reads deliver from now
+    // on is newer, so own-PEL recovery stops there
+    // XPENDING summary: [count, min id, max id, [[consumer, count]...]]
+    pel_bound_.clear();
+    if (redisContext* ctx = write_connection()) {
+        redisReply* reply = static_cast<redisReply*>(redisCommand(
+            ctx, "XPENDING %s %s", stream_key_.c_str(), config_.group_name.c_str()));
+        if (reply && reply->type == REDIS_REPLY_ARRAY && reply->elements >= 3 &&
+            reply->element[2]->type == REDIS_REPLY_STRING) {
+            pel_bound_.assign(reply->element[2]->str, reply->element[2]->len);
+        } else if (!reply || reply->type == REDIS_REPLY_ERROR) {
+            // Unknown bound: skip own-PEL paging rather than re-send live entries;
+            // XAUTOCLAIM still picks those entries up once they are idle
+            LOG_ERROR("recovery") << "XPENDING failed: " << (reply && reply->str ? reply->str : ctx->errstr);
+        }
+        if (reply) freeReplyObject(reply);
+    }
+    
+    recovering_.store(true);
+    recovery_thread_ = std::thread(&RedisConsumer::recovery_thread, this);
+    return true;
+}
+
+void RedisConsumer::stop_recovery() {
+    recovering_.store(false);
+    if (recovery_thread_.joinable()) recovery_thread_.join();
+}
+
+bool RedisConsumer::hand_off(redisReply* reply, redisReply* messages) {
+    while (!recovered_.try_push(RecoveredPage{reply, messages})) {
+        if (!recovering_.load()) {
+            freeReplyObject(reply);
+            return false;
+        }
+        recovered_.wait_for_space(std::chrono::milliseconds(100));
+    }
+    return true;
+}
+
+size_t RedisConsumer::dispatch_recovered(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    // At most one ring's worth per call, so live reads keep moving
+    size_t count = 0;
+    for (size_t n = recovered_.capacity(); n > 0; --n) {
+        auto page = recovered_.try_pop();
+        if (!page) break;
+        count += dispatch_messages(page->messages, buffers);
+        freeReplyObject(page->reply);
+    }
+    messages_read_ += count;
+    messages_recovered_ += count;
+    return count;
+}
+
+void RedisConsumer::note_deferred(std::string_view id) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(deferrals_mutex_);
+    if (deferrals_.size() >= kMaxDeferrals) {
+        for (auto it = deferrals_.begin(); it != deferrals_.end();) {
+            it = it->second.admitted ? deferrals_.erase(it) : std::next(it);
+        }
     }
+    auto it = deferrals_.find(std::string(id));
+    if (it != deferrals_.end()) {
+        it->second.admitted = false;
+    } else if (deferrals_.size() < kMaxDeferrals) {
+        deferrals_.emplace(std::string(id), Deferral{});
+    } else {
+        INGESTER_LOG_EVERY(LogLevel::kWarn, "redis", 1) << kMaxDeferrals
+            << " entries deferred by the app budget; further redeliveries count toward MAX_DELIVERIES";
+    }
+    deferral_count_.store(deferrals_.size(), std::memory_order_relaxed);
 }
 
-size_t RedisConsumer::recover_pending(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
-    if (buffers.empty()) return 0;
+void RedisConsumer::note_admitted(std::string_view id) {
+    if (id.empty()) return;
+    std::lock_guard<std::mutex> lock(deferrals_mutex_);
+    auto it = deferrals_.find(std::string(id));
+    if (it != deferrals_.end()) it->second.admitted = true;
+}
 
-    // Can use read connection here safely since main loop hasn't started
-    // OR use write connection. Let's use read connection to keep "reading" logic together.
+void RedisConsumer::dead_letter_redelivered(redisContext* ctx, redisReply* messages) {
+    if (config_.max_deliveries <= 0) return;
     
-    std::string count_str = std::to_string(config_.read_batch_size);
+    // Delivery counts, one pipelined XPENDING <id> <id> 1 per entry:
+    // [[id, consumer, idle ms, deliveries]]
+    std::vector<size_t> asked;
+    for (size_t i = 0; i < messages->elements; ++i) {
+        redisReply* msg = messages->element[i];
+        if (!msg || msg->type != REDIS_REPLY_ARRAY || msg->elements < 1 || !msg->element[0]->str) continue;
+        const redisReply* id = msg->element[0];
+        const char* argv[] = {"XPENDING", stream_key_.c_str(), config_.group_name.c_str(), id->str, id->str, "1"};
+        const size_t argvlen[] = {8, stream_key_.size(), config_.group_name.size(), id->len, id->len, 1};
+        if (redisAppendCommandArgv(ctx, 6, argv, argvlen) != REDIS_OK) break;
+        asked.push_back(i);
+    }
+    std::vector<std::pair<size_t, long long>> over;
+    for (size_t i : asked) {
+        void* raw = nullptr;
+        if (redisGetReply(ctx, &raw) != REDIS_OK) return;  // Broken connection: the caller's next command reports it
+        redisReply* reply = static_cast<redisReply*>(raw);
+        if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 1 &&
+            reply->element[0]->type == REDIS_REPLY_ARRAY && reply->element[0]->elements >= 4 &&
+            reply->element[0]->element[3]->type == REDIS_REPLY_INTEGER) {
+            over.push_back({i, reply->element[0]->element[3]->integer});
+        }
+        freeReplyObject(reply);
+    }
     
-    const char* argv[] = {
-        "XREADGROUP", "GROUP",
-        config_.group_name.c_str(),
-        config_.consumer_name.c_str(),
-        "COUNT", count_str.c_str(),
-        "STREAMS", config_.stream_key.c_str(),
-        "0"
-    };
-    size_t argvlen[] = {
-        10, 5,
-        config_.group_name.size(),
-        config_.consumer_name.size(),
-        5, count_str.size(),
-        7, config_.stream_key.size(),
-        1
-    };
+    // Deliveries while deferred by the app budget are not failures: up to
+    // now they are written off, and only later ones count
+    {
+        std::lock_guard<std::mutex> lock(deferrals_mutex_);
+        for (auto& [i, deliveries] : over) {
+            if (deferrals_.empty()) break;
+            const redisReply* id = messages->element[i]->element[0];
+            auto it = deferrals_.find(std::string(id->str, id->len));
+            if (it == deferrals_.end()) continue;
+            if (!it->second.admitted) it->second.deliveries = deliveries;
+            deliveries -= it->second.deliveries;
+        }
+    }
+    over.erase(std::remove_if(over.begin(), over.end(),
+                              [this](const auto& entry) { return entry.second <= config_.max_deliveries; }),
+               over.end());
     
-    redisReply* reply = static_cast<redisReply*>(redisCommandArgv(
-        redis_read_, 9, argv, argvlen
-    ));
+    for (const auto& [i, deliveries] : over) {
+        redisReply* msg = messages->element[i];
+        std::string_view field = "data", value = "";
+        redisReply* fields = msg->elements > 1 ? msg->element[1] : nullptr;
+        for (size_t j = 0; fields && fields->type == REDIS_REPLY_ARRAY && j + 1 < fields->elements; j += 2) {
+            const redisReply* key = fields->element[j];
+            const redisReply* val = fields->element[j + 1];
+            if (!key->str || !val->str) continue;
+            const std::string_view name(key->str, key->len);
+            if (name != "data" && name != "pb") continue;
+            field = name;
+            value = std::string_view(val->str, val->len);
+            break;
+        }
+        const std::string reason = "delivered " + std::to_string(deliveries) + " times";
+        if (dead_letter(ctx, std::string_view(msg->element[0]->str, msg->element[0]->len), field, value, reason)) {
+            freeReplyObject(msg);
+            messages->element[i] = nullptr;
+        }
+    }
+}
+
+void RedisConsumer::recovery_thread() {
+    redisContext* ctx = connect_redis(config_, "Recovery");
+    if (!ctx) return;
     
-    size_t count = 0;
-    if (!reply || reply->type == REDIS_REPLY_NIL || reply->type != REDIS_REPLY_ARRAY) {
-        if (reply) freeReplyObject(reply);
-        return 0;
+    const std::string count_str = std::to_string(config_.read_batch_size);
+    size_t own = 0;
+    
+    // 1. Our own PEL, page by page: entries delivered before a crash
+    // With an explicit ID, XREADGROUP returns pending entries after it.
+    // Entries past pel_bound_ came from live reads and are left to them.
+    std::string last_id = "0";
+    const auto bound = stream_id_order(pel_bound_.data(), pel_bound_.size());
+    bool past_bound = pel_bound_.empty();
+    while (!past_bound && recovering_.load()) {
+        const char* argv[] = {
+            "XREADGROUP", "GROUP", config_.group_name.c_str(), consumer_name_.c_str(),
+            "COUNT", count_str.c_str(), "STREAMS", stream_key_.c_str(), last_id.c_str()
+        };
+        size_t argvlen[] = {
+            10, 5, config_.group_name.size(), consumer_name_.size(),
+            5, count_str.size(), 7, stream_key_.size(), last_id.size()
+        };
+        redisReply* reply = static_cast<redisReply*>(redisCommandArgv(ctx, 9, argv, argvlen));
+        redisReply* messages = stream_messages(reply);
+        if (!messages) {
+            if (!reply) {
+                LOG_ERROR("recovery") << "XREADGROUP failed: " << ctx->errstr;
+            }
+            if (reply) freeReplyObject(reply);
+            break;
+        }
+        
+        redisReply* last = messages->element[messages->elements - 1];
+        if (!last || last->type != REDIS_REPLY_ARRAY || last->elements < 1 ||
+            !last->element[0] || !last->element[0]->str) {
+            freeReplyObject(reply);
+            break;
+        }
+        last_id.assign(last->element[0]->str, last->element[0]->len);
+        size_t kept = messages->elements;
+        for (size_t i = 0; i < messages->elements; ++i) {
+            redisReply* msg = messages->element[i];
+            if (!msg || msg->type != REDIS_REPLY_ARRAY || msg->elements < 1 || !msg->element[0]->str) continue;
+            if (stream_id_order(msg->element[0]->str, msg->element[0]->len) > bound) {
+                kept = i;
+                break;
+            }
+        }
+        if (kept < messages->elements) {
+            for (size_t i = kept; i < messages->elements; ++i) {
+                freeReplyObject(messages->element[i]);
+                messages->element[i] = nullptr;
+            }
+            messages->elements = kept;
+            past_bound = true;
+        }
+        if (kept == 0) {
+            freeReplyObject(reply);
+            break;
+        }
+        own += messages->elements;
+        dead_letter_redelivered(ctx, messages);
+        if (!hand_off(reply, messages)) break;
+    }
+    if (own > 0) {
+        LOG_INFO("recovery") << own << " pending messages of " << consumer_name_ << " on " << stream_key_;
     }
     
-    if (reply->elements > 0) {
-        redisReply* stream = reply->element[0];
-        if (stream && stream->type == REDIS_REPLY_ARRAY && stream->elements >= 2) {
-            redisReply* messages = stream->element[1];
-            if (messages && messages->type == REDIS_REPLY_ARRAY) {
-                for (size_t i = 0; i < messages->elements; ++i) {
-                    redisReply* msg = messages->element[i];
-                    if (!msg || msg->type != REDIS_REPLY_ARRAY || msg->elements < 2) continue;
-                    
-                    redisReply* idReply = msg->element[0];
-                    if (!idReply || !idReply->str) continue;
-                    
-                    const char* msg_id = idReply->str;
-                    redisReply* fields = msg->element[1];
-                    
-                    if (fields && fields->type == REDIS_REPLY_ARRAY && fields->elements >= 2) {
-                        for (size_t j = 0; j < fields->elements - 1; j += 2) {
-                            redisReply* keyReply = fields->element[j];
-                            redisReply* valReply = fields->element[j + 1];
-                            
-                            if (!keyReply || !keyReply->str || !valReply || !valReply->str) continue;
-                            
-                            if (strcmp(keyReply->str, "data") == 0) {
-                                try {
-                                    LogEntry entry = parse_message(valReply->str, valReply->len, msg_id);
-                                    
-                                    // Round-robin
-                                    bool pushed = false;
-                                    size_t start_idx = current_buffer_idx_;
-                                    
-                                    do {
-                                        if (buffers[current_buffer_idx_]->try_push(std::move(entry))) {
-                                            pushed = true;
-                                            current_buffer_idx_ = (current_buffer_idx_ + 1) % buffers.size();
-                                            ++count;
-                                            break;
-                                        }
-                                        current_buffer_idx_ = (current_buffer_idx_ + 1) % buffers.size();
-                                    } while (current_buffer_idx_ != start_idx);
-                                    
-                                } catch (...) {
-                                    ++parse_errors_;
-                                }
-                            }
-                        }
-                    }
-                }
+    // 2. Entries idle at other consumers (crashed pods, removed readers),
+    // swept periodically. XAUTOCLAIM moves them to us atomically, so
+    // readers of several ingesters never claim the same entry twice.
+    const int min_idle_ms = config_.claim_min_idle_ms;
+    const std::string min_idle_str = std::to_string(min_idle_ms);
+    while (min_idle_ms > 0 && recovering_.load()) {
+        std::string cursor = "0-0";
+        size_t claimed = 0;
+        do {
+            const char* argv[] = {
+                "XAUTOCLAIM", stream_key_.c_str(), config_.group_name.c_str(), consumer_name_.c_str(),
+                min_idle_str.c_str(), cursor.c_str(), "COUNT", count_str.c_str()
+            };
+            size_t argvlen[] = {
+                10, stream_key_.size(), config_.group_name.size(), consumer_name_.size(),
+                min_idle_str.size(), cursor.size(), 5, count_str.size()
+            };
+            redisReply* reply = static_cast<redisReply*>(redisCommandArgv(ctx, 8, argv, argvlen));
+            
+            // [next cursor, [entries...], [deleted ids...] (Redis 7)]
+            if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements < 2 ||
+                !reply->element[0]->str) {
+                // Redis < 6.2 has no XAUTOCLAIM: keep own-PEL recovery only
+                LOG_ERROR("recovery") << "XAUTOCLAIM failed: "
+                                      << (reply && reply->str ? reply->str : ctx->errstr);
+                if (reply) freeReplyObject(reply);
+                redisFree(ctx);
+                return;
             }
+            cursor.assign(reply->element[0]->str, reply->element[0]->len);
+            redisReply* messages = reply->element[1];
+            if (messages && messages->type == REDIS_REPLY_ARRAY && messages->elements > 0) {
+                claimed += messages->elements;
+                dead_letter_redelivered(ctx, messages);
+                if (!hand_off(reply, messages)) break;
+            } else {
+                freeReplyObject(reply);
+            }
+        } while (cursor != "0-0" && recovering_.load());
+        
+        if (claimed > 0) {
+            messages_claimed_ += claimed;
+            LOG_INFO("recovery") << consumer_name_ << " claimed " << claimed
+                                 << " idle messages on " << stream_key_;
+        }
+        
+        // Next sweep once anything left idle since has crossed the threshold
+        for (int waited = 0; waited < min_idle_ms && recovering_.load(); waited += 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
     }
     
-    if (reply) freeReplyObject(reply);
-    return count;
+    redisFree(ctx);
 }
 
-size_t RedisConsumer::get_stream_length() {
-    std::lock_guard<std::mutex> lock(write_mutex_);
+size_t RedisConsumer::read_range(std::string& cursor, size_t count, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers) {
+    // Exclusive start "(<id>" pages forward (Redis 6.2+)
+    const std::string start = cursor.empty() ? "-" : "(" + cursor;
+    const std::string count_str = std::to_string(count);
+    const char* argv[] = {"XRANGE", stream_key_.c_str(), start.c_str(), "+", "COUNT", count_str.c_str()};
+    size_t argvlen[] = {6, stream_key_.size(), start.size(), 1, 5, count_str.size()};
+    
+    redisReply* reply = static_cast<redisReply*>(redisCommandArgv(redis_write_, 6, argv, argvlen));
+    if (!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) {
+        if (reply) freeReplyObject(reply);
+        return 0;
+    }
     
+    redisReply* last = reply->element[reply->elements - 1];
+    if (last->type == REDIS_REPLY_ARRAY && last->elements > 0 && last->element[0]->str) {
+        cursor.assign(last->element[0]->str, last->element[0]->len);
+    }
+    size_t published = dispatch_messages(reply, buffers);
+    freeReplyObject(reply);
+    return published;
+}
+
+size_t RedisConsumer::get_stream_length() {
     redisReply* reply = static_cast<redisReply*>(redisCommand(
         redis_write_,
         "XLEN %s",
-        config_.stream_key.c_str()
+        stream_key_.c_str()
     ));
     
     size_t len = 0;
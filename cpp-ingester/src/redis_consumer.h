@@ -3,12 +3,25 @@
 #include "config.h"
 #include "log_entry.h"
 #include "ring_buffer.h"
+#include "batch_queue.h"
+#include "intern_table.h"
+#include "memory_budget.h"
+#include "proto_scanner.h"
+#include "resp_scanner.h"
+#include "router.h"
+#include "split_acks.h"
 
 #include <hiredis/hiredis.h>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <string>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace ingester {
 
@@ -16,16 +29,28 @@ namespace ingester {
  * Redis Stream Consumer using XREADGROUP
  * 
  * Optimizations:
- * - SIMD JSON parsing via simdjson
+ * - Single-pass SIMD JSON field scanning (AVX2/SSE2/NEON)
+ * - Protobuf `pb` field: one stream entry carries a whole LogEntryBatch
  * - Batch message reading
+ * - Pipelined XREADGROUP: next reads are on the wire while a reply is parsed
+ * - Replies scanned in place from our own socket buffer, without building
+ *   a hiredis reply tree (raw_replies)
+ * - Background crash recovery on its own connection: pages through the
+ *   whole PEL and XAUTOCLAIMs entries idle at dead consumers
  * - Automatic consumer group creation
- * - ACK batching
  */
 class RedisConsumer {
 public:
     using OnBatchCallback = std::function<void(std::vector<LogEntry>&&)>;
     
     explicit RedisConsumer(const Config& config);
+    
+    /**
+     * Consumer with its own identity, used when several readers share the
+     * group. `reader_id` is stamped on every entry so ACKs find their way back.
+     */
+    RedisConsumer(const Config& config, std::string consumer_name,
+                  std::string stream_key, uint16_t reader_id);
     ~RedisConsumer();
     
     // Non-copyable
@@ -44,36 +69,261 @@ public:
     size_t read_batch(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
     
     /**
-     * Acknowledge processed messages
+     * Wait for pipelined reads still in flight and dispatch their messages
+     * Call after the read loop stops so nothing delivered is left unparsed.
+     */
+    size_t drain_reads(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    
+    /**
+     * Event-loop reads, instead of read_batch: watch read_fd() for
+     * readability, call start_reads() once, then poll_reads() whenever the
+     * socket is readable (and now and then for recovered pages). It takes
+     * every complete reply already received, dispatches it as read_batch
+     * would and keeps the pipeline full; it never waits on the socket.
+     */
+    int read_fd() const { return redis_read_ ? redis_read_->fd : -1; }
+    bool start_reads();
+    size_t poll_reads(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers, bool readable);
+    bool read_failed() const { return !redis_read_ || redis_read_->err != 0; }
+    
+    /**
+     * Parse an XREADGROUP reply into one BatchArena and push its entries
+     * round-robin. Returns number of entries published.
+     * Needs no connection, so recorded replies can be fed in directly.
      */
-    void ack_batch(const std::vector<std::string>& ids);
+    size_t dispatch_reply(redisReply* reply, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
     
     /**
-     * Process pending messages (crash recovery)
+     * Same for the raw RESP bytes of one XREADGROUP reply (scan_stream_reply)
      */
-    size_t recover_pending(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    size_t dispatch_raw(const char* data, size_t len, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
     
     /**
-     * Get current stream length
+     * Start crash recovery alongside live reads
+     * A recovery thread with its own connection pages through this
+     * consumer's PEL from the start, up to the newest pending ID at the
+     * time of the call (call it before the first live read), then
+     * periodically XAUTOCLAIMs entries
+     * idle longer than claim_min_idle_ms at other consumers of the group.
+     * Fetched pages are parsed and published by read_batch on the reader
+     * thread, which stays the only producer on the rings.
+     */
+    bool start_recovery();
+    
+    /**
+     * Read up to `count` entries after `cursor` with XRANGE and push them
+     * like read_batch; `cursor` advances to the last ID read ("" = start).
+     * Nothing is delivered to or ACKed in the group (compression bench).
+     */
+    size_t read_range(std::string& cursor, size_t count, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    
+    /**
+     * Get current stream length (reader thread, or while it is stopped)
      */
     size_t get_stream_length();
     
+    /**
+     * Publish whole replies to a queue shared by all writers instead of
+     * the rings passed to read_batch (which may then be empty)
+     */
+    void set_shared_queue(BatchQueue* queue) { shared_queue_ = queue; }
+    
+    /**
+     * Split each reply by route: route k is published to the rings
+     * `buffers[ring_offsets[k] .. ring_offsets[k + 1])`, or to `queues[k]`
+     * when queues are given. Rows are routed one by one; a pb entry whose
+     * rows reach several routes is registered with `split_acks`, which
+     * holds its ID until every part is written.
+     */
+    void set_routes(const Router* router, std::vector<size_t> ring_offsets, std::vector<BatchQueue*> queues,
+                    SplitAcks* split_acks);
+    
+    /**
+     * Live writer counts, one per route (ClickHouseWriter::active_threads):
+     * only the first `*active[k]` rings of route k are published to, so a
+     * pool can be scaled without touching the rings
+     */
+    void set_writer_limits(std::vector<const std::atomic<int>*> active) { active_writers_ = std::move(active); }
+    
+    const std::string& consumer_name() const { return consumer_name_; }
+    const std::string& stream_key() const { return stream_key_; }
+    
+    // Stats
+    size_t messages_read() const { return messages_read_.load(); }
+    size_t parse_errors() const { return parse_errors_.load(); }
+    size_t dead_lettered() const { return dead_lettered_.load(); }
+    size_t backpressure_waits() const { return backpressure_waits_.load(); }
+    size_t dropped() const { return dropped_.load(); }
+    size_t messages_recovered() const { return messages_recovered_.load(); }
+    size_t messages_claimed() const { return messages_claimed_.load(); }
+    size_t budget_deferred() const { return budget_deferred_.load(); }
+    size_t split_entries() const { return split_entries_.load(); }
+    
     void stop() { running_.store(false); }
     bool is_running() const { return running_.load(); }
 
 private:
     bool ensure_consumer_group();
-    LogEntry parse_message(const char* json_data, size_t len, const char* msg_id);
+    
+    // A reply fetched by the recovery thread; `messages` points into `reply`
+    struct RecoveredPage {
+        redisReply* reply = nullptr;
+        redisReply* messages = nullptr;
+    };
+    
+    void recovery_thread();
+    bool hand_off(redisReply* reply, redisReply* messages);
+    
+    // Dead-letter the recovered entries delivered more than max_deliveries
+    // times and take them out of `messages` (their slots become null).
+    // Deliveries spent waiting on the app budget do not count.
+    void dead_letter_redelivered(redisContext* ctx, redisReply* messages);
+    
+    // Note an entry admit() left pending for the app budget, or let in
+    void note_deferred(std::string_view id);
+    void note_admitted(std::string_view id);
+    void stop_recovery();
+    size_t dispatch_recovered(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    
+    // Pipelined XREADGROUP
+    void build_read_command();
+    bool send_read();
+    bool flush_reads();
+    void top_up_reads(size_t depth);
+    redisReply* next_read_reply();
+    LogEntry parse_message(const char* json_data, size_t len,
+                           const char* msg_id, size_t id_len, BatchArena& arena);
+    
+    /**
+     * Decode a serialized LogEntryBatch into parsed_
+     * Only the last entry carries the stream ID, so the stream entry is
+     * ACKed once, after all of its logs are written.
+     */
+    size_t parse_proto_batch(const char* data, size_t len,
+                             const char* msg_id, size_t id_len, BatchArena& arena);
+    
+    // UUIDv7 for a row without a producer-supplied id: random, or derived
+    // from its stream entry and row with DETERMINISTIC_IDS
+    Uuid next_uuid(int64_t unix_ms, std::string_view stream_id, uint32_t row);
+    
+    // Same for a bare message array (XREADGROUP stream entry or XAUTOCLAIM)
+    size_t dispatch_messages(redisReply* messages, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    
+    // Parse stream entries into one BatchArena and publish them
+    size_t dispatch_entries(const std::vector<StreamEntrySlice>& entries,
+                            std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    
+    /**
+     * Move an entry that can never be inserted out of the PEL: XADD it to
+     * the dead-letter stream, then XACK it. False (entry left pending) if
+     * either command fails.
+     */
+    bool dead_letter(redisContext* ctx, std::string_view id, std::string_view field,
+                     std::string_view value, std::string_view reason);
+    redisContext* write_connection();
+    
+    /**
+     * Raw replies on redis_read_: hiredis writes the commands, replies are
+     * read into resp_buf_ and scanned there. next_raw_reply frames the
+     * reply at the head of the buffer into entries_; take_raw_reply
+     * dispatches and drops it.
+     */
+    bool fill_resp();
+    RespStatus next_raw_reply(bool block);
+    size_t take_raw_reply(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    size_t read_raw(std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    void fail_reads(int err, const char* what);
+    void reply_received();
+    
+    /**
+     * Bulk-push parsed entries across the rings; parks while all are full
+     * Returns entries published (less than all only if stopped while blocked).
+     */
+    size_t publish(std::vector<LogEntry>& entries, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    size_t publish_rings(std::vector<LogEntry>& entries, std::unique_ptr<LockFreeRingBuffer<LogEntry>>* rings,
+                         size_t ring_count, size_t& cursor);
+    size_t publish_shared(std::vector<LogEntry>& entries, BatchQueue& queue);
+    size_t publish_routed(std::vector<LogEntry>& entries, std::vector<std::unique_ptr<LockFreeRingBuffer<LogEntry>>>& buffers);
+    size_t live_rings(size_t route, size_t rings) const;
+    
+    /**
+     * Memory budget admission for parsed_: drops the stream entries whose
+     * app is over its share (they stay pending), waits while the global
+     * budget is used up, and charges the rest to `arena`
+     */
+    void admit(BatchArena& arena);
     
     const Config& config_;
+    const std::string consumer_name_;
+    const std::string stream_key_;
+    const uint16_t reader_id_;
+    uint64_t uuid_state_;
+    const uint64_t stream_seed_;        // stable_hash(stream_key_), for deterministic ids
     redisContext* redis_read_ = nullptr;
-    redisContext* redis_write_ = nullptr;
-    std::mutex write_mutex_;
+    redisContext* redis_write_ = nullptr;  // Setup, XRANGE and dead letters; reader thread only (ACKs: AckPipeline)
     std::atomic<bool> running_{true};
     
+    // Pre-built XREADGROUP argv (reader thread only)
+    std::vector<const char*> read_argv_;
+    std::vector<size_t> read_argvlen_;
+    std::string count_str_;
+    std::string block_str_;
+    size_t inflight_reads_{0};
+    std::deque<std::chrono::steady_clock::time_point> read_sent_;  // Send time per read in flight
+    std::vector<LogEntry> parsed_;      // Per-reply scratch, reused
+    std::vector<StreamEntrySlice> entries_;
+    std::vector<char> resp_buf_;        // Raw replies: read, not yet consumed bytes in [begin, end)
+    size_t resp_begin_ = 0;
+    size_t resp_end_ = 0;
+    size_t resp_reply_bytes_ = 0;       // Length of the reply framed by next_raw_reply
+    std::vector<std::string_view> proto_entries_;
+    ProtoLogFields proto_fields_;
+    InternTable symbols_;               // app_id / source / environment values seen by this reader
+    std::vector<MemoryBudget::Charge> charges_;                 // admit() scratch
+    std::array<size_t, MemoryBudget::kAppBuckets> app_pending_{};
+    BatchQueue* shared_queue_ = nullptr;
+    
+    // Routing (set_routes); per-route scratch and round-robin cursor
+    const Router* router_ = nullptr;
+    SplitAcks* split_acks_ = nullptr;
+    std::vector<size_t> route_rings_;
+    std::vector<BatchQueue*> route_queues_;
+    std::vector<std::vector<LogEntry>> route_entries_;
+    std::vector<size_t> row_routes_;        // publish_routed scratch: route of each row
+    std::vector<uint8_t> entry_routes_;     // Routes the current entry has a part on
+    std::vector<size_t> route_cursors_;
+    std::vector<const std::atomic<int>*> active_writers_;
+    
+    // Crash recovery: fetched on its own thread, dispatched by the reader.
+    // Own-PEL paging stops at pel_bound_, the newest pending ID before live
+    // reads start ("" = nothing pending), so it never re-sends live entries.
+    std::thread recovery_thread_;
+    std::atomic<bool> recovering_{false};
+    std::string pel_bound_;
+    
+    // Entries deferred by the app budget (admit, reader thread), with the
+    // deliveries they used up while deferred (dead_letter_redelivered,
+    // recovery thread). Bounded by kMaxDeferrals; admitted ones go first.
+    struct Deferral {
+        long long deliveries = 0;
+        bool admitted = false;
+    };
+    static constexpr size_t kMaxDeferrals = 1 << 16;
+    std::mutex deferrals_mutex_;
+    std::unordered_map<std::string, Deferral> deferrals_;
+    std::atomic<size_t> deferral_count_{0};
+    LockFreeRingBuffer<RecoveredPage> recovered_{8};
+    
     // Stats
     std::atomic<size_t> messages_read_{0};
     std::atomic<size_t> parse_errors_{0};
+    std::atomic<size_t> dead_lettered_{0};
+    std::atomic<size_t> backpressure_waits_{0};
+    std::atomic<size_t> dropped_{0};
+    std::atomic<size_t> messages_recovered_{0};
+    std::atomic<size_t> messages_claimed_{0};
+    std::atomic<size_t> budget_deferred_{0};
+    std::atomic<size_t> split_entries_{0};
     size_t current_buffer_idx_{0};
 };
 
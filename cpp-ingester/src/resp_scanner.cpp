@@ -0,0 +1,234 @@
+#include "resp_scanner.h"
+#include <cstdint>
+#include <cstring>
+
+namespace ingester {
+
+namespace {
+
+constexpr std::string_view kDataField = "data";
+constexpr std::string_view kProtoField = "pb";
+
+class Cursor {
+public:
+    Cursor(const char* data, size_t len) : begin_(data), p_(data), end_(data + len) {}
+
+    RespStatus status() const { return status_; }
+    char last_type() const { return last_type_; }
+    size_t offset() const { return static_cast<size_t>(p_ - begin_); }
+
+    /**
+     * Next "<type><text>\r\n" header, with RESP3 attributes skipped
+     * `n` is the parsed integer for length-prefixed and aggregate types.
+     */
+    bool header(char& type, int64_t& n) {
+        for (;;) {
+            if (!line(type, text_)) return false;
+            n = 0;
+            switch (type) {
+                case '$': case '=': case '!':
+                case '*': case '~': case '>': case '%': case '|':
+                    if (!number(text_, n)) return false;
+                    break;
+                default:
+                    break;
+            }
+            if (type != '|') return true;
+            for (int64_t i = 0; i < n * 2; ++i) {
+                if (!skip()) return false;
+            }
+        }
+    }
+
+    // Rest of a value whose header was read
+    bool skip_body(char type, int64_t n) {
+        switch (type) {
+            case '$': case '!': case '=': {
+                std::string_view ignored;
+                return n < 0 || bulk(n, ignored);
+            }
+            case '*': case '~': case '>': case '%': {
+                const int64_t elements = type == '%' ? n * 2 : n;
+                for (int64_t i = 0; i < elements; ++i) {
+                    if (!skip()) return false;
+                }
+                return true;
+            }
+            case '+': case '-': case ':': case '_': case ',': case '#': case '(':
+                return true;
+            default:
+                return error();
+        }
+    }
+
+    bool skip() {
+        char type;
+        int64_t n;
+        return header(type, n) && skip_body(type, n);
+    }
+
+    // A string of any kind; nil and non-strings come back empty
+    bool string(std::string_view& out) {
+        char type;
+        int64_t n;
+        if (!header(type, n)) return false;
+        out = {};
+        switch (type) {
+            case '$':
+                return n < 0 || bulk(n, out);
+            case '=':
+                // Verbatim: "txt:" before the text
+                if (n >= 0 && !bulk(n, out)) return false;
+                if (out.size() >= 4) out.remove_prefix(4);
+                return true;
+            case '+':
+                out = text_;
+                return true;
+            default:
+                return skip_body(type, n);
+        }
+    }
+
+    // Aggregate header as an element count: maps count keys and values, nil is -1
+    bool aggregate(int64_t& count, bool& is_aggregate) {
+        char type;
+        int64_t n;
+        if (!header(type, n)) return false;
+        last_type_ = type;
+        is_aggregate = type == '*' || type == '%' || type == '~';
+        if (type == '_' || (is_aggregate && n < 0)) {
+            is_aggregate = true;
+            count = -1;
+            return true;
+        }
+        if (!is_aggregate) {
+            count = 0;
+            return skip_body(type, n);
+        }
+        count = type == '%' ? n * 2 : n;
+        return true;
+    }
+
+private:
+    bool incomplete() {
+        if (status_ == RespStatus::kOk) status_ = RespStatus::kIncomplete;
+        return false;
+    }
+
+    bool error() {
+        status_ = RespStatus::kError;
+        return false;
+    }
+
+    bool line(char& type, std::string_view& text) {
+        if (status_ != RespStatus::kOk) return false;
+        if (p_ >= end_) return incomplete();
+        const char* cr = static_cast<const char*>(std::memchr(p_, '\r', static_cast<size_t>(end_ - p_)));
+        if (!cr || cr + 1 >= end_) return incomplete();
+        if (cr[1] != '\n' || cr == p_) return error();
+        type = *p_;
+        text = std::string_view(p_ + 1, static_cast<size_t>(cr - p_ - 1));
+        p_ = cr + 2;
+        return true;
+    }
+
+    bool number(std::string_view text, int64_t& n) {
+        size_t i = 0;
+        const bool negative = !text.empty() && text[0] == '-';
+        if (negative) ++i;
+        if (i == text.size()) return error();
+        n = 0;
+        for (; i < text.size(); ++i) {
+            if (text[i] < '0' || text[i] > '9') return error();
+            n = n * 10 + (text[i] - '0');
+        }
+        if (negative) n = -n;
+        return true;
+    }
+
+    bool bulk(int64_t n, std::string_view& out) {
+        if (end_ - p_ < n + 2) return incomplete();
+        if (p_[n] != '\r' || p_[n + 1] != '\n') return error();
+        out = std::string_view(p_, static_cast<size_t>(n));
+        p_ += n + 2;
+        return true;
+    }
+
+    const char* const begin_;
+    const char* p_;
+    const char* const end_;
+    std::string_view text_;
+    RespStatus status_ = RespStatus::kOk;
+    char last_type_ = 0;
+};
+
+// [id, [field, value, ...]]; false only when the cursor stopped
+bool scan_entry(Cursor& c, std::vector<StreamEntrySlice>& out) {
+    int64_t count;
+    bool is_aggregate;
+    if (!c.aggregate(count, is_aggregate)) return false;
+    if (!is_aggregate || count < 1) return true;
+
+    StreamEntrySlice entry;
+    if (!c.string(entry.id)) return false;
+    bool found = false;
+    if (count >= 2) {
+        int64_t fields;
+        bool fields_aggregate;
+        if (!c.aggregate(fields, fields_aggregate)) return false;
+        for (int64_t i = 0; i + 1 < fields; i += 2) {
+            std::string_view key;
+            if (!c.string(key)) return false;
+            const bool data = key == kDataField;
+            if (found || (!data && key != kProtoField)) {
+                if (!c.skip()) return false;
+                continue;
+            }
+            if (!c.string(entry.value)) return false;
+            entry.proto = !data;
+            found = true;
+        }
+        if (fields > 0 && fields % 2 == 1 && !c.skip()) return false;
+    }
+    for (int64_t i = 2; i < count; ++i) {
+        if (!c.skip()) return false;
+    }
+    if (found && !entry.id.empty()) out.push_back(entry);
+    return true;
+}
+
+} // namespace
+
+RespStatus scan_stream_reply(const char* data, size_t len, std::vector<StreamEntrySlice>& out, size_t& consumed) {
+    out.clear();
+    Cursor c(data, len);
+
+    int64_t count;
+    bool is_aggregate;
+    if (!c.aggregate(count, is_aggregate)) return c.status();
+    // RESP2: one [key, entries] pair per stream; RESP3: key, entries, ... in a map
+    const bool flat = c.last_type() == '%';
+    if (flat) count /= 2;
+
+    for (int64_t s = 0; s < count; ++s) {
+        int64_t pair = 2;
+        bool pair_aggregate = true;
+        if (!flat && !c.aggregate(pair, pair_aggregate)) return c.status();
+        if (!pair_aggregate || pair < 2) continue;
+        if (!c.skip()) return c.status();       // Stream key
+
+        int64_t entries;
+        bool entries_aggregate;
+        if (!c.aggregate(entries, entries_aggregate)) return c.status();
+        for (int64_t i = 0; i < entries; ++i) {
+            if (!scan_entry(c, out)) return c.status();
+        }
+        for (int64_t i = 2; i < pair; ++i) {
+            if (!c.skip()) return c.status();
+        }
+    }
+    consumed = c.offset();
+    return RespStatus::kOk;
+}
+
+} // namespace ingester
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * One stream entry of a reply: its ID and first `data` or `pb` field
+ * Views into the scanned bytes (or the hiredis reply they came from).
+ */
+struct StreamEntrySlice {
+    std::string_view id;
+    std::string_view value;
+    bool proto = false;         // `pb` (LogEntryBatch) rather than `data` (JSON)
+};
+
+enum class RespStatus {
+    kOk,            // One whole reply scanned
+    kIncomplete,    // Needs more bytes; nothing consumed
+    kError          // Not RESP: the connection is out of sync
+};
+
+/**
+ * Zero-copy RESP2/RESP3 scanner for XREADGROUP replies
+ *
+ * Optimizations:
+ * - No redisReply tree: entries are sliced straight out of the socket
+ *   buffer into a reused vector, no allocation per element
+ * - Bulk strings are skipped by their length, never scanned
+ * - Only the first `data`/`pb` field of an entry is kept; the key match is
+ *   on length first
+ *
+ * Accepts [[stream, entries], ...] (RESP2) and {stream: entries} (RESP3);
+ * nil replies (BLOCK timeout) and error replies scan as zero entries.
+ * Entries without fields (deleted while pending) are left out.
+ * `out` is cleared first; `consumed` is the reply's length in bytes.
+ */
+RespStatus scan_stream_reply(const char* data, size_t len, std::vector<StreamEntrySlice>& out, size_t& consumed);
+
+} // namespace ingester
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "wait_strategy.h"
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <vector>
 #include <cstdint>
 #include <optional>
@@ -9,99 +13,199 @@ namespace ingester {
 
 /**
  * Lock-free Single-Producer Single-Consumer (SPSC) Ring Buffer
- * 
+ *
  * Optimizations:
  * - Cache-line padding to prevent false sharing
  * - Relaxed atomics where possible
  * - Batch operations to reduce atomic overhead
+ * - Each side caches the other side's index: the shared cache line is only
+ *   re-read when the cached value says the ring looks full/empty
+ * - Reserve/commit spans for in-place construction and consumption
+ * - Hybrid spin/yield/futex waits with producer<->consumer wakeups
+ *
+ * Indices run freely and are masked on access, so all `capacity()` slots
+ * are usable and size() is simply head - tail.
+ *
+ * Parkers may be shared between rings so one thread can wait on several:
+ * a writer shares its data parker across the rings it drains, a reader
+ * its space parker across the rings it fills.
  */
 template<typename T>
 class LockFreeRingBuffer {
 public:
-    explicit LockFreeRingBuffer(size_t capacity)
-        : capacity_(next_power_of_2(capacity))
+    /**
+     * Up to two contiguous runs of slots (the second one after wrap-around)
+     */
+    struct Span {
+        T* first = nullptr;
+        size_t first_len = 0;
+        T* second = nullptr;
+        size_t second_len = 0;
+
+        size_t size() const { return first_len + second_len; }
+        bool empty() const { return size() == 0; }
+        T& operator[](size_t i) { return i < first_len ? first[i] : second[i - first_len]; }
+    };
+
+    explicit LockFreeRingBuffer(size_t capacity, Parker* data_parker = nullptr,
+                                Parker* space_parker = nullptr)
+        : capacity_(next_power_of_2(std::max<size_t>(capacity, 2)))
         , mask_(capacity_ - 1)
         , buffer_(capacity_)
+        , data_parker_(data_parker ? data_parker : &own_data_parker_)
+        , space_parker_(space_parker ? space_parker : &own_space_parker_)
         , head_(0)
-        , tail_(0) 
+        , tail_(0)
     {}
-    
+
     /**
      * Try to push an item (producer side)
      * Returns false if buffer is full
      */
     bool try_push(T&& item) {
         const size_t head = head_.load(std::memory_order_relaxed);
-        const size_t next_head = (head + 1) & mask_;
-        
-        if (next_head == tail_.load(std::memory_order_acquire)) {
-            return false; // Buffer full
+
+        if (head - cached_tail_ == capacity_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ == capacity_) {
+                return false; // Buffer full
+            }
         }
-        
-        buffer_[head] = std::move(item);
-        head_.store(next_head, std::memory_order_release);
+
+        buffer_[head & mask_] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        data_parker_->notify();
         return true;
     }
-    
+
+    /**
+     * Move up to `count` items from `first` (producer side)
+     * One acquire/release pair for the whole run. Returns items pushed.
+     */
+    template<typename It>
+    size_t try_push_batch(It first, size_t count) {
+        Span span = reserve_write(count);
+        const size_t n = span.size();
+        for (size_t i = 0; i < n; ++i, ++first) {
+            span[i] = std::move(*first);
+        }
+        commit_write(n);
+        return n;
+    }
+
+    /**
+     * Producer side: claim up to `max` free slots for in-place construction
+     * Publish them with commit_write(); nothing is visible before that.
+     */
+    Span reserve_write(size_t max) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        size_t free_slots = capacity_ - (head - cached_tail_);
+        if (free_slots < max) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            free_slots = capacity_ - (head - cached_tail_);
+        }
+        return make_span(head, std::min(free_slots, max));
+    }
+
+    void commit_write(size_t count) {
+        if (count == 0) return;
+        head_.store(head_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        data_parker_->notify();
+    }
+
+    /**
+     * Consumer side: view up to `max` ready items in place
+     * Release the slots with commit_read(); items may be moved out first.
+     */
+    Span peek_read(size_t max) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t available = cached_head_ - tail;
+        if (available < max) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            available = cached_head_ - tail;
+        }
+        return make_span(tail, std::min(available, max));
+    }
+
+    void commit_read(size_t count) {
+        if (count == 0) return;
+        tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+        space_parker_->notify();
+    }
+
     /**
      * Try to pop an item (consumer side)
      * Returns nullopt if buffer is empty
      */
     std::optional<T> try_pop() {
-        const size_t tail = tail_.load(std::memory_order_relaxed);
-        
-        if (tail == head_.load(std::memory_order_acquire)) {
+        Span span = peek_read(1);
+        if (span.empty()) {
             return std::nullopt; // Buffer empty
         }
-        
-        T item = std::move(buffer_[tail]);
-        tail_.store((tail + 1) & mask_, std::memory_order_release);
+
+        T item = std::move(span[0]);
+        commit_read(1);
         return item;
     }
-    
+
     /**
      * Pop multiple items at once (reduces atomic operations)
      */
     size_t pop_batch(std::vector<T>& out, size_t max_count) {
-        const size_t tail = tail_.load(std::memory_order_relaxed);
-        const size_t head = head_.load(std::memory_order_acquire);
-        
-        if (tail == head) {
+        Span span = peek_read(max_count);
+        const size_t count = span.size();
+        if (count == 0) {
             return 0; // Empty
         }
-        
-        // Calculate available items
-        size_t available = (head - tail) & mask_;
-        if (head < tail) {
-            available = capacity_ - tail + head;
-        }
-        
-        size_t count = std::min(available, max_count);
+
         out.reserve(out.size() + count);
-        
-        size_t current = tail;
         for (size_t i = 0; i < count; ++i) {
-            out.push_back(std::move(buffer_[current]));
-            current = (current + 1) & mask_;
+            out.push_back(std::move(span[i]));
         }
-        
-        tail_.store(current, std::memory_order_release);
+
+        commit_read(count);
         return count;
     }
-    
+
+    /**
+     * Consumer side: wait until an item is available (spin, yield, then park)
+     */
+    bool wait_for_data(std::chrono::nanoseconds timeout) {
+        return hybrid_wait(*data_parker_, [this] { return !empty(); }, timeout);
+    }
+
+    /**
+     * Producer side: wait until a slot is free (spin, yield, then park)
+     */
+    bool wait_for_space(std::chrono::nanoseconds timeout) {
+        return hybrid_wait(*space_parker_, [this] { return !full(); }, timeout);
+    }
+
+    Parker& data_parker() { return *data_parker_; }
+    Parker& space_parker() { return *space_parker_; }
+
     size_t size() const {
-        const size_t head = head_.load(std::memory_order_acquire);
+        // Read tail first: head only grows, so the difference never underflows
         const size_t tail = tail_.load(std::memory_order_acquire);
-        return (head - tail) & mask_;
+        const size_t head = head_.load(std::memory_order_acquire);
+        return head - tail;
     }
-    
+
     bool empty() const {
-        return head_.load(std::memory_order_acquire) == 
+        return head_.load(std::memory_order_acquire) ==
                tail_.load(std::memory_order_acquire);
     }
-    
+
+    bool full() const {
+        return size() >= capacity_;
+    }
+
     size_t capacity() const { return capacity_; }
 
+    // Slot storage, e.g. to move it to the consumer's NUMA node
+    const T* slots() const { return buffer_.data(); }
+    size_t slots_bytes() const { return buffer_.size() * sizeof(T); }
+
 private:
     static size_t next_power_of_2(size_t n) {
         n--;
@@ -114,13 +218,32 @@ private:
         return n + 1;
     }
 
+    Span make_span(size_t start, size_t count) {
+        Span span;
+        if (count == 0) return span;
+        const size_t idx = start & mask_;
+        span.first = &buffer_[idx];
+        span.first_len = std::min(count, capacity_ - idx);
+        span.second_len = count - span.first_len;
+        span.second = span.second_len ? buffer_.data() : nullptr;
+        return span;
+    }
+
     const size_t capacity_;
     const size_t mask_;
     std::vector<T> buffer_;
-    
+
+    Parker own_data_parker_;
+    Parker own_space_parker_;
+    Parker* const data_parker_;     // Consumer parks here, producer notifies
+    Parker* const space_parker_;    // Producer parks here, consumer notifies
+
     // Cache-line padding to prevent false sharing
+    // Each index shares its line with the owning side's cached copy of the other
     alignas(64) std::atomic<size_t> head_;
+    size_t cached_tail_ = 0;        // Producer-owned
     alignas(64) std::atomic<size_t> tail_;
+    size_t cached_head_ = 0;        // Consumer-owned
 };
 
 } // namespace ingester
@@ -0,0 +1,198 @@
+#include "router.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace ingester {
+
+namespace {
+
+std::vector<std::string> split(const std::string& text, char sep) {
+    std::vector<std::string> out;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, sep)) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+bool parse_field(const std::string& name, LogColumn& field) {
+    if (name == "app_id") field = kAppId;
+    else if (name == "source") field = kSource;
+    else if (name == "environment") field = kEnvironment;
+    else if (name == "level") field = kLevel;
+    else return false;
+    return true;
+}
+
+bool parse_level(const std::string& name, int8_t& level) {
+    for (size_t i = 0; i < std::size(kLogLevels); ++i) {
+        if (name == kLogLevels[i]) {
+            level = static_cast<int8_t>(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_positive(const std::string& text, long& out) {
+    char* end = nullptr;
+    out = std::strtol(text.c_str(), &end, 10);
+    return end != text.c_str() && *end == '\0' && out > 0;
+}
+
+std::string_view column_value(const LogEntry& entry, LogColumn column) {
+    switch (column) {
+        case kAppId: return entry.app_id;
+        case kSource: return entry.source;
+        case kEnvironment: return entry.environment;
+        case kTraceId: return entry.trace_id;
+        case kUserId: return entry.user_id;
+        default: return {};
+    }
+}
+
+// One spec per shard unless the route has its own host; `dir` is where its spills go
+void add_route(const Config& base, RouteSpec route, bool own_host, const std::string& dir,
+               std::vector<RouteSpec>& out) {
+    const std::vector<std::string> shards = own_host ? std::vector<std::string>{} : split(base.clickhouse_shards, ';');
+    if (shards.empty()) {
+        if (!dir.empty()) route.config.spill_dir = dir;
+        out.push_back(std::move(route));
+        return;
+    }
+    const int writers = route.config.writer_threads;
+    const int per_shard = std::max<int>(1, (writers + static_cast<int>(shards.size()) - 1) / static_cast<int>(shards.size()));
+    for (size_t s = 0; s < shards.size(); ++s) {
+        RouteSpec spec = route;
+        spec.name = route.name + "/" + std::to_string(s);
+        spec.shard = s;
+        spec.shards = shards.size();
+        spec.config.clickhouse_host = shards[s];
+        spec.config.writer_threads = per_shard;
+        if (!dir.empty()) spec.config.spill_dir = dir + "/shard-" + std::to_string(s);
+        out.push_back(std::move(spec));
+    }
+}
+
+} // namespace
+
+bool parse_shard_key(const std::string& name, LogColumn& column) {
+    if (name == "trace_id") column = kTraceId;
+    else if (name == "user_id") column = kUserId;
+    else return parse_field(name, column) && column != kLevel;
+    return true;
+}
+
+bool parse_routes(const Config& base, std::vector<RouteSpec>& out, std::string& error) {
+    out.clear();
+    // On a sharded cluster rows go to the local table of each shard
+    Config sharded = base;
+    if (!base.clickhouse_shards.empty() && !base.clickhouse_local_table.empty()) {
+        sharded.clickhouse_table = base.clickhouse_local_table;
+    }
+    RouteSpec fallback;
+    fallback.name = "default";
+    fallback.config = sharded;
+    add_route(base, std::move(fallback), false, base.spill_dir, out);
+
+    for (const std::string& spec : split(base.routes, ';')) {
+        std::stringstream in(spec);
+        RouteSpec route;
+        route.config = sharded;
+        bool own_host = false;
+        bool own_table = false;
+        if (!(in >> route.name)) continue;
+
+        std::string token;
+        while (in >> token) {
+            const size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                error = route.name + ": expected key=value, got '" + token + "'";
+                return false;
+            }
+            const std::string key = token.substr(0, eq);
+            const std::string value = token.substr(eq + 1);
+            long number = 0;
+            LogColumn field;
+            if (parse_field(key, field)) {
+                if (route.field != kLogColumnCount) {
+                    error = route.name + ": only one match field per route";
+                    return false;
+                }
+                route.field = field;
+                for (const std::string& v : split(value, ',')) {
+                    int8_t level;
+                    if (field != kLevel) route.values.push_back(v);
+                    else if (parse_level(v, level)) route.levels.push_back(level);
+                    else {
+                        error = route.name + ": unknown level '" + v + "'";
+                        return false;
+                    }
+                }
+            } else if (key == "table") {
+                route.config.clickhouse_table = value;
+                own_table = true;
+            } else if (key == "host" && !value.empty()) {
+                // Replicas with optional ports, parsed by Config::clickhouse_replicas
+                route.config.clickhouse_host = value;
+                own_host = true;
+            } else if ((key == "writers" || key == "batch" || key == "linger_ms") && parse_positive(value, number)) {
+                if (key == "writers") route.config.writer_threads = static_cast<int>(number);
+                else if (key == "batch") route.config.batch_size = static_cast<size_t>(number);
+                else route.config.max_linger_ms = static_cast<int>(number);
+            } else {
+                error = route.name + ": unknown or invalid '" + token + "'";
+                return false;
+            }
+        }
+        if (route.field == kLogColumnCount) {
+            error = route.name + ": no match (app_id=, source=, environment= or level=)";
+            return false;
+        }
+        // Its own cluster is not sharded, so no local table there either
+        if (own_host && !own_table) route.config.clickhouse_table = base.clickhouse_table;
+
+        // Spilled batches replay into their own route's table
+        const std::string dir = base.spill_dir.empty() ? "" : base.spill_dir + "/route-" + route.name;
+        add_route(base, std::move(route), own_host, dir, out);
+    }
+
+    // Replica lists of every route and shard, so a bad port fails here and not at connect
+    std::vector<HostPort> replicas;
+    for (const RouteSpec& route : out) {
+        std::string replica_error;
+        if (!route.config.parse_replicas(replicas, replica_error)) {
+            error = route.name + ": " + replica_error;
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t Router::shard(const LogEntry& entry, size_t first) const {
+    const size_t shards = routes_[first].shards;
+    if (shards == 1) return first;
+    return first + hash_bytes(column_value(entry, shard_key_)) % shards;
+}
+
+size_t Router::route(const LogEntry& entry) const {
+    for (size_t i = routes_.front().shards; i < routes_.size(); i += routes_[i].shards) {
+        const RouteSpec& route = routes_[i];
+        if (route.field == kLevel) {
+            for (int8_t level : route.levels) {
+                if (entry.level == level) return shard(entry, i);
+            }
+            continue;
+        }
+        const std::string_view value = column_value(entry, route.field);
+        for (const std::string& v : route.values) {
+            if (value == v) return shard(entry, i);
+        }
+    }
+    return shard(entry, 0);
+}
+
+} // namespace ingester
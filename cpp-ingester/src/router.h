@@ -0,0 +1,67 @@
+#pragma once
+
+#include "config.h"
+#include "log_entry.h"
+#include "log_schema.h"
+
+#include <string>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * One insert route: a match on one field and the pool that writes it
+ *
+ * Each route has its own rings (or dispatch queue), writer threads, flush
+ * policy and connections, so a busy route's big batches and a quiet
+ * route's linger never hold each other up.
+ *
+ * With CLICKHOUSE_SHARDS a route becomes one spec per shard, in a row:
+ * same match, the shard's replicas as host and the local table, and the
+ * route's writers spread over them. Rows pick a shard by SHARD_KEY hash.
+ */
+struct RouteSpec {
+    std::string name;
+    LogColumn field = kLogColumnCount;      // kAppId | kSource | kEnvironment | kLevel; kLogColumnCount = default
+    std::vector<std::string> values;        // For string fields
+    std::vector<int8_t> levels;             // For kLevel (Enum8 values)
+    size_t shard = 0;                       // This spec's shard of the route
+    size_t shards = 1;                      // Specs of the route (1 = unsharded)
+    Config config;                          // Base settings with the route's overrides
+};
+
+/**
+ * Parse ROUTES into `out`: route 0 is always the default route (the base
+ * config), then one per ';'-separated spec:
+ *
+ *   <name> <field>=<v1>,<v2> [table=T] [host=H[:port],...] [writers=N] [batch=N] [linger_ms=N]
+ *
+ * with <field> one of app_id, source, environment, level. First match wins.
+ * A route with its own host= is not sharded.
+ */
+bool parse_routes(const Config& base, std::vector<RouteSpec>& out, std::string& error);
+
+/**
+ * Route lookup on the reader thread
+ */
+class Router {
+public:
+    Router(const std::vector<RouteSpec>& routes, LogColumn shard_key = kAppId)
+        : routes_(routes), shard_key_(shard_key) {}
+
+    size_t size() const { return routes_.size(); }
+
+    // Index into the routes; the default route's specs when nothing matches
+    size_t route(const LogEntry& entry) const;
+
+private:
+    size_t shard(const LogEntry& entry, size_t first) const;
+
+    const std::vector<RouteSpec>& routes_;
+    const LogColumn shard_key_;
+};
+
+// SHARD_KEY name to column; false if not a string column the router can hash
+bool parse_shard_key(const std::string& name, LogColumn& column);
+
+} // namespace ingester
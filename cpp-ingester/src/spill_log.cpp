@@ -0,0 +1,341 @@
+#include "spill_log.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ingester {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t kRecordMagic = 0x314c5053;   // "SPL1"
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t columns;
+    uint64_t rows;
+    uint64_t payload_len;
+    uint64_t checksum;
+};
+
+struct ColumnHeader {
+    uint64_t type;
+    uint64_t prefix_len;
+    uint64_t body_len;
+};
+
+uint64_t checksum(const char* data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+bool sync_range(char* base, size_t offset, size_t len) {
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset & ~(page - 1);
+    return msync(base + start, offset + len - start, MS_SYNC) == 0;
+}
+
+} // namespace
+
+SpillLog::SpillLog(std::string dir, size_t segment_bytes, size_t max_bytes)
+    : dir_(std::move(dir))
+    , segment_bytes_(std::max<size_t>(segment_bytes, 1 << 20))
+    , max_bytes_(max_bytes) {}
+
+SpillLog::~SpillLog() {
+    for (auto& segment : segments_) close_segment(*segment, false);
+}
+
+std::string SpillLog::segment_path(uint64_t seq) const {
+    char name[48];
+    std::snprintf(name, sizeof(name), "spill-%020llu.log", static_cast<unsigned long long>(seq));
+    return dir_ + "/" + name;
+}
+
+SpillLog::Segment* SpillLog::open_segment(uint64_t seq, size_t size, bool create) {
+    const std::string path = segment_path(seq);
+    int fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+    if (fd < 0) {
+        LOG_ERROR("spill") << "cannot open " << path << ": " << std::strerror(errno);
+        return nullptr;
+    }
+    // Blocks are allocated up front: a store into a hole of a sparse file
+    // on a full disk would raise SIGBUS, here it is an ENOSPC
+    int err = create ? posix_fallocate(fd, 0, static_cast<off_t>(size)) : 0;
+    if (err != 0) {
+        // Writers retry while the spill is full, so this repeats until space frees up
+        INGESTER_LOG_EVERY(LogLevel::kError, "spill", 1) << "cannot allocate " << path << ": " << std::strerror(err);
+        ::close(fd);
+        ::unlink(path.c_str());
+        return nullptr;
+    }
+    void* map = size ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : nullptr;
+    if (map == MAP_FAILED) {
+        LOG_ERROR("spill") << "cannot map " << path << ": " << std::strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+
+    auto segment = std::make_unique<Segment>();
+    segment->seq = seq;
+    segment->fd = fd;
+    segment->map = static_cast<char*>(map);
+    segment->size = size;
+    segments_.push_back(std::move(segment));
+    total_bytes_ += size;
+    return segments_.back().get();
+}
+
+void SpillLog::close_segment(Segment& segment, bool unlink_file) {
+    if (segment.map) munmap(segment.map, segment.size);
+    if (segment.fd >= 0) ::close(segment.fd);
+    if (unlink_file) ::unlink(segment_path(segment.seq).c_str());
+    segment.map = nullptr;
+    segment.fd = -1;
+}
+
+// End of the intact record at `offset`, or `offset` itself if there is none
+size_t SpillLog::next_record(const Segment& segment, size_t offset) const {
+    if (segment.size - offset < sizeof(RecordHeader)) return offset;
+    RecordHeader header;
+    std::memcpy(&header, segment.map + offset, sizeof(header));
+    if (header.magic != kRecordMagic || header.columns != kLogColumnCount) return offset;
+    if (header.payload_len > segment.size - offset - sizeof(header)) return offset;
+    const char* payload = segment.map + offset + sizeof(header);
+    if (checksum(payload, header.payload_len) != header.checksum) return offset;
+    return offset + sizeof(header) + header.payload_len;
+}
+
+bool SpillLog::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        LOG_ERROR("spill") << "cannot create " << dir_ << ": " << ec.message();
+        return false;
+    }
+
+    // Replay position of the previous run
+    uint64_t cursor_seq = 0;
+    size_t cursor_offset = 0;
+    std::ifstream(dir_ + "/cursor") >> cursor_seq >> cursor_offset;
+
+    std::vector<uint64_t> seqs;
+    for (const auto& file : fs::directory_iterator(dir_, ec)) {
+        unsigned long long seq;
+        if (std::sscanf(file.path().filename().c_str(), "spill-%llu.log", &seq) == 1) {
+            seqs.push_back(seq);
+        }
+    }
+    std::sort(seqs.begin(), seqs.end());
+
+    for (uint64_t seq : seqs) {
+        next_seq_ = seq + 1;
+        if (seq < cursor_seq) {
+            ::unlink(segment_path(seq).c_str());    // Replayed before the restart
+            continue;
+        }
+        size_t size = static_cast<size_t>(fs::file_size(segment_path(seq), ec));
+        if (ec || size == 0) {
+            ::unlink(segment_path(seq).c_str());
+            continue;
+        }
+        Segment* segment = open_segment(seq, size, false);
+        if (!segment) return false;
+        segment->sealed = true;     // New appends go to a fresh segment
+
+        size_t start = 0;
+        if (seq == cursor_seq) {
+            // Only trust the cursor if it sits on a record boundary
+            size_t boundary = 0;
+            while (boundary < cursor_offset) {
+                size_t next = next_record(*segment, boundary);
+                if (next == boundary) break;
+                boundary = next;
+            }
+            start = boundary == cursor_offset ? cursor_offset : 0;
+            read_offset_ = start;
+        }
+        
+        // A torn tail after a crash ends the segment
+        size_t records = 0;
+        segment->end = start;
+        for (size_t next; (next = next_record(*segment, segment->end)) != segment->end; ++records) {
+            segment->end = next;
+        }
+        pending_records_ += records;
+        pending_bytes_ += segment->end - start;
+    }
+
+    if (pending_records_ > 0) {
+        LOG_INFO("spill") << pending_records_ << " batches (" << (pending_bytes_ >> 20)
+                          << " MB) left from a previous run in " << dir_;
+    }
+    return true;
+}
+
+// Reserves the record in the active segment (or a new one), lets `fill`
+// write the payload there, then seals it with header and checksum
+template<typename Fill>
+bool SpillLog::append_record(size_t rows, size_t payload_len, Fill fill) {
+    const size_t record_len = sizeof(RecordHeader) + payload_len;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Segment* active = segments_.empty() ? nullptr : segments_.back().get();
+    if (!active || active->sealed || active->size - active->end < record_len) {
+        if (active) active->sealed = true;
+        size_t size = std::max(segment_bytes_, record_len);
+        if (max_bytes_ > 0 && total_bytes_ + size > max_bytes_) return false;
+        active = open_segment(next_seq_++, size, true);
+        if (!active) return false;
+    }
+
+    char* record = active->map + active->end;
+    fill(record + sizeof(RecordHeader));
+
+    RecordHeader header{kRecordMagic, static_cast<uint32_t>(kLogColumnCount), rows,
+                        payload_len, checksum(record + sizeof(RecordHeader), payload_len)};
+    std::memcpy(record, &header, sizeof(header));
+    if (!sync_range(active->map, active->end, record_len)) {
+        // Not durable, so not appended: the caller keeps the batch pending.
+        // The segment takes no more records after an I/O error.
+        LOG_ERROR("spill") << "msync of " << segment_path(active->seq) << " failed: " << std::strerror(errno);
+        std::memset(record, 0, sizeof(RecordHeader));   // Nor replayed after a restart
+        active->sealed = true;
+        return false;
+    }
+
+    active->end += record_len;
+    ++pending_records_;
+    pending_bytes_ += record_len;
+    return true;
+}
+
+bool SpillLog::append(const ColumnarBatch& batch) {
+    // Sizes first, so the record is written once, straight into the mapping
+    size_t payload_len = 0;
+    batch.for_each_column([&](const ColumnSpec&, const auto& column) {
+        payload_len += sizeof(ColumnHeader);
+        column.write_prefix([&](const void*, size_t len) { payload_len += len; });
+        column.write_body([&](const void*, size_t len) { payload_len += len; });
+    });
+
+    return append_record(batch.rows(), payload_len, [&](char* w) {
+        batch.for_each_column([&](const ColumnSpec& spec, const auto& column) {
+            ColumnHeader header{static_cast<uint64_t>(spec.type), 0, 0};
+            char* header_at = w;
+            w += sizeof(header);
+            column.write_prefix([&](const void* data, size_t len) {
+                std::memcpy(w, data, len);
+                w += len;
+                header.prefix_len += len;
+            });
+            column.write_body([&](const void* data, size_t len) {
+                std::memcpy(w, data, len);
+                w += len;
+                header.body_len += len;
+            });
+            std::memcpy(header_at, &header, sizeof(header));
+        });
+    });
+}
+
+bool SpillLog::append(const SpillRecord& record) {
+    size_t payload_len = 0;
+    for (size_t i = 0; i < kLogColumnCount; ++i) {
+        payload_len += sizeof(ColumnHeader) + record.prefix[i].size() + record.body[i].size();
+    }
+
+    return append_record(record.rows, payload_len, [&](char* w) {
+        for (size_t i = 0; i < kLogColumnCount; ++i) {
+            ColumnHeader header{static_cast<uint64_t>(record.type[i]), record.prefix[i].size(),
+                                record.body[i].size()};
+            std::memcpy(w, &header, sizeof(header));
+            w += sizeof(header);
+            if (!record.prefix[i].empty()) std::memcpy(w, record.prefix[i].data(), record.prefix[i].size());
+            w += record.prefix[i].size();
+            if (!record.body[i].empty()) std::memcpy(w, record.body[i].data(), record.body[i].size());
+            w += record.body[i].size();
+        }
+    });
+}
+
+bool SpillLog::peek(SpillRecord& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!segments_.empty()) {
+        Segment& front = *segments_.front();
+        if (read_offset_ >= front.end) {
+            if (!front.sealed) return false;    // Active segment, caught up
+            close_segment(front, true);
+            total_bytes_ -= front.size;
+            segments_.pop_front();
+            read_offset_ = 0;
+            continue;
+        }
+
+        RecordHeader header;
+        std::memcpy(&header, front.map + read_offset_, sizeof(header));
+        const char* r = front.map + read_offset_ + sizeof(header);
+        out.rows = header.rows;
+        for (size_t i = 0; i < kLogColumnCount; ++i) {
+            ColumnHeader column;
+            std::memcpy(&column, r, sizeof(column));
+            r += sizeof(column);
+            out.type[i] = static_cast<ColumnType>(column.type);
+            out.prefix[i] = std::string_view(r, column.prefix_len);
+            r += column.prefix_len;
+            out.body[i] = std::string_view(r, column.body_len);
+            r += column.body_len;
+        }
+        peeked_end_ = read_offset_ + sizeof(header) + header.payload_len;
+        return true;
+    }
+    return false;
+}
+
+void SpillLog::consume() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (peeked_end_ == 0 || segments_.empty()) return;
+    pending_bytes_ -= peeked_end_ - read_offset_;
+    --pending_records_;
+    read_offset_ = peeked_end_;
+    peeked_end_ = 0;
+    save_cursor();
+}
+
+void SpillLog::save_cursor() {
+    const std::string path = dir_ + "/cursor";
+    {
+        std::ofstream out(path + ".tmp", std::ios::trunc);
+        out << segments_.front()->seq << " " << read_offset_ << "\n";
+    }
+    std::rename((path + ".tmp").c_str(), path.c_str());
+}
+
+bool SpillLog::empty() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_records_ == 0;
+}
+
+size_t SpillLog::pending_records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_records_;
+}
+
+size_t SpillLog::pending_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_bytes_;
+}
+
+} // namespace ingester
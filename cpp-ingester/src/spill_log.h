@@ -0,0 +1,115 @@
+#pragma once
+
+#include "column_batch.h"
+#include "log_schema.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace ingester {
+
+/**
+ * One spilled batch, as stored: the pre-encoded wire bytes of every column
+ * Views point into the mapped segment and stay valid until consume().
+ */
+struct SpillRecord {
+    size_t rows = 0;
+    ColumnType type[kLogColumnCount];
+    std::string_view prefix[kLogColumnCount];
+    std::string_view body[kLogColumnCount];
+};
+
+/**
+ * Append-only, mmap'd segment log for batches ClickHouse could not take
+ *
+ * Optimizations:
+ * - Batches are stored in their final wire encoding: spilling is a memcpy
+ *   into the mapping, replay streams the bytes back without re-encoding
+ * - Preallocated segments (posix_fallocate, so a full disk fails the
+ *   append instead of faulting on the mapping); one checked msync per
+ *   record, so a spilled batch is durable before its Redis IDs are ACKed
+ * - Fully replayed segments are unlinked; total size is capped
+ *
+ * Records carry a checksum, so a torn tail after a crash is ignored.
+ * Replay position is kept in a cursor file: a crash between replaying a
+ * record and persisting the cursor replays that record again.
+ *
+ * Thread-safe; appends come from writer threads, peek/consume from one
+ * replay thread.
+ */
+class SpillLog {
+public:
+    SpillLog(std::string dir, size_t segment_bytes, size_t max_bytes);
+    ~SpillLog();
+
+    SpillLog(const SpillLog&) = delete;
+    SpillLog& operator=(const SpillLog&) = delete;
+
+    /**
+     * Create the directory if needed and pick up segments of earlier runs
+     */
+    bool open();
+
+    /**
+     * Durably store `batch`; false if the size cap is reached, the disk is
+     * full or I/O fails
+     */
+    bool append(const ColumnarBatch& batch);
+
+    /**
+     * Durably store a record peeked from another log, bytes unchanged
+     */
+    bool append(const SpillRecord& record);
+
+    /**
+     * Oldest record not replayed yet; false if none
+     */
+    bool peek(SpillRecord& out);
+
+    /**
+     * Mark the record returned by the last peek() as replayed
+     */
+    void consume();
+
+    bool empty() const;
+    size_t pending_records() const;
+    size_t pending_bytes() const;
+
+private:
+    struct Segment {
+        uint64_t seq = 0;
+        int fd = -1;
+        char* map = nullptr;
+        size_t size = 0;        // Mapped (file) size
+        size_t end = 0;         // End of valid records
+        bool sealed = false;
+    };
+
+    std::string segment_path(uint64_t seq) const;
+    Segment* open_segment(uint64_t seq, size_t size, bool create);
+    void close_segment(Segment& segment, bool unlink_file);
+    size_t next_record(const Segment& segment, size_t offset) const;
+    template<typename Fill>
+    bool append_record(size_t rows, size_t payload_len, Fill fill);
+    void save_cursor();
+
+    const std::string dir_;
+    const size_t segment_bytes_;
+    const size_t max_bytes_;
+
+    mutable std::mutex mutex_;
+    std::deque<std::unique_ptr<Segment>> segments_;  // Oldest first; back is active
+    uint64_t next_seq_ = 0;
+    size_t read_offset_ = 0;        // Into segments_.front()
+    size_t peeked_end_ = 0;         // End of the record last peeked (0 = none)
+    size_t total_bytes_ = 0;
+    size_t pending_records_ = 0;
+    size_t pending_bytes_ = 0;
+};
+
+} // namespace ingester
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ingester {
+
+/**
+ * ACK gate for stream entries whose rows went to several writer pools
+ *
+ * A pb entry routed to several pools (routes or shards) ends each pool's
+ * part with its stream ID, so every pool handles the part as a whole group.
+ * The reader registers how many parts there are; each pool reports its
+ * part when written or spilled, and only the last report lets the ID
+ * through to the acker. A part that is neither written nor spilled never
+ * reports, so the entry stays pending and is redelivered whole; the
+ * redelivery registers its parts afresh.
+ *
+ * Optimizations:
+ * - Writers skip the lock entirely while no split entry is outstanding
+ *
+ * Thread-safe: expect() from readers, filter() from writer threads.
+ */
+class SplitAcks {
+public:
+    /**
+     * Hold the ID `id` of reader `reader_id` until `parts` parts are written
+     * Call before publishing any of the parts.
+     */
+    void expect(uint16_t reader_id, std::string_view id, size_t parts) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reader_id >= held_.size()) held_.resize(reader_id + 1);
+        if (held_[reader_id].insert_or_assign(std::string(id), parts).second) {
+            outstanding_.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Count the parts written with `ids` (one writer's IDs of reader
+     * `reader_id`); IDs of entries with parts still outstanding are removed
+     */
+    void filter(uint16_t reader_id, std::vector<std::string>& ids) {
+        if (outstanding_.load(std::memory_order_acquire) == 0) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reader_id >= held_.size() || held_[reader_id].empty()) return;
+        auto& held = held_[reader_id];
+        size_t kept = 0;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto it = held.find(ids[i]);
+            if (it != held.end()) {
+                if (--it->second > 0) continue;
+                held.erase(it);
+                outstanding_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            if (kept != i) ids[kept] = std::move(ids[i]);
+            ++kept;
+        }
+        ids.resize(kept);
+    }
+
+    // Split entries with parts not written yet
+    size_t outstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unordered_map<std::string, size_t>> held_;    // By reader: ID -> parts left
+    std::atomic<size_t> outstanding_{0};
+};
+
+} // namespace ingester
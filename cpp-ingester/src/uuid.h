@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace ingester {
+
+/**
+ * 128-bit UUID as ClickHouse sends it on the wire: high half, then low half
+ */
+struct Uuid {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool empty() const { return high == 0 && low == 0; }
+};
+
+/**
+ * UUIDv7 (RFC 9562): 48-bit Unix milliseconds, version, 74 random bits
+ * Sorts by time like ClickHouse's generateUUIDv7().
+ */
+inline Uuid make_uuid_v7(int64_t unix_ms, uint64_t rand_a, uint64_t rand_b) {
+    Uuid uuid;
+    uuid.high = (static_cast<uint64_t>(unix_ms) << 16) | 0x7000 | (rand_a & 0x0fff);
+    uuid.low = 0x8000000000000000ULL | (rand_b & 0x3fffffffffffffffULL);
+    return uuid;
+}
+
+/**
+ * Parse the canonical 8-4-4-4-12 hex form; returns false if malformed
+ */
+inline bool parse_uuid(std::string_view text, Uuid& out) {
+    if (text.size() != 36) return false;
+    uint64_t halves[2] = {0, 0};
+    int nibbles = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (c != '-') return false;
+            continue;
+        }
+        uint64_t v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+        uint64_t& half = halves[nibbles / 16];
+        half = (half << 4) | v;
+        ++nibbles;
+    }
+    out.high = halves[0];
+    out.low = halves[1];
+    return true;
+}
+
+/**
+ * SplitMix64: cheap per-thread randomness for UUID bits (not cryptographic)
+ */
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * FNV-1a: stable across builds and versions, unlike hash_bytes, for
+ * values that end up stored (deterministic ids, insert tokens)
+ */
+inline uint64_t stable_hash(std::string_view value, uint64_t seed = 0xcbf29ce484222325ULL) {
+    uint64_t h = seed;
+    for (unsigned char c : value) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * UUIDv7 whose 74 "random" bits come from where the row was read: the
+ * stream (`stream_seed` = stable_hash of its key), the entry's stream ID
+ * and the row within the entry. A redelivered entry gets the same ids.
+ */
+inline Uuid stream_uuid_v7(int64_t unix_ms, uint64_t stream_seed, std::string_view stream_id, uint32_t row) {
+    uint64_t state = stable_hash(stream_id, stream_seed) ^ (static_cast<uint64_t>(row) * 0x9e3779b97f4a7c15ULL);
+    uint64_t a = splitmix64(state);
+    uint64_t b = splitmix64(state);
+    return make_uuid_v7(unix_ms, a, b);
+}
+
+} // namespace ingester
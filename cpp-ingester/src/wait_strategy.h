@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace ingester {
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/**
+ * Futex-backed parking spot (condvar fallback off Linux)
+ *
+ * `notify()` is a fence plus one relaxed load unless someone is parked,
+ * so signalling after every push/pop is cheap on the hot path.
+ *
+ * Protocol: the waiter registers, snapshots the sequence, re-checks its
+ * condition and only then sleeps on the snapshot. The notifier publishes
+ * its data, fences, and bumps the sequence if it sees a waiter. Either the
+ * waiter sees the data or the notifier sees the waiter - no lost wakeups.
+ */
+class Parker {
+public:
+    template<typename Ready>
+    bool park_unless(Ready ready, std::chrono::nanoseconds timeout) {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t seen = seq_.load(std::memory_order_acquire);
+        if (!ready()) {
+            sleep(seen, timeout);
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return ready();
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) return;
+        notify_all();
+    }
+
+    // Unconditional wakeup (shutdown, config changes)
+    void notify_all() {
+#if defined(__linux__)
+        seq_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAKE_PRIVATE, INT_MAX,
+                nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lock(mutex_);
+        seq_.fetch_add(1, std::memory_order_release);
+        cv_.notify_all();
+#endif
+    }
+
+private:
+    void sleep(uint32_t seen, std::chrono::nanoseconds timeout) {
+#if defined(__linux__)
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(secs.count());
+        ts.tv_nsec = static_cast<long>((timeout - secs).count());
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq_), FUTEX_WAIT_PRIVATE, seen,
+                &ts, nullptr, 0);
+#else
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, timeout, [&] {
+            return seq_.load(std::memory_order_acquire) != seen;
+        });
+#endif
+    }
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word");
+
+    std::atomic<uint32_t> seq_{0};
+    std::atomic<uint32_t> waiters_{0};
+#if !defined(__linux__)
+    std::mutex mutex_;
+    std::condition_variable cv_;
+#endif
+};
+
+/**
+ * Spin, then yield, then park until `ready()` or timeout
+ * Returns the final value of `ready()`.
+ */
+template<typename Ready>
+bool hybrid_wait(Parker& parker, Ready ready, std::chrono::nanoseconds timeout) {
+    constexpr int kSpins = 256;
+    constexpr int kYields = 16;
+
+    for (int i = 0; i < kSpins; ++i) {
+        if (ready()) return true;
+        cpu_relax();
+    }
+    for (int i = 0; i < kYields; ++i) {
+        if (ready()) return true;
+        std::this_thread::yield();
+    }
+    if (timeout <= std::chrono::nanoseconds::zero()) return ready();
+    return parker.park_unless(ready, timeout);
+}
+
+} // namespace ingester